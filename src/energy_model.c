@@ -0,0 +1,130 @@
+#include <pebble.h>
+#include "energy_model.h"
+#include "glancing_api.h"
+#include "get_weather.h"
+
+// Nominal currents above the watch's own idle draw, to be calibrated
+// against the measured drain.  Charges are in uA x ms.
+#define ENERGY_ACCEL_10HZ_UA 30
+#define ENERGY_ACCEL_25HZ_UA 50
+#define ENERGY_ACCEL_50HZ_UA 90
+#define ENERGY_BATCH_UA_MS 5000     // CPU awake about 1ms per batch at 5mA
+#define ENERGY_SAMPLE_UA_MS 50      // ... and about 10us per sample
+#define ENERGY_LIGHT_UA 9000
+#define ENERGY_MESSAGE_UA_MS 150000 // Radio up about 15ms per message at 10mA
+#define ENERGY_BYTE_UA_MS 100
+
+// Smallest of the supported watches' batteries
+#define ENERGY_BATTERY_MAH 130
+
+#define UA_MS_PER_UAH (60 * 60 * 1000)
+
+static uint64_t s_start_ms;
+static GlanceStats s_start_glance;
+static ForecastIOWeatherStats s_start_weather;
+
+// Battery level at the first step down and when, the time 0 until then.
+// The level is -1 while charging.
+static int32_t s_start_percent = -1;
+static uint64_t s_start_percent_ms;
+static int32_t s_last_percent;
+static uint64_t s_last_drop_ms;
+
+static uint64_t now_ms() {
+  time_t sec;
+  uint16_t ms;
+  time_ms(&sec, &ms);
+  return (uint64_t)sec * 1000 + ms;
+}
+
+static void start_battery_measurement(BatteryChargeState charge_state) {
+  s_start_percent = charge_state.is_charging ? -1 : charge_state.charge_percent;
+  s_start_percent_ms = 0;
+  s_last_percent = s_start_percent;
+  s_last_drop_ms = 0;
+}
+
+void energy_model_restart() {
+  s_start_ms = now_ms();
+  glancing_service_get_stats(&s_start_glance);
+  forecast_io_weather_get_stats(&s_start_weather);
+  start_battery_measurement(battery_state_service_peek());
+}
+
+void energy_model_battery(BatteryChargeState charge_state) {
+  const uint64_t now = now_ms();
+  if (charge_state.is_charging || (s_start_percent < 0) || (charge_state.charge_percent > s_last_percent)) {
+    // Charging spoils the measurement, start again once it is over
+    start_battery_measurement(charge_state);
+    return;
+  }
+  if (charge_state.charge_percent < s_last_percent) {
+    if (!s_start_percent_ms) {
+      s_start_percent = charge_state.charge_percent;
+      s_start_percent_ms = now;
+    }
+    else {
+      s_last_drop_ms = now;
+    }
+    s_last_percent = charge_state.charge_percent;
+  }
+}
+
+static uint32_t to_uah(uint64_t ua_ms) {
+  return ua_ms / UA_MS_PER_UAH;
+}
+
+void energy_model_estimate(EnergyEstimate *estimate) {
+  GlanceStats glance;
+  ForecastIOWeatherStats weather;
+  glancing_service_get_stats(&glance);
+  forecast_io_weather_get_stats(&weather);
+
+  const uint64_t now = now_ms();
+  memset(estimate, 0, sizeof(*estimate));
+  estimate->elapsed_ms = now - s_start_ms;
+
+  const uint64_t accel = (uint64_t)ENERGY_ACCEL_10HZ_UA * (glance.sampling_10hz_ms - s_start_glance.sampling_10hz_ms) +
+                         (uint64_t)ENERGY_ACCEL_25HZ_UA * (glance.sampling_25hz_ms - s_start_glance.sampling_25hz_ms) +
+                         (uint64_t)ENERGY_ACCEL_50HZ_UA * (glance.sampling_50hz_ms - s_start_glance.sampling_50hz_ms);
+  const uint64_t cpu = (uint64_t)ENERGY_BATCH_UA_MS * (glance.batches - s_start_glance.batches) +
+                       (uint64_t)ENERGY_SAMPLE_UA_MS * (glance.samples - s_start_glance.samples);
+  const uint64_t light = (uint64_t)ENERGY_LIGHT_UA * (glance.light_on_ms - s_start_glance.light_on_ms);
+  const uint32_t messages = (weather.messages_sent - s_start_weather.messages_sent) +
+                            (weather.messages_received - s_start_weather.messages_received);
+  const uint32_t bytes = (weather.bytes_sent - s_start_weather.bytes_sent) +
+                         (weather.bytes_received - s_start_weather.bytes_received);
+  const uint64_t radio = (uint64_t)ENERGY_MESSAGE_UA_MS * messages + (uint64_t)ENERGY_BYTE_UA_MS * bytes;
+
+  estimate->accel_uah = to_uah(accel);
+  estimate->cpu_uah = to_uah(cpu);
+  estimate->light_uah = to_uah(light);
+  estimate->radio_uah = to_uah(radio);
+  if (estimate->elapsed_ms) {
+    estimate->estimated_ua = (accel + cpu + light + radio) / estimate->elapsed_ms;
+  }
+
+  // The battery level moves in steps, so measure from the first step down
+  // to the last rather than from the restart to now.  This is the whole
+  // watch, not just this app.
+  estimate->measured_ua = -1;
+  if ((s_start_percent >= 0) && s_start_percent_ms && (s_last_drop_ms > s_start_percent_ms)) {
+    const uint64_t drained_uah = (uint64_t)(s_start_percent - s_last_percent) * ENERGY_BATTERY_MAH * 10;
+    estimate->measured_ua = drained_uah * UA_MS_PER_UAH / (s_last_drop_ms - s_start_percent_ms);
+  }
+}
+
+void energy_model_format(char *buffer, size_t size) {
+  EnergyEstimate estimate;
+  energy_model_estimate(&estimate);
+
+  const int estimated = estimate.estimated_ua;
+  if (estimate.measured_ua < 0) {
+    snprintf(buffer, size, "%d.%02d/- mAh/h", estimated / 1000, (estimated % 1000) / 10);
+  }
+  else {
+    const int measured = estimate.measured_ua;
+    snprintf(buffer, size, "%d.%02d/%d.%02d mAh/h", estimated / 1000, (estimated % 1000) / 10,
+             measured / 1000, (measured % 1000) / 10);
+  }
+}
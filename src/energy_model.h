@@ -0,0 +1,37 @@
+#pragma once
+
+#include <pebble.h>
+
+// Rough model of what the glance service and the weather fetches cost in
+// battery, next to the drain measured from the battery level.
+//
+// The estimate integrates the time at each accelerometer rate, the
+// batches and samples handled, the time the backlight was held on, and
+// the AppMessage traffic, each at a nominal current.  Everything is since
+// energy_model_restart(), so restarting when the config changes gives
+// the cost of the new config.
+
+// Charge over the period, in uAh
+typedef struct EnergyEstimate {
+  uint32_t elapsed_ms;
+  uint32_t accel_uah;     // Accelerometer sampling
+  uint32_t cpu_uah;       // Waking for batches and processing samples
+  uint32_t light_uah;     // Backlight held on while glancing
+  uint32_t radio_uah;     // Weather AppMessages, retries included
+  // All of the above as uA averaged over the period, i.e. uAh per hour
+  uint32_t estimated_ua;
+  // Average drain from the battery level between its first and last steps
+  // down in the period, or -1 until it has stepped down twice
+  int32_t measured_ua;
+} EnergyEstimate;
+
+// Start measuring from now, from the current battery level
+void energy_model_restart();
+
+// Feed battery level changes in from the battery state service
+void energy_model_battery(BatteryChargeState charge_state);
+
+void energy_model_estimate(EnergyEstimate *estimate);
+
+// One debug row, estimated and measured mAh per hour
+void energy_model_format(char *buffer, size_t size);
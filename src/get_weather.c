@@ -18,49 +18,572 @@ static bool pending_refresh = false;
 
 static AppTimer *s_timeout_timer = NULL;
 static EventHandle s_event_handle;
+static EventHandle s_sent_event_handle;
+static EventHandle s_failed_event_handle;
+
+// Retries of the fetch in progress
+static AppTimer *s_retry_timer = NULL;
+static uint8_t s_retry_attempts = 0;
+// Set while a fetch waits for the phone to reconnect
+static bool s_fetch_on_connect = false;
+// Set while a fetch waits for another message to clear the outbox
+static bool s_fetch_when_free = false;
+static EventHandle s_connection_handle;
+
+static ForecastIOWeatherStats s_stats;
+static uint16_t s_inbox_size;
+
+// The forecast decoded from the FIOW_DATA days, one array per field so a
+// range of hours can be handed out without copying.  Day d fills hours
+// d * 24 to d * 24 + 23.  Days are persisted raw, and only read back and
+// decoded when a query needs them.
+//
+// Storage is a header in the first of the reserved keys, then a day per
+// key.  The header holds each day's start and CRC, so a day that hasn't
+// changed isn't written again, and a day read back is checked before it
+// is decoded.  The header itself is written at most once per message, and
+// only when it has changed.  It also keeps the location name, when the
+// forecast was last fetched and how often it is updated, so the next run
+// can start from them.
+typedef struct {
+  int8_t temperature_c[FORECASTIO_WEATHER_HOURS];
+  uint8_t precip_mm[FORECASTIO_WEATHER_HOURS];
+  uint8_t precip_probability[FORECASTIO_WEATHER_HOURS];
+  uint8_t wind_bearing[FORECASTIO_WEATHER_HOURS];
+  uint8_t wind_beaufort[FORECASTIO_WEATHER_HOURS];
+  uint8_t cloud_cover[FORECASTIO_WEATHER_HOURS];
+} ForecastStore;
+
+#define STORAGE_FORMAT 3
+#define HEADER_KEY FORECASTIO_WEATHER_PERSIST_KEY_FIRST
+
+typedef struct __attribute__((__packed__)) {
+  uint8_t format;
+  uint8_t days;
+  //! Version of the stored forecast, as named by the phone, 0 if unknown
+  uint32_t forecast_version;
+  //! Start of each day's first hour, 0 if there is no forecast for the day
+  uint32_t day_start[FORECASTIO_WEATHER_DAYS];
+  uint16_t day_crc[FORECASTIO_WEATHER_DAYS];
+  //! Epoch time the phone last brought the forecast up to date, by a
+  //! complete sync or a version saying nothing had changed, 0 if never
+  uint32_t fetched;
+  char name[FORECASTIO_WEATHER_BUFFER_SIZE];
+  //! Minutes between updates, as last set, 0 if never
+  uint32_t update_frequency_mins;
+} StorageHeader;
+
+static ForecastStore *s_store;
+static StorageHeader s_header;
+// As last read or written, to tell if s_header needs writing
+static StorageHeader s_saved_header;
+static bool s_header_read = false;
+// Bit per day decoded into s_store
+static uint8_t s_days_decoded = 0;
+// Slot of the oldest day, decoded first in s_store.  Days are decoded in
+// time order from there, so a run of days stays contiguous in the arrays
+// however far the ring has turned.
+static uint8_t s_decode_base = 0;
+
+// The sync being received: the version it leads to, its message count,
+// a bit per message received, and whether any of them was rejected
+static uint32_t s_sync_version = 0;
+static uint8_t s_sync_count = 0;
+static uint32_t s_sync_received = 0;
+static bool s_sync_failed = false;
+static AppTimer *s_gap_timer = NULL;
+
+static inline uint32_t day_key(uint8_t day) {
+  return FORECASTIO_WEATHER_PERSIST_KEY_FIRST + 1 + day;
+}
+
+// CRC-16/CCITT
+static uint16_t crc16(const uint8_t *data, size_t length) {
+  uint16_t crc = 0xffff;
+  while (length--) {
+    crc ^= *data++ << 8;
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+  }
+  return crc;
+}
+
+// Read the header, dropping any day that has gone from storage or doesn't
+// match its CRC.  The days are checked, not decoded.
+static void read_header() {
+  if (s_header_read) {
+    return;
+  }
+  s_header_read = true;
+
+  const bool exists = persist_exists(HEADER_KEY);
+  if (!exists || (persist_read_data(HEADER_KEY, &s_header, sizeof(s_header)) != sizeof(s_header)) ||
+      (s_header.format != STORAGE_FORMAT) || (s_header.days != FORECASTIO_WEATHER_DAYS)) {
+    memset(&s_header, 0, sizeof(s_header));
+    if (!exists) {
+      // Days from before the header were kept in keys 0 to 14
+      for (uint32_t key = 0; key <= 2 * FORECASTIO_WEATHER_DAYS; key++) {
+        if (persist_exists(key)) {
+          persist_delete(key);
+        }
+      }
+    }
+  }
+  s_saved_header = s_header;
+  s_header.format = STORAGE_FORMAT;
+  s_header.days = FORECASTIO_WEATHER_DAYS;
+
+  uint8_t data[FORECASTIO_WEATHER_DAY_SIZE];
+  for (uint8_t day = 0; day < FORECASTIO_WEATHER_DAYS; day++) {
+    if (s_header.day_start[day] &&
+        ((persist_read_data(day_key(day), data, sizeof(data)) != FORECASTIO_WEATHER_DAY_SIZE) ||
+         (crc16(data, sizeof(data)) != s_header.day_crc[day]))) {
+      APP_LOG(APP_LOG_LEVEL_WARNING, "Forecast day %d corrupt in storage", day);
+      s_header.day_start[day] = 0;
+      s_header.forecast_version = 0;
+    }
+  }
+}
+
+static void write_header() {
+  if (memcmp(&s_header, &s_saved_header, sizeof(s_header)) != 0) {
+    persist_write_data(HEADER_KEY, &s_header, sizeof(s_header));
+    s_saved_header = s_header;
+  }
+}
+
+static void set_forecast_version(uint32_t version) {
+  read_header();
+  s_header.forecast_version = version;
+}
+
+// When the oldest day changes every decoded day moves, so decode them again
+static void check_decode_base() {
+  read_header();
+  uint8_t oldest = 0;
+  for (uint8_t day = 0; day < FORECASTIO_WEATHER_DAYS; day++) {
+    if (s_header.day_start[day] &&
+        (!s_header.day_start[oldest] || (s_header.day_start[day] < s_header.day_start[oldest]))) {
+      oldest = day;
+    }
+  }
+  if (oldest != s_decode_base) {
+    s_decode_base = oldest;
+    s_days_decoded = 0;
+  }
+}
+
+// Where a day's first hour is decoded in s_store
+static inline int day_index(uint8_t day) {
+  return ((day + FORECASTIO_WEATHER_DAYS - s_decode_base) % FORECASTIO_WEATHER_DAYS) * FORECASTIO_WEATHER_HOURS_PER_DAY;
+}
+
+static bool day_decoded(uint8_t day) {
+  check_decode_base();
+  return s_days_decoded & (1 << day);
+}
+
+static void decode_day(uint8_t day, const uint8_t *data) {
+  check_decode_base();
+  for (int hour = 0; hour < FORECASTIO_WEATHER_HOURS_PER_DAY; hour++) {
+    const uint8_t *in = &data[hour * FORECASTIO_WEATHER_HOUR_SIZE];
+    const int i = day_index(day) + hour;
+    s_store->precip_mm[i] = in[0];
+    s_store->precip_probability[i] = in[1];
+    // Hours missing from the feed are sent as all zeros
+    s_store->temperature_c[i] = (in[2] == 0) ? FORECASTIO_WEATHER_NO_TEMPERATURE :
+                                (in[2] > 127 + 50) ? 127 : (int)in[2] - 50;
+    s_store->wind_bearing[i] = in[3] % 16;
+    s_store->wind_beaufort[i] = in[3] / 16;
+    s_store->cloud_cover[i] = in[4];
+  }
+  s_days_decoded |= 1 << day;
+}
+
+// Read a day back, checking it is the one the header describes
+static bool read_day(uint8_t day, uint8_t *data) {
+  read_header();
+  if (!s_header.day_start[day]) {
+    return false;
+  }
+  if ((persist_read_data(day_key(day), data, FORECASTIO_WEATHER_DAY_SIZE) != FORECASTIO_WEATHER_DAY_SIZE) ||
+      (crc16(data, FORECASTIO_WEATHER_DAY_SIZE) != s_header.day_crc[day])) {
+    APP_LOG(APP_LOG_LEVEL_WARNING, "Forecast day %d corrupt in storage", day);
+    s_header.day_start[day] = 0;
+    s_header.forecast_version = 0;
+    write_header();
+    return false;
+  }
+  return true;
+}
+
+static bool ensure_day_decoded(uint8_t day) {
+  if (day_decoded(day)) {
+    return true;
+  }
+  uint8_t data[FORECASTIO_WEATHER_DAY_SIZE];
+  if (!read_day(day, data)) {
+    return false;
+  }
+  decode_day(day, data);
+  return true;
+}
+
+// The day, and hour within it, that contains time
+static bool find_hour(time_t time, uint8_t *day, uint8_t *hour) {
+  if (!s_store) {
+    return false;
+  }
+  read_header();
+  for (uint8_t d = 0; d < FORECASTIO_WEATHER_DAYS; d++) {
+    const time_t start = s_header.day_start[d];
+    if (start && (time >= start) && (time < start + SECONDS_PER_DAY)) {
+      *day = d;
+      *hour = (time - start) / SECONDS_PER_HOUR;
+      return true;
+    }
+  }
+  return false;
+}
+
+static inline uint32_t read_le32(const uint8_t *in) {
+  return in[0] | (in[1] << 8) | (in[2] << 16) | ((uint32_t)in[3] << 24);
+}
+
+// A message of the forecast couldn't be applied, so what we hold isn't the
+// forecast its sync names.  The version left at 0 gets the whole forecast
+// sent next time.
+static void reject_forecast_message() {
+  set_forecast_version(0);
+  s_sync_failed = true;
+}
+
+// Store a day, unless storage already has it.  The header is left for
+// write_header().
+static void write_day(uint8_t day, uint32_t epoch_time, const uint8_t *data) {
+  read_header();
+  const uint16_t crc = crc16(data, FORECASTIO_WEATHER_DAY_SIZE);
+  if ((s_header.day_start[day] == epoch_time) && (s_header.day_crc[day] == crc)) {
+    s_stats.days_unchanged++;
+    if (day_decoded(day)) {
+      return;
+    }
+  }
+  else {
+    // Unknown until the phone names the forecast this is part of
+    set_forecast_version(0);
+    persist_write_data(day_key(day), data, FORECASTIO_WEATHER_DAY_SIZE);
+    s_header.day_start[day] = epoch_time;
+    s_header.day_crc[day] = crc;
+    s_stats.days_written++;
+  }
+
+  // Decode straight from the message rather than reading it back
+  if (s_store) {
+    decode_day(day, data);
+  }
+}
+
+static void store_day(const uint8_t *message, uint16_t length) {
+  if (length < FORECASTIO_WEATHER_DAY_HEADER_SIZE + FORECASTIO_WEATHER_DAY_SIZE) {
+    APP_LOG(APP_LOG_LEVEL_WARNING, "Forecast day too short: %d bytes", length);
+    reject_forecast_message();
+    return;
+  }
+  const uint8_t day = message[4];
+  if (day >= FORECASTIO_WEATHER_DAYS) {
+    APP_LOG(APP_LOG_LEVEL_WARNING, "Forecast day %d out of range", day);
+    reject_forecast_message();
+    return;
+  }
+  write_day(day, read_le32(message), &message[FORECASTIO_WEATHER_DAY_HEADER_SIZE]);
+}
+
+// Reads the FIOW_PACKED bit stream, most significant bit first.  Reading
+// past the end gives zeros and sets overrun.
+typedef struct {
+  const uint8_t *data;
+  uint16_t size_bits;
+  uint16_t position;
+  bool overrun;
+} BitReader;
+
+static uint32_t get_bits(BitReader *reader, uint8_t width) {
+  uint32_t value = 0;
+  while (width--) {
+    if (reader->position >= reader->size_bits) {
+      reader->overrun = true;
+      return 0;
+    }
+    const uint8_t byte = reader->data[reader->position >> 3];
+    value = (value << 1) | ((byte >> (7 - (reader->position & 7))) & 1);
+    reader->position++;
+  }
+  return value;
+}
+
+// Unpack one day's bits into the FIOW_DATA layout, a field at a time
+static bool unpack_day(BitReader *in, uint8_t *data) {
+  static const int8_t TEMPERATURE_STEPS[4] = { -2, -1, 1, 2 };
+
+  // Temperature, then each hour the same, a small step, or a new value
+  uint8_t value = get_bits(in, 8);
+  for (int h = 0; h < FORECASTIO_WEATHER_HOURS_PER_DAY; h++) {
+    if (h > 0 && get_bits(in, 1)) {
+      value = get_bits(in, 1) ? get_bits(in, 8) : value + TEMPERATURE_STEPS[get_bits(in, 2)];
+    }
+    data[h * FORECASTIO_WEATHER_HOUR_SIZE + 2] = value;
+  }
+
+  // Precipitation, runs of dry hours or an hour's probability and mm
+  int h = 0;
+  while (h < FORECASTIO_WEATHER_HOURS_PER_DAY && !in->overrun) {
+    uint8_t *hour = &data[h * FORECASTIO_WEATHER_HOUR_SIZE];
+    if (!get_bits(in, 1)) {
+      for (int run = get_bits(in, 5) + 1; run > 0 && h < FORECASTIO_WEATHER_HOURS_PER_DAY; run--, h++, hour += FORECASTIO_WEATHER_HOUR_SIZE) {
+        hour[0] = 0;
+        hour[1] = 0;
+      }
+      continue;
+    }
+    hour[1] = get_bits(in, 4) * FORECASTIO_WEATHER_PACKED_LEVEL;
+    hour[0] = get_bits(in, 4);
+    if (hour[0] == FORECASTIO_WEATHER_PACKED_MM_ESCAPE) {
+      hour[0] = get_bits(in, 8);
+    }
+    h++;
+  }
+
+  // Wind, then each hour the same or a new value
+  value = get_bits(in, 8);
+  for (h = 0; h < FORECASTIO_WEATHER_HOURS_PER_DAY; h++) {
+    if (h > 0 && get_bits(in, 1)) {
+      value = get_bits(in, 8);
+    }
+    data[h * FORECASTIO_WEATHER_HOUR_SIZE + 3] = value;
+  }
+
+  // Cloud cover likewise, in 4 bits
+  value = get_bits(in, 4);
+  for (h = 0; h < FORECASTIO_WEATHER_HOURS_PER_DAY; h++) {
+    if (h > 0 && get_bits(in, 1)) {
+      value = get_bits(in, 4);
+    }
+    data[h * FORECASTIO_WEATHER_HOUR_SIZE + 4] = value * FORECASTIO_WEATHER_PACKED_LEVEL;
+  }
+
+  return !in->overrun;
+}
+
+static void unpack_days(const uint8_t *message, uint16_t length) {
+  if ((length < 1) || (message[0] != FORECASTIO_WEATHER_PACKED_VERSION)) {
+    APP_LOG(APP_LOG_LEVEL_WARNING, "Packed forecast format %d unknown", length ? message[0] : -1);
+    reject_forecast_message();
+    return;
+  }
+
+  const uint8_t *in = message + 1;
+  const uint8_t *end = message + length;
+  while (end - in >= FORECASTIO_WEATHER_PACKED_DAY_HEADER_SIZE) {
+    const uint8_t day = in[4];
+    const uint8_t size = in[5];
+    BitReader reader = { .data = in + FORECASTIO_WEATHER_PACKED_DAY_HEADER_SIZE, .size_bits = size * 8 };
+    uint8_t data[FORECASTIO_WEATHER_DAY_SIZE];
+    if ((day >= FORECASTIO_WEATHER_DAYS) || (end - reader.data < size) || !unpack_day(&reader, data)) {
+      APP_LOG(APP_LOG_LEVEL_WARNING, "Packed forecast day %d is corrupt", day);
+      reject_forecast_message();
+      return;
+    }
+    write_day(day, read_le32(in), data);
+    in = reader.data + size;
+  }
+}
+
+static void patch_day(const uint8_t *message, uint16_t length) {
+  if (length < FORECASTIO_WEATHER_DAY_HEADER_SIZE) {
+    APP_LOG(APP_LOG_LEVEL_WARNING, "Forecast patch too short: %d bytes", length);
+    reject_forecast_message();
+    return;
+  }
+  const uint32_t epoch_time = read_le32(message);
+  const uint8_t day = message[4];
+
+  uint8_t data[FORECASTIO_WEATHER_DAY_SIZE];
+  if ((day >= FORECASTIO_WEATHER_DAYS) || (s_header.day_start[day] != epoch_time) || !read_day(day, data)) {
+    // Not the day the phone thinks we have
+    APP_LOG(APP_LOG_LEVEL_WARNING, "Forecast patch for day %d doesn't match", day);
+    reject_forecast_message();
+    return;
+  }
+
+  const uint8_t *in = &message[FORECASTIO_WEATHER_DAY_HEADER_SIZE];
+  const uint8_t *end = message + length;
+  while (end - in >= 2) {
+    const uint8_t first = in[0];
+    const uint8_t count = in[1];
+    in += 2;
+    if ((first + count > FORECASTIO_WEATHER_HOURS_PER_DAY) || (end - in < count * FORECASTIO_WEATHER_HOUR_SIZE)) {
+      APP_LOG(APP_LOG_LEVEL_WARNING, "Forecast patch for day %d is corrupt", day);
+      reject_forecast_message();
+      return;
+    }
+    memcpy(&data[first * FORECASTIO_WEATHER_HOUR_SIZE], in, count * FORECASTIO_WEATHER_HOUR_SIZE);
+    in += count * FORECASTIO_WEATHER_HOUR_SIZE;
+  }
+
+  write_day(day, epoch_time, data);
+}
 
 static void timeout_timer_handler(void *);
+static void refresh_timer_handler(void *);
+static bool fetch();
+
+static inline uint32_t sync_missing() {
+  const uint32_t all = (s_sync_count == 32) ? 0xffffffff : (1u << s_sync_count) - 1;
+  return all & ~s_sync_received;
+}
+
+static void gap_timer_handler(void *context) {
+  s_gap_timer = NULL;
+  const uint32_t missing = sync_missing();
+  if (missing) {
+    APP_LOG(APP_LOG_LEVEL_WARNING, "Forecast sync %lu missing messages %08lx", (unsigned long)s_sync_version, (unsigned long)missing);
+    s_stats.sync_gaps++;
+    for (uint32_t bits = missing; bits; bits &= bits - 1) {
+      s_stats.sync_messages_missing++;
+    }
+    // The request carries the gaps
+    fetch();
+  }
+}
+
+// Note a message of a sync, returning false if it has been applied already
+static bool begin_sync_message(uint32_t version, uint32_t seq) {
+  const uint8_t index = seq & 0xff;
+  const uint8_t count = seq >> 8;
+  if ((count == 0) || (count > FORECASTIO_WEATHER_SYNC_MAX_MESSAGES) || (index >= count)) {
+    APP_LOG(APP_LOG_LEVEL_WARNING, "Forecast sync message %d of %d", index, count);
+    return false;
+  }
+  if ((version != s_sync_version) || (count != s_sync_count)) {
+    s_sync_version = version;
+    s_sync_count = count;
+    s_sync_received = 0;
+    s_sync_failed = false;
+  }
+  if (s_sync_received & (1u << index)) {
+    return false;
+  }
+  s_sync_received |= 1u << index;
+  return true;
+}
+
+static void end_sync_message() {
+  if (sync_missing()) {
+    // Wait for the rest, or for the phone to give up on them
+    if (!s_gap_timer || !app_timer_reschedule(s_gap_timer, FORECASTIO_WEATHER_GAP_TIMEOUT_MS)) {
+      s_gap_timer = app_timer_register(FORECASTIO_WEATHER_GAP_TIMEOUT_MS, gap_timer_handler, NULL);
+    }
+    return;
+  }
+  if (s_gap_timer) {
+    app_timer_cancel(s_gap_timer);
+    s_gap_timer = NULL;
+  }
+  if (s_sync_failed) {
+    // Left at 0, and not fresh, so the next fetch gets the whole forecast
+    APP_LOG(APP_LOG_LEVEL_WARNING, "Forecast sync %lu had messages rejected", (unsigned long)s_sync_version);
+    return;
+  }
+  set_forecast_version(s_sync_version);
+  s_header.fetched = time(NULL);
+}
+
+static inline uint32_t update_interval_s() {
+  return s_update_frequency_mins * SECONDS_PER_MINUTE;
+}
+
+// Seconds until the stored forecast is due an update, 0 if it is due now
+static uint32_t seconds_until_stale() {
+  read_header();
+  const time_t now = time(NULL);
+  if (!s_header.fetched || (now < (time_t)s_header.fetched) ||
+      (now - (time_t)s_header.fetched >= update_interval_s())) {
+    return 0;
+  }
+  return update_interval_s() - (now - s_header.fetched);
+}
+
+static void schedule_refresh(uint32_t delay_s) {
+  // Ensure we're not pending an update, before rescheduling
+  const int retry_interval_ms = delay_s * 1000;
+  if (pending_refresh) {
+    // Reschedule existing timer
+    app_timer_reschedule(s_update_timer, retry_interval_ms);
+  }
+  else {
+    // Create timer
+    s_update_timer = app_timer_register(retry_interval_ms, refresh_timer_handler, NULL);
+    pending_refresh = true;
+  }
+}
 
 static bool js_ready = false;
 static void inbox_received_handler(DictionaryIterator *iter, void *context) {
   Tuple *reply_tuple = dict_find(iter, MESSAGE_KEY_FIOW_REPLY);
+  if(reply_tuple || dict_find(iter, MESSAGE_KEY_FIOW_BADKEY) ||
+     dict_find(iter, MESSAGE_KEY_FIOW_LOCATIONUNAVAILABLE) || dict_find(iter, MESSAGE_KEY_JSReady)) {
+    s_stats.messages_received++;
+    s_stats.bytes_received += dict_size(iter);
+  }
+
   if(reply_tuple) {
     
     Tuple *name_tuple = dict_find(iter, MESSAGE_KEY_FIOW_NAME);
     if (name_tuple) {
-      strncpy(s_info->name, name_tuple->value->cstring, FORECASTIO_WEATHER_BUFFER_SIZE);
+      snprintf(s_info->name, FORECASTIO_WEATHER_BUFFER_SIZE, "%s", name_tuple->value->cstring);
       
       // Tell the user we're good to go
       s_status = ForecastIOWeatherStatusAvailable;
       s_callback(s_info, s_status);
       
-      // Ensure we're not pending an update, before rescheduling
-      const int retry_interval_ms = s_update_frequency_mins * 60 * 1000;
-      if (pending_refresh) {
-        // Reschedule existing timer
-        app_timer_reschedule(s_update_timer, retry_interval_ms);
-      }
-      else {
-        // Create timer
-        s_update_timer = app_timer_register(retry_interval_ms, timeout_timer_handler, NULL);
-        pending_refresh = true;
-      }
+      // Not fetched until the forecast is in too, which the name no longer
+      // waits for
+      snprintf(s_header.name, sizeof(s_header.name), "%s", s_info->name);
+      schedule_refresh(update_interval_s());
     }
 
+    // Messages of a sync go through the sequence check, repeats are dropped
+    Tuple *version_tuple = dict_find(iter, MESSAGE_KEY_FIOW_VERSION);
+    Tuple *seq_tuple = dict_find(iter, MESSAGE_KEY_FIOW_SEQ);
+    const bool in_sync = version_tuple && seq_tuple;
+    const bool apply = !in_sync || begin_sync_message(version_tuple->value->uint32, seq_tuple->value->uint32);
+
     Tuple *data_tuple = dict_find(iter, MESSAGE_KEY_FIOW_DATA);
-    if (data_tuple) {
-      uint8_t *data = data_tuple->value->data;
-      
-      uint32_t epoch_time = data[0] | (data[1] << 8) | (data[2] << 16) | (data[3] << 24);
-      uint32_t time_key = 2 * data[4];
-      uint32_t data_key = 2 * data[4] + 1;
-      
-      if (persist_exists(time_key)) persist_delete(time_key);
-      if (persist_exists(data_key)) persist_delete(data_key);
-      
-      persist_write_int(time_key, epoch_time);
-      persist_write_data(data_key, &data[5], 24 * 5);
+    if (data_tuple && apply) {
+      store_day(data_tuple->value->data, data_tuple->length);
+    }
+
+    Tuple *packed_tuple = dict_find(iter, MESSAGE_KEY_FIOW_PACKED);
+    if (packed_tuple && apply) {
+      unpack_days(packed_tuple->value->data, packed_tuple->length);
+    }
+
+    Tuple *patch_tuple = dict_find(iter, MESSAGE_KEY_FIOW_PATCH);
+    if (patch_tuple && apply) {
+      patch_day(patch_tuple->value->data, patch_tuple->length);
+    }
+
+    if (in_sync) {
+      end_sync_message();
+    }
+    else if (version_tuple) {
+      // Nothing had changed
+      set_forecast_version(version_tuple->value->uint32);
+      s_header.fetched = time(NULL);
     }
+    write_header();
 
   }
 
@@ -79,7 +602,14 @@ static void inbox_received_handler(DictionaryIterator *iter, void *context) {
   Tuple *ready_tuple = dict_find(iter, MESSAGE_KEY_JSReady);
   if(ready_tuple) {
     js_ready = true;
-    forecast_io_weather_fetch();
+    // No need to ask again if what we started with is recent enough
+    const uint32_t fresh_s = seconds_until_stale();
+    if (fresh_s) {
+      schedule_refresh(fresh_s);
+    }
+    else {
+      forecast_io_weather_fetch();
+    }
   }  
 }
 
@@ -88,30 +618,127 @@ static void fail_and_callback() {
   s_callback(s_info, s_status);
 }
 
-static void outbox_failed_handler(DictionaryIterator *iter, 
-                                      AppMessageResult reason, void *context) {
-  // Message failed before timer elapsed, reschedule for later
-  if(s_timeout_timer) {
+static void cancel_retry() {
+  if (s_retry_timer) {
+    app_timer_cancel(s_retry_timer);
+    s_retry_timer = NULL;
+  }
+  s_retry_attempts = 0;
+}
+
+static void retry_timer_handler(void *context) {
+  s_retry_timer = NULL;
+  s_stats.retries++;
+  fetch();
+}
+
+// The fetch failed, try it again after a backoff, or once the phone is
+// back if it has gone
+static void retry_later() {
+  if (s_timeout_timer) {
     app_timer_cancel(s_timeout_timer);
+    s_timeout_timer = NULL;
+  }
+  if (s_retry_timer) {
+    return;
+  }
+  if (!connection_service_peek_pebble_app_connection()) {
+    s_fetch_on_connect = true;
+    return;
+  }
+  if (s_retry_attempts >= FORECASTIO_WEATHER_RETRY_MAX_ATTEMPTS) {
+    APP_LOG(APP_LOG_LEVEL_WARNING, "Weather fetch failed %d times, waiting for the next update", s_retry_attempts);
+    s_stats.retry_give_ups++;
+    s_retry_attempts = 0;
+    schedule_refresh(update_interval_s());
+    return;
   }
 
+  uint32_t delay_ms = FORECASTIO_WEATHER_RETRY_BASE_MS << s_retry_attempts;
+  if (delay_ms > FORECASTIO_WEATHER_RETRY_MAX_MS) {
+    delay_ms = FORECASTIO_WEATHER_RETRY_MAX_MS;
+  }
+  delay_ms -= rand() % (delay_ms / 2 + 1);
+  s_retry_attempts++;
+  s_retry_timer = app_timer_register(delay_ms, retry_timer_handler, NULL);
+}
+
+// The outbox handlers hear of every message the app sends, the
+// watchface's own included, and only our requests are any of our business
+// beyond the outbox coming free
+static inline bool is_request(DictionaryIterator *iter) {
+  return iter && dict_find(iter, MESSAGE_KEY_FIOW_REQUEST);
+}
+
+static void outbox_free() {
+  if (s_fetch_when_free) {
+    s_fetch_when_free = false;
+    fetch();
+  }
+}
+
+static void outbox_failed_handler(DictionaryIterator *iter, 
+                                      AppMessageResult reason, void *context) {
+  if (!is_request(iter)) {
+    outbox_free();
+    return;
+  }
   // Inform the user of the failure
   fail_and_callback();
+  retry_later();
+}
 
-  // Use the timeout handler to perform the same action - resend the message
-  const int retry_interval_ms = 500;
-  app_timer_register(retry_interval_ms, timeout_timer_handler, NULL);
+static void connection_handler(bool connected) {
+  if (!connected) {
+    // Retrying can wait until the phone is back
+    if (s_retry_timer) {
+      cancel_retry();
+      s_fetch_on_connect = true;
+    }
+  }
+  else if (s_fetch_on_connect) {
+    s_fetch_on_connect = false;
+    cancel_retry();
+    fetch();
+  }
 }
 
 static bool fetch() {
+  if (!connection_service_peek_pebble_app_connection()) {
+    s_fetch_on_connect = true;
+    return false;
+  }
+
   DictionaryIterator *out;
   AppMessageResult result = app_message_outbox_begin(&out);
+  if (result == APP_MSG_BUSY) {
+    // Another of the app's messages is on its way, ours goes once it's
+    // through rather than counting as a failure
+    s_fetch_when_free = true;
+    return false;
+  }
   if(result != APP_MSG_OK) {
     fail_and_callback();
+    retry_later();
     return false;
   }
 
   dict_write_uint8(out, MESSAGE_KEY_FIOW_REQUEST, 1);
+  // So the phone can send only what has changed
+  read_header();
+  dict_write_uint32(out, MESSAGE_KEY_FIOW_VERSION, s_header.forecast_version);
+  // So it knows how much it can pack in a message
+  dict_write_uint16(out, MESSAGE_KEY_FIOW_INBOX, s_inbox_size);
+  // And how old a forecast it could send from its cache
+  dict_write_uint32(out, MESSAGE_KEY_FIOW_MAXAGE, update_interval_s());
+  const uint32_t missing = sync_missing();
+  if (missing) {
+    const uint8_t gaps[8] = {
+      s_sync_version & 0xff, (s_sync_version >> 8) & 0xff, (s_sync_version >> 16) & 0xff, s_sync_version >> 24,
+      missing & 0xff, (missing >> 8) & 0xff, (missing >> 16) & 0xff, missing >> 24,
+    };
+    dict_write_data(out, MESSAGE_KEY_FIOW_MISSING, gaps, sizeof(gaps));
+  }
 
   if(strlen(s_api_key) > 0)
     dict_write_cstring(out, MESSAGE_KEY_FIOW_APIKEY, s_api_key);
@@ -121,32 +748,49 @@ static bool fetch() {
     dict_write_int32(out, MESSAGE_KEY_FIOW_LONGITUDE, s_coordinates.longitude);
   }
 
+  // Schedule the timeout timer, before the send can be acked
+  if (s_timeout_timer) {
+    app_timer_cancel(s_timeout_timer);
+  }
+  s_timeout_timer = app_timer_register(FORECASTIO_WEATHER_ACK_TIMEOUT_MS, timeout_timer_handler, NULL);
+
+  const uint32_t size = dict_size(out);
   result = app_message_outbox_send();
   if(result != APP_MSG_OK) {
     fail_and_callback();
+    retry_later();
     return false;
   }
+  s_stats.messages_sent++;
+  s_stats.bytes_sent += size;
 
-  // Schedule the timeout timer
-  const int interval_ms = 1000;
-  s_timeout_timer = app_timer_register(interval_ms, timeout_timer_handler, NULL);  
-  
   s_status = ForecastIOWeatherStatusPending;
   s_callback(s_info, s_status);
   return true;
 }
 
 static void timeout_timer_handler(void *context) {
-  // Could update status here
-  
-  // Retry the message
+  s_timeout_timer = NULL;
+  retry_later();
+}
+
+static void refresh_timer_handler(void *context) {
   pending_refresh = false;
+  cancel_retry();
   fetch();
 }
 
 static void outbox_sent_handler(DictionaryIterator *iter, void *context) {
+  if (!is_request(iter)) {
+    outbox_free();
+    return;
+  }
   // Successful message, the timeout is not needed anymore for this message
-  app_timer_cancel(s_timeout_timer);
+  if (s_timeout_timer) {
+    app_timer_cancel(s_timeout_timer);
+    s_timeout_timer = NULL;
+  }
+  s_retry_attempts = 0;
 }
 
 void forecast_io_weather_init(ForecastIOWeatherCallback *callback) {
@@ -156,14 +800,54 @@ void forecast_io_weather_init(ForecastIOWeatherCallback *callback) {
 
   s_callback = callback;
   s_info = (ForecastIOWeatherInfo*)malloc(sizeof(ForecastIOWeatherInfo));
+  if(!s_store) {
+    s_store = (ForecastStore*)malloc(sizeof(ForecastStore));
+  }
+  s_header_read = false;
+  s_days_decoded = 0;
+  s_decode_base = 0;
+  s_sync_version = 0;
+  s_sync_count = 0;
+  s_sync_received = 0;
+  s_sync_failed = false;
+  // Cheap, and catches days lost from storage before anything asks for them
+  read_header();
+  write_header();
+  // So the stored forecast is judged fresh by the frequency it was
+  // fetched under, not the default, until the settings say otherwise
+  if (s_header.update_frequency_mins) {
+    s_update_frequency_mins = s_header.update_frequency_mins;
+  }
   s_api_key[0] = 0;
   s_coordinates = FORECASTIO_WEATHER_GPS_LOCATION;
   s_status = ForecastIOWeatherStatusNotYetFetched;
-  events_app_message_request_inbox_size(200);
-  events_app_message_request_outbox_size(100);
+  memset(&s_stats, 0, sizeof(s_stats));
+  s_inbox_size = app_message_inbox_size_maximum();
+  if (s_inbox_size > FORECASTIO_WEATHER_INBOX_SIZE) {
+    s_inbox_size = FORECASTIO_WEATHER_INBOX_SIZE;
+  }
+  events_app_message_request_inbox_size(s_inbox_size);
+  // Room for the largest fetch: request, version, inbox, max age, missing,
+  // API key, latitude and longitude
+  events_app_message_request_outbox_size(dict_calc_buffer_size(8, sizeof(uint8_t), sizeof(uint32_t),
+                                                               sizeof(uint16_t), sizeof(uint32_t),
+                                                               2 * sizeof(uint32_t), sizeof(s_api_key),
+                                                               sizeof(int32_t), sizeof(int32_t)));
   s_event_handle = events_app_message_register_inbox_received(inbox_received_handler, NULL);
-  app_message_register_outbox_sent(outbox_sent_handler);
-  app_message_register_outbox_failed(outbox_failed_handler);
+  // Through pebble-events, so the app's own AppMessage handlers don't
+  // replace these
+  s_sent_event_handle = events_app_message_register_outbox_sent(outbox_sent_handler, NULL);
+  s_failed_event_handle = events_app_message_register_outbox_failed(outbox_failed_handler, NULL);
+  s_connection_handle = events_connection_service_subscribe((ConnectionHandlers) {
+    .pebble_app_connection_handler = connection_handler
+  });
+
+  // Start from the last run's forecast, if there was one
+  if (s_header.fetched) {
+    snprintf(s_info->name, FORECASTIO_WEATHER_BUFFER_SIZE, "%s", s_header.name);
+    s_status = ForecastIOWeatherStatusAvailable;
+    s_callback(s_info, s_status);
+  }
 }
 
 void forecast_io_weather_set_api_key(const char *api_key) {
@@ -171,7 +855,7 @@ void forecast_io_weather_set_api_key(const char *api_key) {
     s_api_key[0] = 0;
   }
   else {
-    strncpy(s_api_key, api_key, sizeof(s_api_key));
+    snprintf(s_api_key, sizeof(s_api_key), "%s", api_key);
     if (js_ready) {
       fetch();
     }
@@ -180,7 +864,20 @@ void forecast_io_weather_set_api_key(const char *api_key) {
 
 void forecast_io_weather_set_update_frequency(uint32_t minutes) {
   s_update_frequency_mins = minutes;
-  fetch();
+  read_header();
+  s_header.update_frequency_mins = minutes;
+  write_header();
+  const uint32_t fresh_s = seconds_until_stale();
+  if (fresh_s) {
+    schedule_refresh(fresh_s);
+  }
+  else {
+    fetch();
+  }
+}
+
+uint32_t forecast_io_weather_get_update_frequency() {
+  return s_update_frequency_mins;
 }
 
 void forecast_io_weather_set_location(const ForecastIOWeatherCoordinates coordinates){
@@ -199,18 +896,102 @@ bool forecast_io_weather_fetch() {
   if(!bluetooth_connection_service_peek()) {
     s_status = ForecastIOWeatherStatusBluetoothDisconnected;
     s_callback(s_info, s_status);
+    s_fetch_on_connect = true;
     return false;
   }
 
+  cancel_retry();
   return fetch();
 }
 
+bool forecast_io_weather_fetch_waiting() {
+  return s_fetch_when_free;
+}
+
+void forecast_io_weather_get_stats(ForecastIOWeatherStats *stats) {
+  *stats = s_stats;
+}
+
+bool forecast_io_weather_forecast_at(time_t time, ForecastIOWeatherHour *hour) {
+  uint8_t day, day_hour;
+  if (!find_hour(time, &day, &day_hour) || !ensure_day_decoded(day)) {
+    return false;
+  }
+
+  const int i = day_index(day) + day_hour;
+  hour->time = s_header.day_start[day] + day_hour * SECONDS_PER_HOUR;
+  hour->temperature_c = s_store->temperature_c[i];
+  hour->precip_mm = s_store->precip_mm[i];
+  hour->precip_probability = s_store->precip_probability[i];
+  hour->wind_bearing = s_store->wind_bearing[i];
+  hour->wind_beaufort = s_store->wind_beaufort[i];
+  hour->cloud_cover = s_store->cloud_cover[i];
+  return true;
+}
+
+bool forecast_io_weather_forecast_range(time_t start, uint16_t hours, ForecastIOWeatherRange *range) {
+  uint8_t day, day_hour;
+  if (!find_hour(start, &day, &day_hour) || !ensure_day_decoded(day)) {
+    return false;
+  }
+
+  const int first = day_index(day) + day_hour;
+  range->start = s_header.day_start[day] + day_hour * SECONDS_PER_HOUR;
+  range->count = 0;
+  // Days follow on in the arrays from the oldest, so carry on round the
+  // ring while the next day starts where this one ends
+  while (true) {
+    range->count += FORECASTIO_WEATHER_HOURS_PER_DAY - day_hour;
+    const uint8_t next = (day + 1) % FORECASTIO_WEATHER_DAYS;
+    if ((range->count >= hours) || (next == s_decode_base) ||
+        (s_header.day_start[next] != s_header.day_start[day] + SECONDS_PER_DAY) || !ensure_day_decoded(next)) {
+      break;
+    }
+    day = next;
+    day_hour = 0;
+  }
+  if (range->count > hours) {
+    range->count = hours;
+  }
+
+  range->temperature_c = &s_store->temperature_c[first];
+  range->precip_mm = &s_store->precip_mm[first];
+  range->precip_probability = &s_store->precip_probability[first];
+  range->wind_bearing = &s_store->wind_bearing[first];
+  range->wind_beaufort = &s_store->wind_beaufort[first];
+  range->cloud_cover = &s_store->cloud_cover[first];
+  return true;
+}
+
 void forecast_io_weather_deinit() {
+  if(s_gap_timer) {
+    app_timer_cancel(s_gap_timer);
+    s_gap_timer = NULL;
+  }
+  if(s_timeout_timer) {
+    app_timer_cancel(s_timeout_timer);
+    s_timeout_timer = NULL;
+  }
+  if(s_update_timer && pending_refresh) {
+    app_timer_cancel(s_update_timer);
+  }
+  s_update_timer = NULL;
+  pending_refresh = false;
+  cancel_retry();
+  s_fetch_on_connect = false;
+  s_fetch_when_free = false;
+  if(s_store) {
+    free(s_store);
+    s_store = NULL;
+  }
   if(s_info) {
     free(s_info);
     s_info = NULL;
     s_callback = NULL;
     events_app_message_unsubscribe(s_event_handle);
+    events_app_message_unsubscribe(s_sent_event_handle);
+    events_app_message_unsubscribe(s_failed_event_handle);
+    events_connection_service_unsubscribe(s_connection_handle);
   }
 }
 
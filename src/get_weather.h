@@ -22,6 +22,25 @@ typedef enum {
   ForecastIOWeatherStatusLocationUnavailable
 } ForecastIOWeatherStatus;
 
+//! AppMessage traffic of the weather library since it was initialized
+typedef struct {
+  uint32_t messages_sent;
+  uint32_t bytes_sent;
+  uint32_t messages_received;
+  uint32_t bytes_received;
+  //! Fetches resent after a failure or timeout, and fetches given up on
+  //! after FORECASTIO_WEATHER_RETRY_MAX_ATTEMPTS
+  uint32_t retries;
+  uint32_t retry_give_ups;
+  //! Forecast syncs found incomplete, and messages asked for again
+  uint32_t sync_gaps;
+  uint32_t sync_messages_missing;
+  //! Forecast days written to storage, and days received that storage
+  //! already had
+  uint32_t days_written;
+  uint32_t days_unchanged;
+} ForecastIOWeatherStats;
+
 //! Possible weather conditions
 typedef enum {
   ForecastIOWeatherConditionClearSky = 0,
@@ -43,6 +62,117 @@ typedef struct {
 
 } ForecastIOWeatherInfo;
 
+//! Hourly forecast, held as a ring of day slots, day k after the first
+//! full sync going in slot k % 7.  PebbleKit JS sends a FIOW_DATA message
+//! to fill a slot with a new day, and a FIOW_PATCH of only the hours that
+//! changed for a day the watch already holds.  Both travel in a sync,
+//! below, whose messages name the forecast they lead to; the watch sends
+//! the version back with each request, so the phone knows what it holds.
+#define FORECASTIO_WEATHER_DAYS 7
+#define FORECASTIO_WEATHER_HOURS_PER_DAY 24
+#define FORECASTIO_WEATHER_HOURS (FORECASTIO_WEATHER_DAYS * FORECASTIO_WEATHER_HOURS_PER_DAY)
+//! Bytes per hour in FIOW_DATA: precipitation mm/h, precipitation probability,
+//! temperature + 50, Beaufort * 16 + bearing in 16ths, cloud cover
+#define FORECASTIO_WEATHER_HOUR_SIZE 5
+//! FIOW_DATA and FIOW_PATCH header: uint32_t epoch time of the first hour
+//! of the day, uint8_t slot.  FIOW_DATA follows it with the 24 hours,
+//! FIOW_PATCH with runs of uint8_t first hour, uint8_t count, then the hours.
+#define FORECASTIO_WEATHER_DAY_HEADER_SIZE 5
+#define FORECASTIO_WEATHER_DAY_SIZE (FORECASTIO_WEATHER_HOURS_PER_DAY * FORECASTIO_WEATHER_HOUR_SIZE)
+
+//! A whole day can also come bit packed, several to a FIOW_PACKED message:
+//! uint8_t format version, then per day uint32_t epoch time of the first
+//! hour, uint8_t slot, uint8_t size of the bits in bytes, and the bits,
+//! most significant first, a field at a time for the 24 hours:
+//!   temperature: 8 bits, then per hour 0 the same, 10 and 2 bits a step
+//!     of -2, -1, +1 or +2, or 11 and 8 bits
+//!   precipitation, until 24 hours are covered: 0 and 5 bits, a run of 1
+//!     to 32 hours with probability and mm both 0, or 1, 4 bits
+//!     probability, 4 bits mm, or 15 and 8 bits mm, for one hour
+//!   wind: 8 bits, then per hour 0 the same, or 1 and 8 bits
+//!   cloud cover: 4 bits, then per hour 0 the same, or 1 and 4 bits
+//! Probability and cloud cover are sent in 4 bits, level * 17, so the
+//! phone rounds them to that before sending either format.
+#define FORECASTIO_WEATHER_PACKED_VERSION 1
+#define FORECASTIO_WEATHER_PACKED_DAY_HEADER_SIZE 6
+#define FORECASTIO_WEATHER_PACKED_LEVEL 17
+#define FORECASTIO_WEATHER_PACKED_MM_ESCAPE 15
+
+//! Each message of a sync carries FIOW_VERSION, the version it leads to,
+//! and FIOW_SEQ, its index | message count << 8.  The phone keeps a few in
+//! flight and resends any that fail, so they can arrive out of order or
+//! twice; the watch applies each once, in any order, and takes the
+//! version when it has them all.  If a sync is still incomplete
+//! FORECASTIO_WEATHER_GAP_TIMEOUT_MS after its last message, the watch
+//! asks again with FIOW_MISSING, the uint32_t version and a uint32_t bit
+//! per missing message, and the phone resends only those.  When nothing
+//! has changed the phone sends FIOW_VERSION alone, without FIOW_SEQ, so
+//! the watch still knows its forecast is up to date.
+#define FORECASTIO_WEATHER_SYNC_MAX_MESSAGES 32
+#define FORECASTIO_WEATHER_GAP_TIMEOUT_MS 10000
+
+//! A fetch that fails, or isn't acked within
+//! FORECASTIO_WEATHER_ACK_TIMEOUT_MS, is retried after a backoff that
+//! starts at FORECASTIO_WEATHER_RETRY_BASE_MS and doubles each attempt, up
+//! to FORECASTIO_WEATHER_RETRY_MAX_MS, less a random jitter of up to half,
+//! so watches that lost the phone together don't retry together.  After
+//! FORECASTIO_WEATHER_RETRY_MAX_ATTEMPTS it gives up until the next
+//! scheduled update.  Retries wait while the phone is disconnected, and
+//! the fetch is made again when it reconnects.
+#define FORECASTIO_WEATHER_ACK_TIMEOUT_MS 1000
+#define FORECASTIO_WEATHER_RETRY_BASE_MS 1000
+#define FORECASTIO_WEATHER_RETRY_MAX_MS 60000
+#define FORECASTIO_WEATHER_RETRY_MAX_ATTEMPTS 6
+
+//! Largest inbox the weather library asks for, enough for a week packed
+//! in one or two messages.  The size is sent with each request.  So is
+//! FIOW_MAXAGE, the update frequency in seconds: the phone may answer from
+//! a forecast it cached for the location within that time.
+#define FORECASTIO_WEATHER_INBOX_SIZE 512
+
+//! The forecast is stored in persist keys from this one, a header
+//! (format, each day's start and CRC-16, and the forecast version) then
+//! a key per day, FORECASTIO_WEATHER_DAYS + 1 keys in all.  Keys 0 to 14,
+//! used before there was a header, are cleared on first run.
+#define FORECASTIO_WEATHER_PERSIST_KEY_FIRST 200
+#define FORECASTIO_WEATHER_PERSIST_KEYS (FORECASTIO_WEATHER_DAYS + 1)
+
+//! Temperature of an hour the forecast had no data for
+#define FORECASTIO_WEATHER_NO_TEMPERATURE INT8_MIN
+
+//! One hour of forecast
+typedef struct {
+  //! Start of the hour
+  time_t time;
+  //! Degrees C, or FORECASTIO_WEATHER_NO_TEMPERATURE
+  int8_t temperature_c;
+  //! mm/h rounded up, 255 for 255 or more
+  uint8_t precip_mm;
+  //! 0 to 255 for 0 to 1
+  uint8_t precip_probability;
+  //! Direction the wind comes from in 16ths of a circle, 0 is north
+  uint8_t wind_bearing;
+  //! 0 to 12
+  uint8_t wind_beaufort;
+  //! 0 to 255 for 0 to 1
+  uint8_t cloud_cover;
+} ForecastIOWeatherHour;
+
+//! Consecutive forecast hours, one array per field, each count entries.
+//! The arrays belong to the weather library and are only valid until the
+//! next forecast arrives or forecast_io_weather_deinit().
+typedef struct {
+  //! Start of the first hour
+  time_t start;
+  uint16_t count;
+  const int8_t *temperature_c;
+  const uint8_t *precip_mm;
+  const uint8_t *precip_probability;
+  const uint8_t *wind_bearing;
+  const uint8_t *wind_beaufort;
+  const uint8_t *cloud_cover;
+} ForecastIOWeatherRange;
+
 //! Struct containing coordinates
 typedef struct {
   //! Latitude of the coordinates x 100000 (eg : 42.123456 -> 4212345)
@@ -59,7 +189,10 @@ typedef struct {
 typedef void(ForecastIOWeatherCallback)(ForecastIOWeatherInfo *info, ForecastIOWeatherStatus status);
 
 //! Initialize the weather library. The data is fetched after calling this, and should be accessed
-//! and stored once the callback returns data, if it is successful.
+//! and stored once the callback returns data, if it is successful.  If an earlier run stored a
+//! forecast, the callback is called from here with its location name and
+//! ForecastIOWeatherStatusAvailable, and it isn't fetched again until it is older than the update
+//! frequency, which is kept from the last run too.
 //! @param callback Callback to be called once the weather.
 void forecast_io_weather_init(ForecastIOWeatherCallback *callback);
 
@@ -71,6 +204,9 @@ void forecast_io_weather_set_api_key(const char *api_key);
 //! @param minutes The number of minutes before re-polling the weather provider.
 void forecast_io_weather_set_update_frequency(uint32_t minutes);
 
+//! @return The number of minutes between weather updates
+uint32_t forecast_io_weather_get_update_frequency();
+
 //! Initialize the weather location if you don't want to use the GPS
 //! @param coordinates The coordinates (default is FORECASTIO_WEATHER_GPS_LOCATION)
 void forecast_io_weather_set_location(const ForecastIOWeatherCoordinates coordinates);
@@ -80,6 +216,29 @@ void forecast_io_weather_set_location(const ForecastIOWeatherCoordinates coordin
 //! @return true if the fetch message to PebbleKit JS was successful, false otherwise.
 bool forecast_io_weather_fetch();
 
+//! @return true while a fetch waits for another message to clear the outbox.  Messages of your
+//! own that can wait should, as the fetch goes from the outbox sent or failed handler.
+bool forecast_io_weather_fetch_waiting();
+
+//! Get the AppMessage traffic counts since forecast_io_weather_init()
+//! @param stats Filled in with the counts
+void forecast_io_weather_get_stats(ForecastIOWeatherStats *stats);
+
+//! Get the forecast for the hour containing a time.  Days are read from
+//! persistent storage and decoded the first time they are needed.
+//! @param time The time to look up
+//! @param hour Filled in with the forecast
+//! @return false if there is no forecast for that hour
+bool forecast_io_weather_forecast_at(time_t time, ForecastIOWeatherHour *hour);
+
+//! Get the forecast for consecutive hours, without copying it
+//! @param start Any time in the first hour
+//! @param hours The number of hours wanted
+//! @param range Filled in with the hours, which may be fewer than asked
+//! for if the forecast ends or has a gap
+//! @return false if there is no forecast for the first hour
+bool forecast_io_weather_forecast_range(time_t start, uint16_t hours, ForecastIOWeatherRange *range);
+
 //! Deinitialize and free the backing ForecastIOWeatherInfo.
 void forecast_io_weather_deinit();
 
@@ -0,0 +1,89 @@
+#include <pebble.h>
+#include "glance_filter.h"
+
+#if GLANCE_FILTER == GLANCE_FILTER_IIR
+
+// Filter state with 4 fractional bits, so small steps aren't lost to rounding
+#define IIR_FRACTION_BITS 4
+
+static bool s_primed = false;
+static int32_t s_state[3];
+
+void glance_filter_reset() {
+  s_primed = false;
+}
+
+static inline int16_t iir_step(int32_t *state, int16_t reading) {
+  const int32_t scaled = (int32_t)reading * (1 << IIR_FRACTION_BITS);
+  *state += (scaled - *state) / (1 << GLANCE_FILTER_IIR_SHIFT);
+  return (int16_t)(*state / (1 << IIR_FRACTION_BITS));
+}
+
+void glance_filter_batch(const AccelData *in, uint32_t num_samples, AccelData *out) {
+  for (uint32_t i = 0; i < num_samples; i++) {
+    if (!s_primed) {
+      s_state[0] = (int32_t)in[i].x * (1 << IIR_FRACTION_BITS);
+      s_state[1] = (int32_t)in[i].y * (1 << IIR_FRACTION_BITS);
+      s_state[2] = (int32_t)in[i].z * (1 << IIR_FRACTION_BITS);
+      s_primed = true;
+    }
+    out[i] = in[i];
+    out[i].x = iir_step(&s_state[0], in[i].x);
+    out[i].y = iir_step(&s_state[1], in[i].y);
+    out[i].z = iir_step(&s_state[2], in[i].z);
+  }
+}
+
+#elif GLANCE_FILTER == GLANCE_FILTER_MEDIAN3
+
+// The two readings before the current one, oldest first
+static uint8_t s_history_count = 0;
+static int16_t s_history[2][3];
+
+void glance_filter_reset() {
+  s_history_count = 0;
+}
+
+static inline int16_t median3(int16_t a, int16_t b, int16_t c) {
+  if (a > b) {
+    int16_t t = a;
+    a = b;
+    b = t;
+  }
+  // a <= b, so the median is b clamped to [a, c] or c
+  if (c < a) {
+    return a;
+  }
+  return (c < b) ? c : b;
+}
+
+void glance_filter_batch(const AccelData *in, uint32_t num_samples, AccelData *out) {
+  for (uint32_t i = 0; i < num_samples; i++) {
+    const int16_t reading[3] = { in[i].x, in[i].y, in[i].z };
+    out[i] = in[i];
+
+    // Until there is enough history, pass readings through
+    if (s_history_count == 2) {
+      out[i].x = median3(s_history[0][0], s_history[1][0], reading[0]);
+      out[i].y = median3(s_history[0][1], s_history[1][1], reading[1]);
+      out[i].z = median3(s_history[0][2], s_history[1][2], reading[2]);
+      memcpy(s_history[0], s_history[1], sizeof(s_history[0]));
+      memcpy(s_history[1], reading, sizeof(reading));
+    }
+    else {
+      memcpy(s_history[s_history_count++], reading, sizeof(reading));
+    }
+  }
+}
+
+#else
+
+void glance_filter_reset() {}
+
+void glance_filter_batch(const AccelData *in, uint32_t num_samples, AccelData *out) {
+  if (in != out) {
+    memcpy(out, in, num_samples * sizeof(AccelData));
+  }
+}
+
+#endif
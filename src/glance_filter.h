@@ -0,0 +1,31 @@
+#pragma once
+
+#include <pebble.h>
+
+// Optional smoothing of accelerometer readings before zone classification,
+// in integer arithmetic only.
+//
+// GLANCE_FILTER selects the stage compiled in:
+//   GLANCE_FILTER_NONE     readings are classified as they arrive
+//   GLANCE_FILTER_IIR      first order low-pass, y += (x - y) / 2^GLANCE_FILTER_IIR_SHIFT
+//   GLANCE_FILTER_MEDIAN3  per-axis median of the last three readings, drops single spikes
+//
+// The filter state carries over from one batch to the next, and must be
+// reset when the readings have a gap, e.g. on subscribe or after suspend.
+
+#define GLANCE_FILTER_NONE 0
+#define GLANCE_FILTER_IIR 1
+#define GLANCE_FILTER_MEDIAN3 2
+
+#ifndef GLANCE_FILTER
+#define GLANCE_FILTER GLANCE_FILTER_IIR
+#endif
+
+#ifndef GLANCE_FILTER_IIR_SHIFT
+#define GLANCE_FILTER_IIR_SHIFT 1
+#endif
+
+void glance_filter_reset();
+
+//! Filter a batch.  in and out may be the same.
+void glance_filter_batch(const AccelData *in, uint32_t num_samples, AccelData *out);
@@ -0,0 +1,92 @@
+#include <pebble.h>
+#include "glance_governor.h"
+
+const GlanceTierConfig glance_tier_config[GLANCE_TIER_COUNT] = {
+  [GLANCE_TIER_OFF] = { ACCEL_SAMPLING_10HZ, 0 },
+  [GLANCE_TIER_SUSPENDED] = { ACCEL_SAMPLING_10HZ, 0 },
+  [GLANCE_TIER_IDLE] = { ACCEL_SAMPLING_10HZ, 15 },   // 1.5s between wake-ups
+  [GLANCE_TIER_SLOW] = { ACCEL_SAMPLING_10HZ, 7 },    // 0.7s
+  [GLANCE_TIER_FAST] = { ACCEL_SAMPLING_25HZ, 5 },    // 0.2s
+  [GLANCE_TIER_BURST] = { ACCEL_SAMPLING_50HZ, 10 },  // 0.2s, finer samples
+};
+
+static bool s_have_last = false;
+static AccelData s_last;
+static bool s_still = false;
+static uint64_t s_still_dropped_since_ms = 0;  // 0 when not still in the dropped zone
+
+void glance_governor_reset() {
+  s_have_last = false;
+  s_still = false;
+  s_still_dropped_since_ms = 0;
+}
+
+static inline uint32_t abs_diff(int a, int b) {
+  return (a > b) ? a - b : b - a;
+}
+
+uint32_t glance_governor_motion_energy(const AccelData *data, uint32_t num_samples) {
+  if (num_samples == 0) {
+    return 0;
+  }
+
+  uint32_t sum = 0;
+  uint32_t steps = 0;
+  const AccelData *prev = s_have_last ? &s_last : &data[0];
+  for (uint32_t i = s_have_last ? 0 : 1; i < num_samples; i++) {
+    sum += abs_diff(data[i].x, prev->x) + abs_diff(data[i].y, prev->y) + abs_diff(data[i].z, prev->z);
+    prev = &data[i];
+    steps++;
+  }
+
+  s_last = data[num_samples - 1];
+  s_have_last = true;
+  return steps ? sum / steps : 0;
+}
+
+GlanceSamplingTier glance_governor_update(GlanceSamplingTier current, uint64_t tier_since_ms,
+                                          const GlanceGovernorInputs *inputs, uint32_t energy,
+                                          uint64_t now_ms) {
+  // Hysteresis on stillness
+  if (energy > GLANCE_GOVERNOR_MOVING_ENERGY) {
+    s_still = false;
+  }
+  else if (energy < GLANCE_GOVERNOR_STILL_ENERGY) {
+    s_still = true;
+  }
+
+  if (s_still && (inputs->zone == GLANCE_ZONE_INACTIVE)) {
+    if (s_still_dropped_since_ms == 0) {
+      s_still_dropped_since_ms = now_ms;
+    }
+  }
+  else {
+    s_still_dropped_since_ms = 0;
+  }
+
+  const uint64_t still_dropped_ms = s_still_dropped_since_ms ? now_ms - s_still_dropped_since_ms : 0;
+
+  GlanceSamplingTier target;
+  if (inputs->roll_window) {
+    target = GLANCE_TIER_BURST;
+  }
+  else if (inputs->prefer_fast) {
+    target = GLANCE_TIER_FAST;
+  }
+  else if (inputs->can_suspend && inputs->suspend_after_ms &&
+           (still_dropped_ms >= inputs->suspend_after_ms)) {
+    target = GLANCE_TIER_SUSPENDED;
+  }
+  else if (still_dropped_ms >= GLANCE_GOVERNOR_IDLE_AFTER_MS) {
+    target = GLANCE_TIER_IDLE;
+  }
+  else {
+    target = GLANCE_TIER_SLOW;
+  }
+
+  // Speed up straight away, slow down only after the minimum dwell
+  if ((target < current) && (now_ms - tier_since_ms < GLANCE_GOVERNOR_MIN_DWELL_MS)) {
+    return current;
+  }
+  return target;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <pebble.h>
+#include "glancing_api.h"
+
+// Accelerometer sampling governor for the glancing service.
+//
+// Picks a sampling tier - rate and batch size - from what the glance
+// FSMs need and how much the wrist is moving.  Moving to a faster tier
+// happens at once; moving to a slower one waits out a minimum dwell, and
+// dropping to the idle tier needs the wrist to have been still in the
+// dropped zone for a while, with hysteresis on the motion threshold.
+//
+// After a longer still spell in the dropped zone the governor picks the
+// suspended tier: the service stops accelerometer batches altogether and
+// waits for a tap, or a periodic single-reading peek that finds the wrist
+// has moved, to resume sampling.
+
+typedef enum {
+  GLANCE_TIER_OFF = 0,        // Not subscribed
+  GLANCE_TIER_SUSPENDED = 1,  // Dropped and still for long, waiting for a tap or peek
+  GLANCE_TIER_IDLE = 2,       // Dropped and still, wake rarely
+  GLANCE_TIER_SLOW = 3,       // Watching for a glance
+  GLANCE_TIER_FAST = 4,       // Glance in progress
+  GLANCE_TIER_BURST = 5,      // Roll window, catch the return to the active zone
+  GLANCE_TIER_COUNT
+} GlanceSamplingTier;
+
+typedef struct GlanceTierConfig {
+  AccelSamplingRate rate;
+  uint8_t samples_per_update;
+} GlanceTierConfig;
+
+extern const GlanceTierConfig glance_tier_config[GLANCE_TIER_COUNT];
+
+// Mean of |dx| + |dy| + |dz| between consecutive samples, milli-g
+#define GLANCE_GOVERNOR_STILL_ENERGY 40    // Below this the wrist is still...
+#define GLANCE_GOVERNOR_MOVING_ENERGY 80   // ...until it goes above this
+#define GLANCE_GOVERNOR_IDLE_AFTER_MS 5000 // Still and dropped this long before idling
+#define GLANCE_GOVERNOR_MIN_DWELL_MS 1000  // Minimum time in a tier before slowing down
+
+// While suspended
+#define GLANCE_GOVERNOR_PEEK_MS 1000       // Time between accelerometer peeks
+#define GLANCE_GOVERNOR_WAKE_DELTA 150     // |dx| + |dy| + |dz| from the suspend reading that wakes
+
+typedef struct GlanceGovernorInputs {
+  bool prefer_fast;   // FSMs want fast sampling
+  bool roll_window;   // Roll timer running
+  GlanceZone zone;    // Zone at the end of the batch
+  bool can_suspend;   // No glance in progress
+  uint32_t suspend_after_ms;  // Still and dropped this long before suspending, 0 never
+} GlanceGovernorInputs;
+
+//! Forget the motion history, e.g. on subscribe
+void glance_governor_reset();
+
+//! Feed a batch of samples and return its motion energy
+uint32_t glance_governor_motion_energy(const AccelData *data, uint32_t num_samples);
+
+//! Pick the tier to sample at next
+//! @param current Tier in use
+//! @param tier_since_ms When the current tier started
+GlanceSamplingTier glance_governor_update(GlanceSamplingTier current, uint64_t tier_since_ms,
+                                          const GlanceGovernorInputs *inputs, uint32_t energy,
+                                          uint64_t now_ms);
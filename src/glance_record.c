@@ -0,0 +1,245 @@
+#include <pebble.h>
+#include "glance_record.h"
+
+// Worst cases: a record header of two 5 byte varints and the count, and
+// a sample of three 3 byte varints
+#define RECORD_HEADER_MAX 11
+#define SAMPLE_MAX 9
+
+typedef struct RecordRing {
+  uint8_t chunks[GLANCE_RECORD_CHUNKS][GLANCE_RECORD_CHUNK_SIZE];
+  uint16_t lengths[GLANCE_RECORD_CHUNKS];
+} RecordRing;
+
+// Only allocated while recording or while there are chunks to send
+static RecordRing *s_ring = NULL;
+static uint8_t s_head = 0;     // Oldest unsent chunk
+static uint8_t s_unsent = 0;   // Completed chunks, from s_head
+static bool s_active = false;
+static uint16_t s_seq = 0;
+static uint32_t s_dropped = 0;
+
+static GlanceRecordReadyHandler s_ready = NULL;
+static void *s_ready_context = NULL;
+
+// The chunk in progress, in the slot after the unsent ones
+static bool s_open = false;
+static uint16_t s_used;
+static uint16_t s_samples;
+static uint64_t s_last_record_ms;
+static int16_t s_prev[3];
+
+static inline uint8_t *open_chunk_data() {
+  return s_ring->chunks[(s_head + s_unsent) % GLANCE_RECORD_CHUNKS];
+}
+
+static uint8_t *put_varint(uint8_t *out, uint32_t value) {
+  while (value >= 0x80) {
+    *out++ = (value & 0x7f) | 0x80;
+    value >>= 7;
+  }
+  *out++ = value;
+  return out;
+}
+
+static inline uint32_t zigzag(int32_t value) {
+  return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static bool ensure_ring() {
+  if (!s_ring) {
+    s_ring = malloc(sizeof(RecordRing));
+    s_head = 0;
+    s_unsent = 0;
+  }
+  return s_ring != NULL;
+}
+
+static void free_ring_if_done() {
+  if (s_ring && !s_active && !s_open && (s_unsent == 0)) {
+    free(s_ring);
+    s_ring = NULL;
+  }
+}
+
+static void open_chunk(uint64_t time_ms) {
+  if (s_unsent == GLANCE_RECORD_CHUNKS) {
+    // The phone isn't keeping up, lose the oldest
+    s_head = (s_head + 1) % GLANCE_RECORD_CHUNKS;
+    s_unsent--;
+    s_dropped++;
+  }
+
+  uint8_t *chunk = open_chunk_data();
+  const uint32_t time = (uint32_t)time_ms;
+  chunk[0] = GLANCE_RECORD_VERSION;
+  chunk[1] = GLANCE_RECORD_HEADER_SIZE;
+  chunk[2] = s_seq & 0xff;
+  chunk[3] = s_seq >> 8;
+  chunk[4] = time & 0xff;
+  chunk[5] = (time >> 8) & 0xff;
+  chunk[6] = (time >> 16) & 0xff;
+  chunk[7] = (time >> 24) & 0xff;
+
+  s_open = true;
+  s_used = GLANCE_RECORD_HEADER_SIZE;
+  s_samples = 0;
+  s_last_record_ms = time_ms;
+  s_prev[0] = s_prev[1] = s_prev[2] = 0;
+}
+
+// Returns true if a chunk was completed, false if there was nothing in it
+static bool close_chunk() {
+  if (!s_open) {
+    return false;
+  }
+  s_open = false;
+  if (s_samples == 0) {
+    return false;
+  }
+
+  uint8_t *chunk = open_chunk_data();
+  chunk[8] = s_samples & 0xff;
+  chunk[9] = s_samples >> 8;
+  s_ring->lengths[(s_head + s_unsent) % GLANCE_RECORD_CHUNKS] = s_used;
+  s_unsent++;
+  s_seq++;
+  return true;
+}
+
+static void close_chunk_and_notify() {
+  if (close_chunk() && s_ready) {
+    s_ready(s_ready_context);
+  }
+}
+
+bool glance_record_start(GlanceRecordReadyHandler ready, void *context) {
+  if (!ensure_ring()) {
+    return false;
+  }
+  s_ready = ready;
+  s_ready_context = context;
+  s_active = true;
+  return true;
+}
+
+void glance_record_stop() {
+  if (!s_active) {
+    return;
+  }
+  s_active = false;
+  close_chunk_and_notify();
+  free_ring_if_done();
+}
+
+bool glance_record_active() {
+  return s_active;
+}
+
+void glance_record_batch(const AccelData *data, uint32_t count, uint64_t first_time_ms, uint32_t period_ms) {
+  if (!s_active) {
+    return;
+  }
+
+  uint32_t i = 0;
+  while (i < count) {
+    const uint64_t time_ms = first_time_ms + i * period_ms;
+    if (s_open && (GLANCE_RECORD_CHUNK_SIZE - s_used < RECORD_HEADER_MAX + SAMPLE_MAX)) {
+      close_chunk_and_notify();
+    }
+    if (!s_open) {
+      open_chunk(time_ms);
+    }
+
+    uint8_t *chunk = open_chunk_data();
+    const uint8_t *end = chunk + GLANCE_RECORD_CHUNK_SIZE;
+    uint8_t *out = chunk + s_used;
+    out = put_varint(out, (time_ms > s_last_record_ms) ? (uint32_t)(time_ms - s_last_record_ms) : 0);
+    out = put_varint(out, period_ms);
+    uint8_t *count_out = out++;
+    s_last_record_ms = time_ms;
+
+    // A record ends where the vibe motor starts or stops
+    const bool vibrated = data[i].did_vibrate;
+    uint8_t n = 0;
+    while ((i < count) && (data[i].did_vibrate == vibrated) && (end - out >= SAMPLE_MAX)) {
+      const int16_t sample[3] = { data[i].x, data[i].y, data[i].z };
+      for (int axis = 0; axis < 3; axis++) {
+        out = put_varint(out, zigzag((int32_t)sample[axis] - s_prev[axis]));
+        s_prev[axis] = sample[axis];
+      }
+      n++;
+      i++;
+    }
+    *count_out = (n << 1) | (vibrated ? 1 : 0);
+    s_used = out - chunk;
+    s_samples += n;
+  }
+}
+
+const uint8_t *glance_record_peek_chunk(uint16_t *length) {
+  if (!s_ring || (s_unsent == 0)) {
+    return NULL;
+  }
+  *length = s_ring->lengths[s_head];
+  return s_ring->chunks[s_head];
+}
+
+void glance_record_chunk_sent(const uint8_t *chunk) {
+  // The oldest may have been overwritten while this was being sent
+  if (!s_ring || (s_unsent == 0) || (chunk[2] != s_ring->chunks[s_head][2]) ||
+      (chunk[3] != s_ring->chunks[s_head][3])) {
+    return;
+  }
+  // The chunk in progress stays in its slot
+  s_head = (s_head + 1) % GLANCE_RECORD_CHUNKS;
+  s_unsent--;
+  free_ring_if_done();
+}
+
+uint32_t glance_record_dropped() {
+  return s_dropped;
+}
+
+void glance_record_save(uint32_t first_key) {
+  close_chunk();
+  if (!s_ring) {
+    return;
+  }
+
+  const uint8_t skip = (s_unsent > GLANCE_RECORD_PERSIST_KEYS) ? s_unsent - GLANCE_RECORD_PERSIST_KEYS : 0;
+  for (uint32_t i = 0; i < GLANCE_RECORD_PERSIST_KEYS; i++) {
+    if (skip + i < s_unsent) {
+      const uint8_t slot = (s_head + skip + i) % GLANCE_RECORD_CHUNKS;
+      persist_write_data(first_key + i, s_ring->chunks[slot], s_ring->lengths[slot]);
+    }
+    else if (persist_exists(first_key + i)) {
+      persist_delete(first_key + i);
+    }
+  }
+
+  s_head = (s_head + s_unsent) % GLANCE_RECORD_CHUNKS;
+  s_unsent = 0;
+  free_ring_if_done();
+}
+
+void glance_record_load(uint32_t first_key) {
+  for (uint32_t i = 0; i < GLANCE_RECORD_PERSIST_KEYS; i++) {
+    if (!persist_exists(first_key + i)) {
+      continue;
+    }
+    if (!s_open && (s_unsent < GLANCE_RECORD_CHUNKS) && ensure_ring()) {
+      const uint8_t slot = (s_head + s_unsent) % GLANCE_RECORD_CHUNKS;
+      const int length = persist_read_data(first_key + i, s_ring->chunks[slot], GLANCE_RECORD_CHUNK_SIZE);
+      const uint8_t *chunk = s_ring->chunks[slot];
+      if ((length >= GLANCE_RECORD_HEADER_SIZE) && (chunk[0] == GLANCE_RECORD_VERSION)) {
+        s_ring->lengths[slot] = length;
+        s_unsent++;
+        // Carry on the numbering, so the phone sees these come first
+        s_seq = (chunk[2] | (chunk[3] << 8)) + 1;
+      }
+    }
+    persist_delete(first_key + i);
+  }
+  free_ring_if_done();
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <pebble.h>
+
+// Recording of the raw accelerometer batches the glancing service sees,
+// compact enough to stream minutes of 25Hz data to the phone, where
+// app.js turns it into a trace for tools/glance_replay.
+//
+// Batches are packed into fixed size chunks, each decodable on its own,
+// kept in a small ring in RAM until they have been sent.  Unsent chunks
+// can be saved to persistent storage, one chunk per key, and sent on the
+// next run.
+//
+// Chunk, all little-endian:
+//   uint8_t version, uint8_t header size, uint16_t sequence number,
+//   uint32_t time of the first sample (ms, truncated),
+//   uint16_t sample count,
+//   then batch records until the chunk is full:
+//     varint ms from the first sample of the previous record (0 for the first),
+//     varint ms between samples,
+//     uint8_t sample count << 1 | 1 if the vibe motor ran during the samples,
+//     then per sample zigzag varints of x, y and z less the previous
+//     sample's, the first in the chunk less 0.
+// A batch is split into records where the vibe motor starts or stops.  A
+// batch that doesn't fit is split too, its remainder continuing in a new
+// record in the next chunk.  Samples take about 4 bytes, so a chunk holds
+// about 2.5s at 25Hz and a minute streams in 6KB.
+
+#define GLANCE_RECORD_VERSION 1
+#define GLANCE_RECORD_HEADER_SIZE 10
+#define GLANCE_RECORD_CHUNK_SIZE PERSIST_DATA_MAX_LENGTH
+
+// Chunks held in RAM, about 10s at 25Hz if the phone can't keep up
+#define GLANCE_RECORD_CHUNKS 4
+// Consecutive persist keys used by glance_record_save()
+#define GLANCE_RECORD_PERSIST_KEYS 4
+
+// Called when a chunk has been completed and is ready to send
+typedef void (*GlanceRecordReadyHandler)(void *context);
+
+// Start recording, returns false if the ring can't be allocated
+bool glance_record_start(GlanceRecordReadyHandler ready, void *context);
+
+// Stop recording, completing the chunk in progress.  The ring is freed
+// once everything in it has been sent.
+void glance_record_stop();
+
+bool glance_record_active();
+
+// Append a batch, from the glancing service
+void glance_record_batch(const AccelData *data, uint32_t count, uint64_t first_time_ms, uint32_t period_ms);
+
+//! Oldest completed chunk not yet sent
+//! @param length Set to the chunk length
+//! @return The chunk, or NULL if there is none
+const uint8_t *glance_record_peek_chunk(uint16_t *length);
+
+//! Drop the chunk returned by glance_record_peek_chunk(), once the phone
+//! has it
+//! @param chunk The chunk as sent, which is only dropped if it is still
+//! the oldest
+void glance_record_chunk_sent(const uint8_t *chunk);
+
+//! Chunks overwritten before they could be sent
+uint32_t glance_record_dropped();
+
+//! Move the unsent chunks, up to GLANCE_RECORD_PERSIST_KEYS of the newest,
+//! to keys starting at first_key, deleting any left over from before
+void glance_record_save(uint32_t first_key);
+
+//! Queue chunks saved by glance_record_save() for sending, and delete them
+//! from storage
+void glance_record_load(uint32_t first_key);
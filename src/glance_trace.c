@@ -0,0 +1,102 @@
+#include <pebble.h>
+#include "glance_trace.h"
+
+#if GLANCE_TRACE_LEVEL >= GLANCE_TRACE_LEVEL_RING
+
+static GlanceTraceEntry s_ring[GLANCE_TRACE_ENTRIES];
+static uint16_t s_next = 0;    // Next slot to write
+static uint16_t s_count = 0;   // Valid entries, saturates at GLANCE_TRACE_ENTRIES
+static uint64_t s_last_ms = 0;
+static bool s_unsaved = false;  // Entries recorded since the last save
+
+void glance_trace_record(GlanceTraceEvent event, uint8_t arg0, int16_t arg1, uint64_t time_ms) {
+  GlanceTraceEntry *e = &s_ring[s_next];
+  uint64_t delta = (s_count && time_ms > s_last_ms) ? time_ms - s_last_ms : 0;
+
+  e->event = event;
+  e->arg0 = arg0;
+  e->delta_ms = (delta > 0xFFFF) ? 0xFFFF : (uint16_t)delta;
+  e->arg1 = arg1;
+
+  s_last_ms = time_ms;
+  s_unsaved = true;
+  s_next = (s_next + 1) & (GLANCE_TRACE_ENTRIES - 1);
+  if (s_count < GLANCE_TRACE_ENTRIES) {
+    s_count++;
+  }
+}
+
+uint16_t glance_trace_copy(uint8_t *buffer, uint16_t size) {
+  if (size < GLANCE_TRACE_HEADER_SIZE) {
+    return 0;
+  }
+
+  uint16_t count = s_count;
+  uint16_t room = (size - GLANCE_TRACE_HEADER_SIZE) / sizeof(GlanceTraceEntry);
+  if (count > room) {
+    // Keep the newest entries
+    count = room;
+  }
+
+  uint32_t last_ms = (uint32_t)s_last_ms;
+  buffer[0] = GLANCE_TRACE_VERSION;
+  buffer[1] = sizeof(GlanceTraceEntry);
+  buffer[2] = count & 0xff;
+  buffer[3] = count >> 8;
+  buffer[4] = last_ms & 0xff;
+  buffer[5] = (last_ms >> 8) & 0xff;
+  buffer[6] = (last_ms >> 16) & 0xff;
+  buffer[7] = (last_ms >> 24) & 0xff;
+
+  uint8_t *out = buffer + GLANCE_TRACE_HEADER_SIZE;
+  uint16_t index = (s_next - count) & (GLANCE_TRACE_ENTRIES - 1);
+  for (uint16_t i = 0; i < count; i++) {
+    memcpy(out, &s_ring[index], sizeof(GlanceTraceEntry));
+    out += sizeof(GlanceTraceEntry);
+    index = (index + 1) & (GLANCE_TRACE_ENTRIES - 1);
+  }
+
+  return GLANCE_TRACE_HEADER_SIZE + count * sizeof(GlanceTraceEntry);
+}
+
+void glance_trace_save(uint32_t first_key) {
+  if (!s_unsaved) {
+    return;
+  }
+  s_unsaved = false;
+
+  uint8_t buffer[GLANCE_TRACE_DUMP_SIZE];
+  uint16_t length = glance_trace_copy(buffer, sizeof(buffer));
+
+  for (uint32_t i = 0; i < GLANCE_TRACE_PERSIST_KEYS; i++) {
+    uint16_t offset = i * PERSIST_DATA_MAX_LENGTH;
+    if (offset < length) {
+      uint16_t chunk = length - offset;
+      if (chunk > PERSIST_DATA_MAX_LENGTH) {
+        chunk = PERSIST_DATA_MAX_LENGTH;
+      }
+      persist_write_data(first_key + i, buffer + offset, chunk);
+    }
+    else if (persist_exists(first_key + i)) {
+      persist_delete(first_key + i);
+    }
+  }
+}
+
+void glance_trace_clear() {
+  s_next = 0;
+  s_count = 0;
+  s_unsaved = false;
+}
+
+#else
+
+uint16_t glance_trace_copy(uint8_t *buffer, uint16_t size) {
+  return 0;
+}
+
+void glance_trace_save(uint32_t first_key) {}
+
+void glance_trace_clear() {}
+
+#endif
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <pebble.h>
+
+// Binary trace of glancing service events.
+//
+// A fixed ring of small records (event id, ms since the previous record,
+// two small arguments) that costs a few stores per event, replacing
+// APP_LOG on the accelerometer path.  The ring can be serialized for an
+// AppMessage or persistent storage, so a bad glance can be examined after
+// the fact.
+//
+// GLANCE_TRACE_LEVEL selects what is compiled in:
+//   GLANCE_TRACE_LEVEL_OFF   nothing - release builds pay no cost
+//   GLANCE_TRACE_LEVEL_RING  binary ring only
+//   GLANCE_TRACE_LEVEL_LOG   binary ring, plus APP_LOG of each event
+// It defaults to off; debug builds turn the ring on with GLANCE_TRACE=ring
+// or GLANCE_TRACE=log in the environment of `pebble build` (see wscript).
+
+#define GLANCE_TRACE_LEVEL_OFF 0
+#define GLANCE_TRACE_LEVEL_RING 1
+#define GLANCE_TRACE_LEVEL_LOG 2
+
+#ifndef GLANCE_TRACE_LEVEL
+#define GLANCE_TRACE_LEVEL GLANCE_TRACE_LEVEL_OFF
+#endif
+
+typedef enum {
+  GLANCE_TRACE_SAMPLING = 1,  // arg0 = rate Hz, arg1 = samples per update, both 0 when suspended
+  GLANCE_TRACE_ZONE = 2,      // arg0 = new GlanceZone, arg1 = old GlanceZone
+  GLANCE_TRACE_FSM2 = 3,      // arg0 = old state << 4 | new state, arg1 = input
+  GLANCE_TRACE_FSM3 = 4,      // arg0 = old state << 4 | new state, arg1 = input
+  GLANCE_TRACE_OUTPUT = 5,    // arg0 = GlanceOutput
+  GLANCE_TRACE_LIGHT = 6,     // arg0 = 1 on, 0 off
+  GLANCE_TRACE_TAP = 7,       // arg0 = axis, arg1 = direction
+  GLANCE_TRACE_WAKE = 8,      // arg0 = GlanceWakeCause, arg1 = ms from wake to first batch
+} GlanceTraceEvent;
+
+typedef struct __attribute__((__packed__)) GlanceTraceEntry {
+  uint8_t event;
+  uint8_t arg0;
+  uint16_t delta_ms;  // Since the previous entry, saturating at 0xFFFF
+  int16_t arg1;
+} GlanceTraceEntry;
+
+// Power of two, so the ring index is a mask
+#define GLANCE_TRACE_ENTRIES 64
+
+// Serialized form, all little-endian:
+//   uint8_t version, uint8_t entry size, uint16_t entry count,
+//   uint32_t time of the newest entry (ms, truncated),
+//   then the entries, oldest first.
+#define GLANCE_TRACE_VERSION 1
+#define GLANCE_TRACE_HEADER_SIZE 8
+#define GLANCE_TRACE_DUMP_SIZE (GLANCE_TRACE_HEADER_SIZE + GLANCE_TRACE_ENTRIES * sizeof(GlanceTraceEntry))
+
+// Number of consecutive persist keys used by glance_trace_save()
+#define GLANCE_TRACE_PERSIST_KEYS \
+  ((GLANCE_TRACE_DUMP_SIZE + PERSIST_DATA_MAX_LENGTH - 1) / PERSIST_DATA_MAX_LENGTH)
+
+#if GLANCE_TRACE_LEVEL >= GLANCE_TRACE_LEVEL_RING
+
+void glance_trace_record(GlanceTraceEvent event, uint8_t arg0, int16_t arg1, uint64_t time_ms);
+
+#if GLANCE_TRACE_LEVEL >= GLANCE_TRACE_LEVEL_LOG
+#define GLANCE_TRACE(EVENT, ARG0, ARG1, TIME_MS) do { \
+    APP_LOG(APP_LOG_LEVEL_DEBUG, "trace %d: %d %d", (EVENT), (int)(ARG0), (int)(ARG1)); \
+    glance_trace_record((EVENT), (ARG0), (ARG1), (TIME_MS)); \
+  } while (0)
+#else
+#define GLANCE_TRACE(EVENT, ARG0, ARG1, TIME_MS) glance_trace_record((EVENT), (ARG0), (ARG1), (TIME_MS))
+#endif
+
+#else
+
+#define GLANCE_TRACE(EVENT, ARG0, ARG1, TIME_MS) ((void)0)
+
+#endif
+
+//! Serialize the ring, oldest entry first
+//! @param buffer Destination, at least GLANCE_TRACE_DUMP_SIZE bytes for the whole ring
+//! @return Bytes written, 0 if tracing is compiled out
+uint16_t glance_trace_copy(uint8_t *buffer, uint16_t size);
+
+//! Write the serialized ring to GLANCE_TRACE_PERSIST_KEYS keys starting at
+//! first_key, if anything has been recorded since the last save
+void glance_trace_save(uint32_t first_key);
+
+void glance_trace_clear();
@@ -0,0 +1,18 @@
+#pragma once
+
+// Generated by tools/glance_replay/zone_fit - edit by re-running it.
+//
+// Hand-tuned bounds, before any fit.  The roll zone's lower Y was
+// originally 850 - now easier to hit at low sample rate.
+
+#define GLANCE_ACTIVE_ZONE_X { -500, 500 }
+#define GLANCE_ACTIVE_ZONE_Y { -900, 200 }
+#define GLANCE_ACTIVE_ZONE_Z { -1100, 0 }
+
+#define GLANCE_DROPPED_ZONE_X { 800, 1000 }
+#define GLANCE_DROPPED_ZONE_Y { -500, 500 }
+#define GLANCE_DROPPED_ZONE_Z { -800, 800 }
+
+#define GLANCE_ROLL_ZONE_X { -600, 600 }
+#define GLANCE_ROLL_ZONE_Y { 600, 1200 }
+#define GLANCE_ROLL_ZONE_Z { -500, 500 }
@@ -0,0 +1,352 @@
+#include <pebble.h>
+#include "glance_zones.h"
+#include "glance_zone_bounds.h"
+
+#ifndef WITHIN
+#define WITHIN(n, min, max) ((n) >= (min) && (n) <= (max))
+#endif
+
+// Inside the box grown by margin on every side
+#define WITHIN_ACCELEROMETER_ZONE(zone, data, margin) ( \
+  WITHIN((data).x, (zone).x_segment.start - (margin), (zone).x_segment.end + (margin)) && \
+  WITHIN((data).y, (zone).y_segment.start - (margin), (zone).y_segment.end + (margin)) && \
+  WITHIN((data).z, (zone).z_segment.start - (margin), (zone).z_segment.end + (margin)) \
+  )
+#define STAYS_IN_ZONE(zone, data) WITHIN_ACCELEROMETER_ZONE(zone, data, (zone).exit_margin)
+#define ENTERS_ZONE(zone, data) WITHIN_ACCELEROMETER_ZONE(zone, data, -(zone).entry_margin)
+
+// watch tilted towards user, screen pointed toward user
+glancing_zone active_zone = {
+  .x_segment = GLANCE_ACTIVE_ZONE_X,
+  .y_segment = GLANCE_ACTIVE_ZONE_Y,
+  .z_segment = GLANCE_ACTIVE_ZONE_Z,
+  .entry_margin = 0,
+  .exit_margin = 50
+};
+
+// arm hanging downward, select button pointing toward ground
+glancing_zone dropped_zone = {
+  .x_segment = GLANCE_DROPPED_ZONE_X,
+  .y_segment = GLANCE_DROPPED_ZONE_Y,
+  .z_segment = GLANCE_DROPPED_ZONE_Z,
+  .entry_margin = 0,
+  .exit_margin = 50
+};
+
+// arm horizontal, screen facing away from user, essentially wrist was rotated away from user
+glancing_zone roll_zone = {
+  .x_segment = GLANCE_ROLL_ZONE_X,
+  .y_segment = GLANCE_ROLL_ZONE_Y,
+  .z_segment = GLANCE_ROLL_ZONE_Z,
+  .entry_margin = 0,
+  .exit_margin = 50
+};
+
+// Zones in the order of the bounds array
+static glancing_zone * const s_bounds_zones[3] = { &active_zone, &dropped_zone, &roll_zone };
+
+// As compiled in, for glance_zones_reset_bounds()
+static const segment s_compiled_segments[3][3] = {
+  { GLANCE_ACTIVE_ZONE_X, GLANCE_ACTIVE_ZONE_Y, GLANCE_ACTIVE_ZONE_Z },
+  { GLANCE_DROPPED_ZONE_X, GLANCE_DROPPED_ZONE_Y, GLANCE_DROPPED_ZONE_Z },
+  { GLANCE_ROLL_ZONE_X, GLANCE_ROLL_ZONE_Y, GLANCE_ROLL_ZONE_Z },
+};
+
+void glance_zones_get_bounds(int16_t *bounds) {
+  for (int i = 0; i < 3; i++) {
+    const glancing_zone *zone = s_bounds_zones[i];
+    bounds[6 * i] = zone->x_segment.start;
+    bounds[6 * i + 1] = zone->x_segment.end;
+    bounds[6 * i + 2] = zone->y_segment.start;
+    bounds[6 * i + 3] = zone->y_segment.end;
+    bounds[6 * i + 4] = zone->z_segment.start;
+    bounds[6 * i + 5] = zone->z_segment.end;
+  }
+}
+
+bool glance_zones_set_bounds(const int16_t *bounds) {
+  for (int i = 0; i < GLANCE_ZONE_BOUNDS_COUNT; i += 2) {
+    if ((bounds[i] > bounds[i + 1]) || (bounds[i] < -GLANCE_ZONE_BOUNDS_LIMIT) ||
+        (bounds[i + 1] > GLANCE_ZONE_BOUNDS_LIMIT)) {
+      return false;
+    }
+  }
+
+  for (int i = 0; i < 3; i++) {
+    glancing_zone *zone = s_bounds_zones[i];
+    zone->x_segment = (segment) { bounds[6 * i], bounds[6 * i + 1] };
+    zone->y_segment = (segment) { bounds[6 * i + 2], bounds[6 * i + 3] };
+    zone->z_segment = (segment) { bounds[6 * i + 4], bounds[6 * i + 5] };
+  }
+  glance_zones_pack();
+  return true;
+}
+
+void glance_zones_reset_bounds() {
+  for (int i = 0; i < 3; i++) {
+    s_bounds_zones[i]->x_segment = s_compiled_segments[i][0];
+    s_bounds_zones[i]->y_segment = s_compiled_segments[i][1];
+    s_bounds_zones[i]->z_segment = s_compiled_segments[i][2];
+  }
+  glance_zones_pack();
+}
+
+bool glance_zones_parse_bounds(const char *text, int16_t *bounds) {
+  for (int i = 0; i < GLANCE_ZONE_BOUNDS_COUNT; i++) {
+    while (*text == ' ') {
+      text++;
+    }
+    bool negative = (*text == '-');
+    if (negative) {
+      text++;
+    }
+    if ((*text < '0') || (*text > '9')) {
+      return false;
+    }
+    int32_t value = 0;
+    while ((*text >= '0') && (*text <= '9') && (value <= GLANCE_ZONE_BOUNDS_LIMIT)) {
+      value = 10 * value + (*text++ - '0');
+    }
+    bounds[i] = negative ? -value : value;
+    while (*text == ' ') {
+      text++;
+    }
+    if (i < GLANCE_ZONE_BOUNDS_COUNT - 1) {
+      if (*text++ != ',') {
+        return false;
+      }
+    }
+  }
+  return *text == '\0';
+}
+
+typedef struct PersistedZoneBounds {
+  uint8_t version;
+  uint8_t count;
+  int16_t bounds[GLANCE_ZONE_BOUNDS_COUNT];
+} PersistedZoneBounds;
+
+#define ZONE_BOUNDS_VERSION 1
+
+bool glance_zones_load(uint32_t key) {
+  PersistedZoneBounds saved;
+  if ((persist_read_data(key, &saved, sizeof(saved)) != sizeof(saved)) ||
+      (saved.version != ZONE_BOUNDS_VERSION) || (saved.count != GLANCE_ZONE_BOUNDS_COUNT)) {
+    return false;
+  }
+  return glance_zones_set_bounds(saved.bounds);
+}
+
+void glance_zones_save(uint32_t key) {
+  PersistedZoneBounds saved = {
+    .version = ZONE_BOUNDS_VERSION,
+    .count = GLANCE_ZONE_BOUNDS_COUNT,
+  };
+  glance_zones_get_bounds(saved.bounds);
+  persist_write_data(key, &saved, sizeof(saved));
+}
+
+GlanceZone glance_zone_classify(GlanceZone current_zone, const AccelData *reading) {
+
+  // Start by testing if the zone is unchanged (for efficiency)
+  switch (current_zone) {
+    case GLANCE_ZONE_ACTIVE:
+      if (STAYS_IN_ZONE(active_zone, *reading)) {
+        return current_zone;
+      }
+      break;
+
+    case GLANCE_ZONE_INACTIVE:
+      if (STAYS_IN_ZONE(dropped_zone, *reading)) {
+        return current_zone;
+      }
+      break;
+
+    case GLANCE_ZONE_ROLL:
+      if (STAYS_IN_ZONE(roll_zone, *reading)) {
+        return current_zone;
+      }
+      break;
+
+    case GLANCE_ZONE_NONE:
+      break;
+  }
+
+  // Try the other possibilities, avoiding repeating the test done above -
+  // entering a zone is never easier than staying in it.
+  if ((current_zone != GLANCE_ZONE_ACTIVE) && ENTERS_ZONE(active_zone, *reading)) {
+    return GLANCE_ZONE_ACTIVE;
+  }
+  if ((current_zone != GLANCE_ZONE_INACTIVE) && ENTERS_ZONE(dropped_zone, *reading)) {
+    return GLANCE_ZONE_INACTIVE;
+  }
+  if ((current_zone != GLANCE_ZONE_ROLL) && ENTERS_ZONE(roll_zone, *reading)) {
+    return GLANCE_ZONE_ROLL;
+  }
+  return GLANCE_ZONE_NONE;
+}
+
+void glance_zone_classify_batch_boxes(GlanceZone current_zone, const AccelData *data,
+                                      uint32_t num_samples, uint8_t *zones_out) {
+  for (uint32_t i = 0; i < num_samples; i++) {
+    current_zone = glance_zone_classify(current_zone, &data[i]);
+    zones_out[i] = current_zone;
+  }
+}
+
+// SWAR backend.
+//
+// A reading is packed as three uint16 lanes (x, y, z) of a uint64_t, each
+// biased by SWAR_BIAS so that it is non-negative.  For each zone
+//   reading + above_start = v - start + 0x8000 per lane
+//   below_end - reading   = end - v + 0x8000 per lane
+// and neither can carry or borrow into the next lane while readings and
+// bounds stay within +/-SWAR_BIAS milli-g (the accelerometer reads +/-4g),
+// so the top bit of each lane says whether that axis is inside the box.
+
+#define SWAR_BIAS 0x4000
+#define SWAR_H 0x0000800080008000ULL
+
+typedef struct PackedZone {
+  uint64_t above_start;
+  uint64_t below_end;
+} PackedZone;
+
+// Indexed by GlanceZone, so bit n of a membership mask is GlanceZone n.
+// Boxes grown by the exit margin, and shrunk by the entry margin.
+static PackedZone s_packed_stay[3];
+static PackedZone s_packed_enter[3];
+
+// Zone picked when a reading leaves its current zone, by membership mask:
+// active first, then dropped, then roll.
+static const uint8_t s_first_zone[8] = {
+  GLANCE_ZONE_NONE,     // none
+  GLANCE_ZONE_INACTIVE, // dropped
+  GLANCE_ZONE_ACTIVE,   // active
+  GLANCE_ZONE_ACTIVE,   // active + dropped
+  GLANCE_ZONE_ROLL,     // roll
+  GLANCE_ZONE_INACTIVE, // roll + dropped
+  GLANCE_ZONE_ACTIVE,   // roll + active
+  GLANCE_ZONE_ACTIVE,   // all
+};
+
+static inline uint64_t swar_lanes(int x, int y, int z) {
+  return (uint64_t)(uint16_t)x | ((uint64_t)(uint16_t)y << 16) | ((uint64_t)(uint16_t)z << 32);
+}
+
+static void pack_zone(PackedZone *packed, const glancing_zone *zone, int margin) {
+  packed->above_start = swar_lanes(0x8000 - SWAR_BIAS - zone->x_segment.start + margin,
+                                   0x8000 - SWAR_BIAS - zone->y_segment.start + margin,
+                                   0x8000 - SWAR_BIAS - zone->z_segment.start + margin);
+  packed->below_end = swar_lanes(0x8000 + SWAR_BIAS + zone->x_segment.end + margin,
+                                 0x8000 + SWAR_BIAS + zone->y_segment.end + margin,
+                                 0x8000 + SWAR_BIAS + zone->z_segment.end + margin);
+}
+
+static void pack_zone_margins(GlanceZone index, const glancing_zone *zone) {
+  pack_zone(&s_packed_stay[index], zone, zone->exit_margin);
+  pack_zone(&s_packed_enter[index], zone, -zone->entry_margin);
+}
+
+static void build_lut();
+
+void glance_zones_pack() {
+  pack_zone_margins(GLANCE_ZONE_INACTIVE, &dropped_zone);
+  pack_zone_margins(GLANCE_ZONE_ACTIVE, &active_zone);
+  pack_zone_margins(GLANCE_ZONE_ROLL, &roll_zone);
+  build_lut();
+}
+
+static inline uint8_t swar_in_zone(uint64_t reading, const PackedZone *zone) {
+  return ((reading + zone->above_start) & (zone->below_end - reading) & SWAR_H) == SWAR_H;
+}
+
+static inline uint8_t swar_zone_mask(uint64_t reading) {
+  return swar_in_zone(reading, &s_packed_enter[GLANCE_ZONE_INACTIVE]) |
+         (swar_in_zone(reading, &s_packed_enter[GLANCE_ZONE_ACTIVE]) << GLANCE_ZONE_ACTIVE) |
+         (swar_in_zone(reading, &s_packed_enter[GLANCE_ZONE_ROLL]) << GLANCE_ZONE_ROLL);
+}
+
+void glance_zone_classify_batch_swar(GlanceZone current_zone, const AccelData *data,
+                                     uint32_t num_samples, uint8_t *zones_out) {
+  for (uint32_t i = 0; i < num_samples; i++) {
+    uint64_t reading = swar_lanes(data[i].x + SWAR_BIAS, data[i].y + SWAR_BIAS, data[i].z + SWAR_BIAS);
+
+    // Staying put wins, as in glance_zone_classify(), and is by far the
+    // common case, so only build the full membership mask on a change.
+    if ((current_zone == GLANCE_ZONE_NONE) || !swar_in_zone(reading, &s_packed_stay[current_zone])) {
+      current_zone = s_first_zone[swar_zone_mask(reading)];
+    }
+    zones_out[i] = current_zone;
+  }
+}
+
+// LUT backend.
+//
+// Each axis is clamped to +/-GLANCE_ZONE_LUT_RANGE and shifted down to
+// GLANCE_ZONE_LUT_BITS, and the three joined into a cell index.  The table
+// holds, 4 cells to a byte, the zone a reading at the centre of the cell
+// would enter from GLANCE_ZONE_NONE, so one lookup replaces the three box
+// tests.  Staying put still wins when the reading is inside the current
+// zone's stay box, but that is only tested when the table says otherwise.
+
+#ifdef GLANCE_ZONE_LUT_BUILD
+
+#define LUT_SHIFT (11 + 1 - GLANCE_ZONE_LUT_BITS)
+#define LUT_CELLS (GLANCE_ZONE_LUT_LEVELS * GLANCE_ZONE_LUT_LEVELS * GLANCE_ZONE_LUT_LEVELS)
+
+static uint8_t s_lut[LUT_CELLS / 4];
+
+// Indexed by GlanceZone, as for the SWAR backend
+static const glancing_zone * const s_zones_by_index[3] = { &dropped_zone, &active_zone, &roll_zone };
+
+static inline uint32_t lut_level(int v) {
+  if (v < -GLANCE_ZONE_LUT_RANGE) {
+    v = -GLANCE_ZONE_LUT_RANGE;
+  }
+  else if (v > GLANCE_ZONE_LUT_RANGE - 1) {
+    v = GLANCE_ZONE_LUT_RANGE - 1;
+  }
+  return (uint32_t)(v + GLANCE_ZONE_LUT_RANGE) >> LUT_SHIFT;
+}
+
+static inline GlanceZone lut_lookup(const AccelData *reading) {
+  const uint32_t cell = (lut_level(reading->x) << (2 * GLANCE_ZONE_LUT_BITS)) |
+                        (lut_level(reading->y) << GLANCE_ZONE_LUT_BITS) | lut_level(reading->z);
+  return (s_lut[cell >> 2] >> (2 * (cell & 3))) & 3;
+}
+
+static inline int lut_cell_centre(uint32_t level) {
+  return -GLANCE_ZONE_LUT_RANGE + (int)(level << LUT_SHIFT) + GLANCE_ZONE_LUT_CELL / 2;
+}
+
+static void build_lut() {
+  memset(s_lut, 0, sizeof(s_lut));
+  for (uint32_t cell = 0; cell < LUT_CELLS; cell++) {
+    const AccelData centre = {
+      .x = lut_cell_centre(cell >> (2 * GLANCE_ZONE_LUT_BITS)),
+      .y = lut_cell_centre((cell >> GLANCE_ZONE_LUT_BITS) & (GLANCE_ZONE_LUT_LEVELS - 1)),
+      .z = lut_cell_centre(cell & (GLANCE_ZONE_LUT_LEVELS - 1)),
+    };
+    const GlanceZone zone = glance_zone_classify(GLANCE_ZONE_NONE, &centre);
+    s_lut[cell >> 2] |= zone << (2 * (cell & 3));
+  }
+}
+
+void glance_zone_classify_batch_lut(GlanceZone current_zone, const AccelData *data,
+                                    uint32_t num_samples, uint8_t *zones_out) {
+  for (uint32_t i = 0; i < num_samples; i++) {
+    const GlanceZone zone = lut_lookup(&data[i]);
+    if ((zone != current_zone) &&
+        ((current_zone == GLANCE_ZONE_NONE) || !STAYS_IN_ZONE(*s_zones_by_index[current_zone], data[i]))) {
+      current_zone = zone;
+    }
+    zones_out[i] = current_zone;
+  }
+}
+
+#else
+
+static void build_lut() {}
+
+#endif
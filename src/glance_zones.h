@@ -0,0 +1,116 @@
+#pragma once
+
+#include <pebble.h>
+#include "glancing_api.h"
+
+// Accelerometer zone classification for the glancing service.
+//
+// Each zone is an axis-aligned box in milli-g.  A reading stays in the
+// current zone while it is inside that zone's box, otherwise it moves to
+// the first box containing it, in the order active, dropped, roll, else
+// GLANCE_ZONE_NONE.
+//
+// For hysteresis each zone also has margins: a reading must be
+// entry_margin inside the box to enter the zone, and exit_margin outside
+// it to leave, so readings hovering on an edge don't flip the zone.
+//
+// GLANCE_ZONE_CLASSIFIER picks how glance_zone_classify_batch() tests
+// the boxes.  The box and SWAR backends are always built, so the host
+// benchmark can compare them; the LUT backend's table takes 1KB, so it is
+// only built when selected or when GLANCE_ZONE_LUT_BUILD is defined.
+//
+// The LUT backend is approximate: a reading is quantized to a cell of
+// GLANCE_ZONE_LUT_CELL milli-g a side, and the zone it would enter looked
+// up, so box edges move to the nearest cell boundary.  In exchange the
+// zones could be any shape, not only boxes.  Leaving a zone is still
+// tested exactly, against its box grown by the exit margin.
+
+#define GLANCE_ZONE_CLASSIFIER_BOXES 0  // Scalar box tests, sample by sample
+#define GLANCE_ZONE_CLASSIFIER_SWAR 1   // Bounds packed as int16 lanes in a uint64_t
+#define GLANCE_ZONE_CLASSIFIER_LUT 2    // 2 bit zone per quantized (x, y, z) cell
+
+#ifndef GLANCE_ZONE_CLASSIFIER
+#define GLANCE_ZONE_CLASSIFIER GLANCE_ZONE_CLASSIFIER_SWAR
+#endif
+
+#if (GLANCE_ZONE_CLASSIFIER == GLANCE_ZONE_CLASSIFIER_LUT) && !defined(GLANCE_ZONE_LUT_BUILD)
+#define GLANCE_ZONE_LUT_BUILD
+#endif
+
+// 16 levels per axis over +/-2g, beyond which no zone reaches
+#define GLANCE_ZONE_LUT_BITS 4
+#define GLANCE_ZONE_LUT_LEVELS (1 << GLANCE_ZONE_LUT_BITS)
+#define GLANCE_ZONE_LUT_RANGE 2048
+#define GLANCE_ZONE_LUT_CELL (2 * GLANCE_ZONE_LUT_RANGE / GLANCE_ZONE_LUT_LEVELS)
+
+// Largest batch accel_data_service_subscribe() will deliver
+#define GLANCE_ZONE_MAX_BATCH 25
+
+typedef struct segment {
+  int start;
+  int end;
+} segment;
+
+typedef struct glancing_zone {
+  segment x_segment;
+  segment y_segment;
+  segment z_segment;
+  int entry_margin;
+  int exit_margin;
+} glancing_zone;
+
+extern glancing_zone active_zone;
+extern glancing_zone dropped_zone;
+extern glancing_zone roll_zone;
+
+//! Rebuild the packed bounds used by the SWAR backend, and the LUT
+//! backend's table.  Must be called after changing any of the zone boxes
+//! or margins.
+void glance_zones_pack();
+
+// The boxes compiled in come from glance_zone_bounds.h, generated by
+// tools/glance_replay/zone_fit.  They can be overridden at runtime, as 18
+// numbers: x start, x end, y start, y end, z start, z end of the active,
+// dropped and roll zones in turn.
+#define GLANCE_ZONE_BOUNDS_COUNT 18
+#define GLANCE_ZONE_BOUNDS_LIMIT 4000  // The accelerometer reads +/-4g
+
+void glance_zones_get_bounds(int16_t *bounds);
+
+//! Replace the boxes, and repack them
+//! @return false, leaving the boxes alone, if any start is after its end
+//! or out of range
+bool glance_zones_set_bounds(const int16_t *bounds);
+
+//! Back to the compiled in boxes
+void glance_zones_reset_bounds();
+
+//! Parse the 18 bounds from comma separated text
+bool glance_zones_parse_bounds(const char *text, int16_t *bounds);
+
+//! Apply bounds saved by glance_zones_save(), if there are any
+bool glance_zones_load(uint32_t key);
+void glance_zones_save(uint32_t key);
+
+//! Classify one reading with the scalar box tests
+GlanceZone glance_zone_classify(GlanceZone current_zone, const AccelData *reading);
+
+//! Classify a batch, carrying the zone from one sample to the next
+//! @param current_zone Zone before data[0]
+//! @param zones_out Zone after each sample, num_samples entries
+void glance_zone_classify_batch_boxes(GlanceZone current_zone, const AccelData *data,
+                                      uint32_t num_samples, uint8_t *zones_out);
+void glance_zone_classify_batch_swar(GlanceZone current_zone, const AccelData *data,
+                                     uint32_t num_samples, uint8_t *zones_out);
+#ifdef GLANCE_ZONE_LUT_BUILD
+void glance_zone_classify_batch_lut(GlanceZone current_zone, const AccelData *data,
+                                    uint32_t num_samples, uint8_t *zones_out);
+#endif
+
+#if GLANCE_ZONE_CLASSIFIER == GLANCE_ZONE_CLASSIFIER_SWAR
+#define glance_zone_classify_batch glance_zone_classify_batch_swar
+#elif GLANCE_ZONE_CLASSIFIER == GLANCE_ZONE_CLASSIFIER_LUT
+#define glance_zone_classify_batch glance_zone_classify_batch_lut
+#else
+#define glance_zone_classify_batch glance_zone_classify_batch_boxes
+#endif
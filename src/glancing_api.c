@@ -1,12 +1,26 @@
 #include <pebble.h>
 #include "glancing_api.h"
-
-// Enable debugging of glancing, currently just vibrate on glancing
-#define DEBUG
+#include "glancing_fsm.h"
+#include "glance_trace.h"
+#include "glance_zones.h"
+#include "glance_governor.h"
+#include "glance_filter.h"
+#include "glance_record.h"
 
 static bool discard_sample = false;
 
-#define SET_TIMER(TIMER, MS, CURR_TIME) (TIMER) = (CURR_TIME + MS)
+// Earliest running timer deadline, or NO_DEADLINE.  Setting a timer can
+// only bring it forward; resetting one leaves it early until the next
+// process_timers() recomputes it, which costs one spurious check.
+#define NO_DEADLINE UINT64_MAX
+static uint64_t next_deadline_ms = NO_DEADLINE;
+
+#define SET_TIMER(TIMER, MS, CURR_TIME) do { \
+    (TIMER) = (CURR_TIME + MS); \
+    if ((TIMER) < next_deadline_ms) { \
+      next_deadline_ms = (TIMER); \
+    } \
+  } while (0)
 #define TIMER_ACTIVE(TIMER, CURR_TIME) ((TIMER) > (CURR_TIME))
 #define TIMER_EXPIRED(TIMER, CURR_TIME) (((TIMER) != 0) && ((TIMER) <= (CURR_TIME)))
 #define RESET_TIMER(TIMER) (TIMER) = 0
@@ -23,47 +37,7 @@ static uint64_t old_active_timer = 0;  // Expiry time in milliseconds.  When run
 int32_t roll_timer_duration = 1000;         // Time allowed to return from roll
 static uint64_t roll_timer = 0;        // Expiry time in milliseconds
 
-#ifndef WITHIN
-#define WITHIN(n, min, max) ((n) >= (min) && (n) <= (max))
-#endif
-
-#define WITHIN_ACCELEROMETER_ZONE(zone, data) ( \
-  WITHIN((data).x, (zone).x_segment.start, (zone).x_segment.end) && \
-  WITHIN((data).y, (zone).y_segment.start, (zone).y_segment.end) && \
-  WITHIN((data).z, (zone).z_segment.start, (zone).z_segment.end) \
-  )
-
-typedef struct segment {
-  int start;
-  int end;
-} segment;
-
-typedef struct glancing_zone {
-  segment x_segment;
-  segment y_segment;
-  segment z_segment;
-} glancing_zone;
-
-// watch tilted towards user, screen pointed toward user
-glancing_zone active_zone = {
-  .x_segment = { -500, 500},
-  .y_segment = { -900, 200},
-  .z_segment = { -1100, 0}
-};
-
-// arm hanging downward, select button pointing toward ground
-glancing_zone dropped_zone = {
-  .x_segment = { 800, 1000},
-  .y_segment = { -500, 500},
-  .z_segment = { -800, 800}
-};
-
-// arm horizontal, screen facing away from user, essentially wrist was rotated away from user
-glancing_zone roll_zone = {
-  .x_segment = { -600, 600},
-  .y_segment = { 600, 1200},  // Lower Y was originally 850 - now easier to hit at low sample rate
-  .z_segment = { -500, 500}
-};
+int32_t suspend_timer_duration = 30000;     // Time still in the dropped zone before suspending, 0 never
 
 static GlanceZone current_zone = GLANCE_ZONE_NONE;
 
@@ -71,15 +45,31 @@ static void keep_light_on_while_active();
 
 static void prv_accel_handler(AccelData *data, uint32_t num_samples);
 
-// Default to an empty callback when state changes
-static void noop_glance_result_callback(GlanceResult *data) {}
-static GlanceResultHandler configured_glance_result_callback = noop_glance_result_callback;
+typedef struct GlanceSubscriber {
+  GlanceTransitionHandler handler;
+  void *context;
+  uint8_t event_mask;
+} GlanceSubscriber;
+
+static GlanceSubscriber subscribers[GLANCE_MAX_SUBSCRIBERS];
+
+// Transitions waiting for the end of the batch
+static GlanceTransition pending_transitions[GLANCE_MAX_TRANSITIONS];
+static uint8_t pending_count = 0;
+
+// Handler passed to glancing_service_subscribe(), fed one transition at a time
+static GlanceResultHandler configured_glance_result_callback = NULL;
 
 // Default initial state to inactive
 static GlanceResult glance_data = {.result = GLANCE_OUTPUT_IDLE};
+// State before the pending transitions
+static GlanceResult delivered_glance_data = {.result = GLANCE_OUTPUT_IDLE};
+
+static GlanceStats glance_stats;
 
 static bool light_on_when_active = false;
 static bool allow_flick_backlight_when_inactive = false;
+static bool tap_subscribed = false;
 // the time duration of the fade out
 static const int32_t LIGHT_FADE_TIME_MS = 500;
 
@@ -90,16 +80,123 @@ typedef struct time_ms_t {
   uint64_t milliseconds;
 } time_ms_t;
 
-static inline void send_glance_output(GlanceOutput output) {
+// Time of the batch being processed, used to timestamp trace events
+static uint64_t last_batch_time_ms = 0;
+
+// Time of the latest sample seen, to keep sample times monotonic
+static uint64_t last_sample_time_ms = 0;
+
+// Last reading taken while the vibe motor was off, held in place of
+// readings taken while it was on
+static bool have_quiet_reading = false;
+static AccelData last_quiet_reading;
+
+// Reading time at which the wrist last left the dropped zone, 0 once
+// accounted for
+static uint64_t left_dropped_zone_ms = 0;
+
+// Reading time of the last activation, 0 once the wrist has dropped
+static uint64_t last_activation_ms = 0;
+
+// Time up to which sampling time has been added to glance_stats, 0 when
+// not sampling
+static uint64_t sampling_accounted_ms = 0;
+
+// When the backlight was last switched on by the service
+static uint64_t light_on_since_ms = 0;
+
+static void flush_glance_transitions() {
+  if (pending_count == 0) {
+    return;
+  }
+
+  for (int i = 0; i < GLANCE_MAX_SUBSCRIBERS; i++) {
+    const GlanceSubscriber *sub = &subscribers[i];
+    if (!sub->handler) {
+      continue;
+    }
+    if (sub->event_mask == GLANCE_EVENT_MASK_ALL) {
+      sub->handler(pending_transitions, pending_count, &glance_data, sub->context);
+      continue;
+    }
+
+    GlanceTransition matching[GLANCE_MAX_TRANSITIONS];
+    uint8_t count = 0;
+    for (uint8_t j = 0; j < pending_count; j++) {
+      if (sub->event_mask & GLANCE_EVENT_MASK(pending_transitions[j].event)) {
+        matching[count++] = pending_transitions[j];
+      }
+    }
+    if (count) {
+      sub->handler(matching, count, &glance_data, sub->context);
+    }
+  }
+
+  delivered_glance_data = glance_data;
+  pending_count = 0;
+}
+
+static void queue_glance_transition(GlanceEvent event, uint8_t value, uint64_t time_ms) {
+  if (pending_count == GLANCE_MAX_TRANSITIONS) {
+    // A very busy batch - deliver what there is so far, early
+    flush_glance_transitions();
+  }
+  pending_transitions[pending_count++] = (GlanceTransition) {
+    .time_ms = time_ms,
+    .event = event,
+    .value = value,
+  };
+}
+
+static inline void send_glance_output(GlanceOutput output, uint64_t time_ms) {
+  GLANCE_TRACE(GLANCE_TRACE_OUTPUT, output, 0, time_ms);
   glance_data.result = output;
   glance_data.event = GLANCE_EVENT_OUTPUT;
-  configured_glance_result_callback(&glance_data);
+  queue_glance_transition(GLANCE_EVENT_OUTPUT, output, time_ms);
 }
 
-static inline void send_glance_zone(GlanceZone zone) {
+static inline void send_glance_zone(GlanceZone zone, uint64_t time_ms) {
   glance_data.zone = zone;
   glance_data.event = GLANCE_EVENT_ZONE;
-  configured_glance_result_callback(&glance_data);
+  queue_glance_transition(GLANCE_EVENT_ZONE, zone, time_ms);
+}
+
+// Adapts the batched transitions to a GlanceResultHandler
+static void result_handler_adapter(const GlanceTransition *transitions, uint8_t count,
+                                   const GlanceResult *state, void *context) {
+  GlanceResult result = delivered_glance_data;
+  for (uint8_t i = 0; i < count; i++) {
+    result.event = transitions[i].event;
+    if (result.event == GLANCE_EVENT_OUTPUT) {
+      result.result = transitions[i].value;
+    }
+    else {
+      result.zone = transitions[i].value;
+    }
+    configured_glance_result_callback(&result);
+  }
+}
+
+bool glancing_service_add_subscriber(uint8_t event_mask, GlanceTransitionHandler handler, void *context) {
+  for (int i = 0; i < GLANCE_MAX_SUBSCRIBERS; i++) {
+    if (!subscribers[i].handler) {
+      subscribers[i] = (GlanceSubscriber) {
+        .handler = handler,
+        .context = context,
+        .event_mask = event_mask,
+      };
+      return true;
+    }
+  }
+  return false;
+}
+
+void glancing_service_remove_subscriber(GlanceTransitionHandler handler, void *context) {
+  for (int i = 0; i < GLANCE_MAX_SUBSCRIBERS; i++) {
+    if ((subscribers[i].handler == handler) && (subscribers[i].context == context)) {
+      subscribers[i].handler = NULL;
+    }
+  }
 }
 
 static void store_current_time(time_ms_t *time_data)
@@ -110,300 +207,320 @@ static void store_current_time(time_ms_t *time_data)
 }
 
 bool prefer_fast_sampling = false;
-bool slow_sampling_active = false;
-bool fast_sampling_active = false;
 uint32_t sample_duration_ms = 0;
 
-// Setup motion accel handler with low sample rate
-// 10hz with buffer for 7 samples for 0.7 second poll rate
-static void start_slow_accelerometer_sampling(void *data) {
-  APP_LOG(APP_LOG_LEVEL_DEBUG, "start_slow_accelerometer_sampling");
- 
-  if (slow_sampling_active) {
+static GlanceSamplingTier sampling_tier = GLANCE_TIER_OFF;
+static uint64_t sampling_tier_since_ms = 0;
+
+// At most one tier switch is pending at a time; a newer decision just
+// replaces the tier it will switch to.
+static AppTimer *tier_switch_timer = NULL;
+static GlanceSamplingTier pending_sampling_tier = GLANCE_TIER_OFF;
+
+// While suspended, the reading taken at suspend and the peek timer
+static AccelData suspend_reading;
+static AppTimer *peek_timer = NULL;
+// Set when waking, cleared by the first batch after it
+static uint64_t wake_time_ms = 0;
+static GlanceWakeCause wake_cause;
+
+static void tap_event_handler(AccelAxisType axis, int32_t direction);
+static void peek_timer_handler(void *data);
+
+// The tap service is wanted for flick backlight, and to wake from suspend
+static void update_tap_subscription() {
+  const bool wanted = light_on_when_active || (sampling_tier == GLANCE_TIER_SUSPENDED);
+  if (wanted && !tap_subscribed) {
+    accel_tap_service_subscribe(tap_event_handler);
+  }
+  else if (!wanted && tap_subscribed) {
+    accel_tap_service_unsubscribe();
+  }
+  tap_subscribed = wanted;
+}
+
+static inline bool accelerometer_subscribed() {
+  return sampling_tier > GLANCE_TIER_SUSPENDED;
+}
+
+// Add the time since the last call to the stats for the current tier
+static void account_sampling_time(uint64_t now_ms) {
+  if (sampling_accounted_ms && (now_ms > sampling_accounted_ms)) {
+    const uint32_t elapsed = now_ms - sampling_accounted_ms;
+    if (sampling_tier == GLANCE_TIER_SUSPENDED) {
+      glance_stats.suspended_ms += elapsed;
+    }
+    else if (accelerometer_subscribed()) {
+      switch (glance_tier_config[sampling_tier].rate) {
+        case ACCEL_SAMPLING_10HZ:
+          glance_stats.sampling_10hz_ms += elapsed;
+          break;
+        case ACCEL_SAMPLING_25HZ:
+          glance_stats.sampling_25hz_ms += elapsed;
+          break;
+        default:
+          glance_stats.sampling_50hz_ms += elapsed;
+          break;
+      }
+    }
+  }
+  sampling_accounted_ms = (sampling_tier == GLANCE_TIER_OFF) ? 0 : now_ms;
+}
+
+// Stop batches altogether, leaving the FSMs and their timers as they are
+static void suspend_accelerometer_sampling() {
+  if (accelerometer_subscribed()) {
+    accel_data_service_unsubscribe();
+  }
+  account_sampling_time(last_batch_time_ms);
+  accel_service_peek(&suspend_reading);
+  peek_timer = app_timer_register(GLANCE_GOVERNOR_PEEK_MS, peek_timer_handler, NULL);
+
+  sampling_tier = GLANCE_TIER_SUSPENDED;
+  sampling_tier_since_ms = last_batch_time_ms;
+  glance_stats.suspends++;
+  update_tap_subscription();
+  GLANCE_TRACE(GLANCE_TRACE_SAMPLING, 0, 0, last_batch_time_ms);
+}
+
+// Setup motion accel handler at the rate and batch size of the tier
+static void start_accelerometer_sampling(GlanceSamplingTier tier) {
+  if (tier == sampling_tier) {
     return;
   }
-  
-  if (fast_sampling_active) {
-    accel_service_set_samples_per_update(7);
-    fast_sampling_active = false;  
+  if (tier == GLANCE_TIER_SUSPENDED) {
+    suspend_accelerometer_sampling();
+    return;
+  }
+
+  const GlanceTierConfig *config = &glance_tier_config[tier];
+  if (accelerometer_subscribed()) {
+    accel_service_set_samples_per_update(config->samples_per_update);
   }
   else {
-    accel_data_service_subscribe(7, prv_accel_handler);
+    accel_data_service_subscribe(config->samples_per_update, prv_accel_handler);
   }
-  accel_service_set_sampling_rate(ACCEL_SAMPLING_10HZ);
-  slow_sampling_active = true;  
+  accel_service_set_sampling_rate(config->rate);
+
+  const bool was_suspended = (sampling_tier == GLANCE_TIER_SUSPENDED);
+  account_sampling_time(last_batch_time_ms);
+  sampling_tier = tier;
+  sampling_tier_since_ms = last_batch_time_ms;
   discard_sample = true;
-  sample_duration_ms = 1000 / 10;
-  APP_LOG(APP_LOG_LEVEL_DEBUG, "Exit start_slow_accelerometer_sampling");
+  sample_duration_ms = 1000 / config->rate;
+  if (was_suspended) {
+    update_tap_subscription();
+  }
+  GLANCE_TRACE(GLANCE_TRACE_SAMPLING, config->rate, config->samples_per_update, last_batch_time_ms);
+}
+
+static void wake_accelerometer_sampling(GlanceWakeCause cause, uint64_t now_ms) {
+  if (peek_timer) {
+    app_timer_cancel(peek_timer);
+    peek_timer = NULL;
+  }
+  wake_time_ms = now_ms;
+  wake_cause = cause;
+  if (cause == GLANCE_WAKE_TAP) {
+    glance_stats.wakes_by_tap++;
+  }
+  else {
+    glance_stats.wakes_by_peek++;
+  }
+  last_batch_time_ms = now_ms;
+  glance_filter_reset();
+  start_accelerometer_sampling(GLANCE_TIER_SLOW);
 }
 
-// Setup motion accel handler with high sample rate
-// 25hz with buffer for 5 samples for 0.2 second poll rate
-static void start_fast_accelerometer_sampling(void *data) {
-  APP_LOG(APP_LOG_LEVEL_DEBUG, "start_fast_accelerometer_sampling");
-  if (fast_sampling_active) {
+// A single reading, cheap next to a running subscription.  Wake if the
+// wrist has left the dropped zone or moved since suspending.
+static void peek_timer_handler(void *data) {
+  peek_timer = NULL;
+
+  AccelData reading;
+  if (accel_service_peek(&reading) == 0) {
+    const uint32_t delta = abs(reading.x - suspend_reading.x) + abs(reading.y - suspend_reading.y) +
+                           abs(reading.z - suspend_reading.z);
+    if ((glance_zone_classify(GLANCE_ZONE_INACTIVE, &reading) != GLANCE_ZONE_INACTIVE) ||
+        (delta > GLANCE_GOVERNOR_WAKE_DELTA)) {
+      time_ms_t current_time;
+      store_current_time(&current_time);
+      wake_accelerometer_sampling(GLANCE_WAKE_PEEK, current_time.milliseconds);
+      return;
+    }
+  }
+  peek_timer = app_timer_register(GLANCE_GOVERNOR_PEEK_MS, peek_timer_handler, NULL);
+}
+
+static void tier_switch_timer_handler(void *data) {
+  tier_switch_timer = NULL;
+  start_accelerometer_sampling(pending_sampling_tier);
+}
+
+static void request_sampling_tier(GlanceSamplingTier tier) {
+  pending_sampling_tier = tier;
+  if (!tier_switch_timer && (tier != sampling_tier)) {
+    // Not from within the accel handler itself
+    tier_switch_timer = app_timer_register(10, tier_switch_timer_handler, NULL);
+  }
+}
+
+static void record_raise_to_light(uint64_t now_ms) {
+  if (!left_dropped_zone_ms || (now_ms - left_dropped_zone_ms > GLANCE_RAISE_WINDOW_MS)) {
+    // Not a raise from the dropped zone, e.g. looking at the watch on a desk
     return;
   }
 
-  if (slow_sampling_active) {
-    APP_LOG(APP_LOG_LEVEL_DEBUG, "accel_service_set_samples_per_update");
-    accel_service_set_samples_per_update(5);
-    slow_sampling_active = false;
+  const uint32_t latency = now_ms - left_dropped_zone_ms;
+  uint32_t bucket = latency / GLANCE_LATENCY_BUCKET_MS;
+  if (bucket >= GLANCE_LATENCY_BUCKETS) {
+    bucket = GLANCE_LATENCY_BUCKETS - 1;
   }
-  else {
-    accel_data_service_subscribe(5, prv_accel_handler);
+  if (glance_stats.raise_to_light[bucket] < UINT16_MAX) {
+    glance_stats.raise_to_light[bucket]++;
   }
-  
-  APP_LOG(APP_LOG_LEVEL_DEBUG, "accel_service_set_sampling_rate");
-  accel_service_set_sampling_rate(ACCEL_SAMPLING_25HZ);
-  fast_sampling_active = true;
-  discard_sample = true;
-  sample_duration_ms = 1000 / 25;
-  APP_LOG(APP_LOG_LEVEL_DEBUG, "Exit start_fast_accelerometer_sampling");
+  glance_stats.raise_to_light_total_ms += latency;
+  left_dropped_zone_ms = 0;
 }
 
 static GlanceOutput output_state = GLANCE_OUTPUT_IDLE;
-static void set_output_state(GlanceOutput new_state) {
+static void set_output_state(GlanceOutput new_state, uint64_t time_ms) {
+  if (new_state == GLANCE_OUTPUT_ACTIVE) {
+    // The light comes on now, not at the time of the reading
+    record_raise_to_light(last_batch_time_ms);
+  }
   if (new_state != output_state) {
+    if (new_state == GLANCE_OUTPUT_ACTIVE) {
+      glance_stats.activations++;
+      last_activation_ms = time_ms;
+    }
     output_state = new_state;
-    send_glance_output(new_state);
+    send_glance_output(new_state, time_ms);
   }
 }
 
-typedef enum {
-  GLANCE_STATE3_IDLE = 0,      // User is probably not looking at the watch
-  GLANCE_STATE3_NEW_ACTIVE = 2,          // User might well be looking at the watch
-  GLANCE_STATE3_OLD_ACTIVE = 3,          // User might well be looking at the watch
-  GLANCE_STATE3_IDLE_ACTIVE = 4,     // Activity expired, but not yet idle
-} GlanceFSMState3;
-
-typedef enum {
-  GLANCE_INPUT3_DROPPED = 0,
-  GLANCE_INPUT3_ROLLED = 1,
-  GLANCE_INPUT3_ACTIVE = 2,
-  GLANCE_INPUT3_SHORT_TIMER_EXPIRED = 3,
-  GLANCE_INPUT3_LONG_TIMER_EXPIRED = 4
-} GlanceFSMInput3;
-
 static GlanceFSMState3 state3 = GLANCE_STATE3_IDLE;
 static void glance_fsm3(GlanceFSMInput3 input, uint64_t time_of_input_ms) {
-  GlanceFSMState3 new_state = state3;
-  bool turn_light_on = false;
-  
-  if (input == GLANCE_INPUT3_DROPPED) {
-    APP_LOG(APP_LOG_LEVEL_DEBUG, "FSM3: DROPPED");
-    new_state = GLANCE_STATE3_IDLE;
+  const GlanceTransition3 *t = &glance_fsm3_table[state3][input];
+  const uint16_t actions = t->actions;
+
+  if (actions & GLANCE_ACTION3_RESET_TIMERS) {
     RESET_TIMER(new_active_timer);
     RESET_TIMER(old_active_timer);
-    set_output_state(GLANCE_OUTPUT_IDLE);
-    prefer_fast_sampling = false;
   }
-  
-  else if (input == GLANCE_INPUT3_ROLLED) {
-    APP_LOG(APP_LOG_LEVEL_DEBUG, "FSM3: ROLLED");
-    new_state = GLANCE_STATE3_NEW_ACTIVE;
-    if ((state3 == GLANCE_STATE3_IDLE) || (state3 == GLANCE_STATE3_IDLE_ACTIVE)) {
-      set_output_state(GLANCE_OUTPUT_ACTIVE);
-    }
-    else {
-      send_glance_output(GLANCE_OUTPUT_ROLL);
-    }
-    RESET_TIMER(new_active_timer);
-    RESET_TIMER(old_active_timer);
+  if (actions & GLANCE_ACTION3_START_NEW_TIMER) {
     SET_TIMER(new_active_timer, new_active_timer_duration, time_of_input_ms);
-    turn_light_on = true;
-    prefer_fast_sampling = true;
   }
-  
-  else if ((input == GLANCE_INPUT3_ACTIVE) && (state3 == GLANCE_STATE3_IDLE)) {
-    APP_LOG(APP_LOG_LEVEL_DEBUG, "FSM3: ACTIVE");
-    new_state = GLANCE_STATE3_NEW_ACTIVE;
-    RESET_TIMER(new_active_timer);
-    RESET_TIMER(old_active_timer);
-    SET_TIMER(new_active_timer, new_active_timer_duration, time_of_input_ms);
-    set_output_state(GLANCE_OUTPUT_ACTIVE);
-    turn_light_on = true;
+  if (actions & GLANCE_ACTION3_START_OLD_TIMER) {
+    SET_TIMER(old_active_timer, old_active_timer_duration, time_of_input_ms);
+  }
+  if (actions & GLANCE_ACTION3_OUTPUT_IDLE) {
+    set_output_state(GLANCE_OUTPUT_IDLE, time_of_input_ms);
+  }
+  if (actions & GLANCE_ACTION3_OUTPUT_ACTIVE) {
+    set_output_state(GLANCE_OUTPUT_ACTIVE, time_of_input_ms);
+  }
+  if (actions & GLANCE_ACTION3_OUTPUT_ROLL) {
+    glance_stats.rolls++;
+    send_glance_output(GLANCE_OUTPUT_ROLL, time_of_input_ms);
+  }
+  if (actions & GLANCE_ACTION3_FAST_SAMPLING) {
     prefer_fast_sampling = true;
   }
-    
-  else if ((input == GLANCE_INPUT3_SHORT_TIMER_EXPIRED) && (state3 == GLANCE_STATE3_NEW_ACTIVE)) {
-    APP_LOG(APP_LOG_LEVEL_DEBUG, "FSM3: SHORT_EXPIRE");
-    new_state = GLANCE_STATE3_OLD_ACTIVE;
-    SET_TIMER(old_active_timer, old_active_timer_duration, time_of_input_ms);
-    set_output_state(GLANCE_OUTPUT_ACTIVE);
+  if (actions & GLANCE_ACTION3_SLOW_SAMPLING) {
     prefer_fast_sampling = false;
   }
-    
-  else if ((input == GLANCE_INPUT3_LONG_TIMER_EXPIRED) && (state3 == GLANCE_STATE3_OLD_ACTIVE)) {
-    APP_LOG(APP_LOG_LEVEL_DEBUG, "FSM3: LONG_EXPIRE");
-    new_state = GLANCE_STATE3_IDLE_ACTIVE;
-    set_output_state(GLANCE_OUTPUT_IDLE);
-    prefer_fast_sampling = false;
+
+  if (t->next_state != state3) {
+    GLANCE_TRACE(GLANCE_TRACE_FSM3, (state3 << 4) | t->next_state, input, time_of_input_ms);
   }
-  
-  state3 = new_state;
-  APP_LOG(APP_LOG_LEVEL_DEBUG, "FSM3: New state %d", state3);
-  
+  state3 = t->next_state;
+
   // We don't turn the light on until the state has been changed.
-  if (turn_light_on) {
+  if (actions & GLANCE_ACTION3_LIGHT_ON) {
     keep_light_on_while_active();
   }
 }  
 
 
-typedef enum {
-  GLANCE_STATE2_NONE = 0,      // User is probably not looking at the watch
-  GLANCE_STATE2_ROLL = 6,     // User might be part way through a wrist roll
-} GlanceFSMState2;
-
-typedef enum {
-  GLANCE_INPUT2_DROPPED_ZONE = 0,
-  GLANCE_INPUT2_ACTIVE_ZONE = 1,
-  GLANCE_INPUT2_ROLL_ZONE = 2,
-  GLANCE_INPUT2_UNKNOWN_ZONE = 3,
-  GLANCE_INPUT2_SHORT_TIMER_EXPIRED = 4,
-  GLANCE_INPUT2_LONG_TIMER_EXPIRED = 5,
-  GLANCE_INPUT2_ROLL_TIMER_EXPIRED = 6,
-  GLANCE_INPUT2_ACTIVATION_TIMER_EXPIRED = 7,
-} GlanceFSMInput2;
-
 GlanceFSMState2 state2 = GLANCE_STATE2_NONE;
 static void glance_fsm2(GlanceFSMInput2 input, uint64_t time_of_input_ms) {
-  GlanceFSMState2 new_state = state2;
-  
-  switch (input) {
-    case GLANCE_INPUT2_DROPPED_ZONE:
-      // Hand dropped - reset everything
-      RESET_TIMER(roll_timer);
-      RESET_TIMER(activation_timer);
-      new_state = GLANCE_STATE2_NONE;
-      glance_fsm3(GLANCE_INPUT3_DROPPED, time_of_input_ms);
-      break;
-    
-    case GLANCE_INPUT2_ACTIVE_ZONE:
-      if (TIMER_ACTIVE(roll_timer, time_of_input_ms) && (state2 == GLANCE_STATE2_ROLL)) {
-        // Complete roll
-        RESET_TIMER(roll_timer);
-        glance_fsm3(GLANCE_INPUT3_ROLLED, time_of_input_ms);
-      }
-      else {
-        // Start activation timer
-        SET_TIMER(activation_timer, activation_timer_duration, time_of_input_ms);
-      }
-      break;
-    
-    case GLANCE_INPUT2_ROLL_ZONE:
-      RESET_TIMER(activation_timer);
-      if (TIMER_ACTIVE(roll_timer, time_of_input_ms)) {
-        // Flag that we reached the roll zone
-        new_state = GLANCE_STATE2_ROLL;
-      }
-      else if (current_zone == GLANCE_ZONE_ACTIVE) {
-        SET_TIMER(roll_timer, roll_timer_duration, time_of_input_ms);
-        new_state = GLANCE_STATE2_ROLL;
-        prefer_fast_sampling = true;
-      }
-      break;
+  const uint8_t guards = (TIMER_ACTIVE(roll_timer, time_of_input_ms) ? GLANCE_GUARD2_ROLL_TIMER_RUNNING : 0) |
+                         ((current_zone == GLANCE_ZONE_ACTIVE) ? GLANCE_GUARD2_WAS_ACTIVE_ZONE : 0);
+  const GlanceTransition2 *t = &glance_fsm2_table[state2][input][guards];
+  const uint8_t actions = t->actions;
 
-    case GLANCE_INPUT2_UNKNOWN_ZONE:
+  if (actions) {
+    if (actions & GLANCE_ACTION2_RESET_ROLL_TIMER) {
+      RESET_TIMER(roll_timer);
+    }
+    if (actions & GLANCE_ACTION2_RESET_ACTIVATION_TIMER) {
       RESET_TIMER(activation_timer);
-      if (current_zone == GLANCE_ZONE_ACTIVE) {
-        SET_TIMER(roll_timer, roll_timer_duration, time_of_input_ms);
-        prefer_fast_sampling = true;
-        new_state = GLANCE_STATE2_NONE;
-      }  
-      break;
-
-    case GLANCE_INPUT2_ROLL_TIMER_EXPIRED:
-      prefer_fast_sampling = false;
-      new_state = GLANCE_STATE2_NONE;
-      break;
-  
-    case GLANCE_INPUT2_ACTIVATION_TIMER_EXPIRED:
+    }
+    if (actions & GLANCE_ACTION2_START_ROLL_TIMER) {
+      SET_TIMER(roll_timer, roll_timer_duration, time_of_input_ms);
+    }
+    if (actions & GLANCE_ACTION2_START_ACTIVATION_TIMER) {
+      SET_TIMER(activation_timer, activation_timer_duration, time_of_input_ms);
+    }
+    if (actions & GLANCE_ACTION2_FAST_SAMPLING) {
+      prefer_fast_sampling = true;
+    }
+    if (actions & GLANCE_ACTION2_SLOW_SAMPLING) {
       prefer_fast_sampling = false;
-      glance_fsm3(GLANCE_INPUT3_ACTIVE, time_of_input_ms);
-      break;
-    
-    case GLANCE_INPUT2_SHORT_TIMER_EXPIRED:
-      glance_fsm3(GLANCE_INPUT3_SHORT_TIMER_EXPIRED, time_of_input_ms);
-      break;
-
-    case GLANCE_INPUT2_LONG_TIMER_EXPIRED:
-      glance_fsm3(GLANCE_INPUT3_LONG_TIMER_EXPIRED, time_of_input_ms);   
-      break;
+    }
   }
-  
-  state2 = new_state;
-}  
 
+  if (t->fsm3_input != GLANCE_INPUT3_NONE) {
+    glance_fsm3(t->fsm3_input, time_of_input_ms);
+  }
 
-static void process_accelerometer_reading(AccelData *reading, uint64_t reading_time_ms) {
-
-  // Start by testing if the zone is unchanged (for efficiency)
-  bool zone_not_changed = false;
-  switch (current_zone) {
-    case GLANCE_ZONE_ACTIVE:
-      if (WITHIN_ACCELEROMETER_ZONE(active_zone, *reading)) {
-        zone_not_changed = true;
-        // APP_LOG(APP_LOG_LEVEL_DEBUG, "Still ACTIVE");
-      }
-      break;
+  if (t->next_state != state2) {
+    GLANCE_TRACE(GLANCE_TRACE_FSM2, (state2 << 4) | t->next_state, input, time_of_input_ms);
+  }
+  state2 = t->next_state;
+}  
 
-    case GLANCE_ZONE_INACTIVE:
-      if (WITHIN_ACCELEROMETER_ZONE(dropped_zone, *reading)) {
-        zone_not_changed = true;
-        // APP_LOG(APP_LOG_LEVEL_DEBUG, "Still INACTIVE");
-      }
-      break;
 
-    case GLANCE_ZONE_ROLL:
-      if (WITHIN_ACCELEROMETER_ZONE(roll_zone, *reading)) {
-        zone_not_changed = true;
-        // APP_LOG(APP_LOG_LEVEL_DEBUG, "Still ROLLED");
-      }
-      break;
+// FSM2 input for entering each GlanceZone
+static const uint8_t zone_fsm2_input[] = {
+  [GLANCE_ZONE_INACTIVE] = GLANCE_INPUT2_DROPPED_ZONE,
+  [GLANCE_ZONE_ACTIVE] = GLANCE_INPUT2_ACTIVE_ZONE,
+  [GLANCE_ZONE_ROLL] = GLANCE_INPUT2_ROLL_ZONE,
+  [GLANCE_ZONE_NONE] = GLANCE_INPUT2_UNKNOWN_ZONE,
+};
 
-    case GLANCE_ZONE_NONE:
-      break;
+static void process_zone_change(GlanceZone new_zone, uint64_t reading_time_ms) {
+  GLANCE_TRACE(GLANCE_TRACE_ZONE, new_zone, current_zone, reading_time_ms);
+  if (current_zone == GLANCE_ZONE_INACTIVE) {
+    left_dropped_zone_ms = reading_time_ms;
   }
-
-  // If we haven't spotted that the zone is unchanged, try the other possibilities.
-  // Avoid repeating the test done above.
-  if (!zone_not_changed) {
-    if ((current_zone != GLANCE_ZONE_ACTIVE) && WITHIN_ACCELEROMETER_ZONE(active_zone, *reading)) {
-      APP_LOG(APP_LOG_LEVEL_DEBUG, "Gone ACTIVE");
-      glance_fsm2(GLANCE_INPUT2_ACTIVE_ZONE, reading_time_ms);
-      current_zone = GLANCE_ZONE_ACTIVE;
-      send_glance_zone(current_zone);      
-    }
-    else if ((current_zone != GLANCE_ZONE_INACTIVE) && WITHIN_ACCELEROMETER_ZONE(dropped_zone, *reading)) { 
-      APP_LOG(APP_LOG_LEVEL_DEBUG, "Gone INACTIVE");
-      glance_fsm2(GLANCE_INPUT2_DROPPED_ZONE, reading_time_ms);
-      current_zone = GLANCE_ZONE_INACTIVE;
-      send_glance_zone(current_zone);
-    }
-    else if ((current_zone != GLANCE_ZONE_ROLL) && WITHIN_ACCELEROMETER_ZONE(roll_zone, *reading)) { 
-      APP_LOG(APP_LOG_LEVEL_DEBUG, "Gone ROLL");
-      glance_fsm2(GLANCE_INPUT2_ROLL_ZONE, reading_time_ms);
-      current_zone = GLANCE_ZONE_ROLL;
-      send_glance_zone(current_zone);
-    }
-    else if (current_zone != GLANCE_ZONE_NONE) {
-      APP_LOG(APP_LOG_LEVEL_DEBUG, "Gone NONE");
-      glance_fsm2(GLANCE_INPUT2_UNKNOWN_ZONE, reading_time_ms);
-      current_zone = GLANCE_ZONE_NONE;
-      send_glance_zone(current_zone);
+  else if (new_zone == GLANCE_ZONE_INACTIVE) {
+    glance_stats.drops++;
+    if (last_activation_ms && (reading_time_ms - last_activation_ms <= GLANCE_FALSE_ACTIVATION_MS)) {
+      glance_stats.false_activations++;
     }
+    last_activation_ms = 0;
   }
-  //else {
-  //  APP_LOG(APP_LOG_LEVEL_DEBUG, "Zone unchanged");
-  //}
+  glance_fsm2(zone_fsm2_input[new_zone], reading_time_ms);
+  current_zone = new_zone;
+  send_glance_zone(current_zone, reading_time_ms);
+}
 
-  // Create inputs for timer experies
-  if (TIMER_EXPIRED(roll_timer, reading_time_ms)) {
-    RESET_TIMER(roll_timer);
-    glance_fsm2(GLANCE_INPUT2_ROLL_TIMER_EXPIRED, reading_time_ms);
-  }
+static inline uint64_t earliest_deadline(uint64_t deadline, uint64_t timer) {
+  return (timer && (timer < deadline)) ? timer : deadline;
+}
+
+static void update_next_deadline() {
+  uint64_t deadline = earliest_deadline(NO_DEADLINE, roll_timer);
+  deadline = earliest_deadline(deadline, new_active_timer);
+  deadline = earliest_deadline(deadline, old_active_timer);
+  next_deadline_ms = earliest_deadline(deadline, activation_timer);
+}
+
+// The new_active and old_active timers only step FSM3 towards idle, so the
+// readings before them can't change what their expiry does
+static void process_active_timers(uint64_t reading_time_ms) {
   if (TIMER_EXPIRED(new_active_timer, reading_time_ms)) {
     RESET_TIMER(new_active_timer);
     glance_fsm2(GLANCE_INPUT2_SHORT_TIMER_EXPIRED, reading_time_ms);
@@ -412,16 +529,112 @@ static void process_accelerometer_reading(AccelData *reading, uint64_t reading_t
     RESET_TIMER(old_active_timer);
     glance_fsm2(GLANCE_INPUT2_LONG_TIMER_EXPIRED, reading_time_ms);
   }
+}
+
+static void process_timers(uint64_t reading_time_ms) {
+  // Create inputs for timer experies
+  if (TIMER_EXPIRED(roll_timer, reading_time_ms)) {
+    RESET_TIMER(roll_timer);
+    glance_fsm2(GLANCE_INPUT2_ROLL_TIMER_EXPIRED, reading_time_ms);
+  }
+  process_active_timers(reading_time_ms);
   if (TIMER_EXPIRED(activation_timer, reading_time_ms)) {
     RESET_TIMER(activation_timer);
     glance_fsm2(GLANCE_INPUT2_ACTIVATION_TIMER_EXPIRED, reading_time_ms);
   }
+
+  update_next_deadline();
+}
+
+// One AppTimer for the earliest deadline, so timers expire on time even
+// when no batch is due, e.g. at 10Hz or while suspended.
+static AppTimer *deadline_timer = NULL;
+static uint64_t deadline_timer_ms = NO_DEADLINE;
+
+static void deadline_timer_handler(void *data);
+
+// When the batch after the last sample processed is due
+static inline uint64_t next_batch_due_ms() {
+  return last_sample_time_ms + glance_tier_config[sampling_tier].samples_per_update * sample_duration_ms;
+}
+
+// When the deadline timer should fire.  The roll and activation timers
+// depend on the readings before them, which may still be buffered in the
+// accelerometer; the next batch steps through those and expires the timers
+// in order on the way, so while sampling they wait for it unless it is
+// overdue.  The new_active and old_active timers expire on time.
+static uint64_t deadline_timer_due_ms() {
+  const uint64_t active_ms = earliest_deadline(earliest_deadline(NO_DEADLINE, new_active_timer), old_active_timer);
+  uint64_t zone_ms = earliest_deadline(earliest_deadline(NO_DEADLINE, roll_timer), activation_timer);
+  if ((zone_ms != NO_DEADLINE) && accelerometer_subscribed() && (zone_ms < next_batch_due_ms())) {
+    zone_ms = next_batch_due_ms();
+  }
+  return (active_ms < zone_ms) ? active_ms : zone_ms;
+}
+
+static void sync_deadline_timer(uint64_t now_ms) {
+  update_next_deadline();
+  const uint64_t due_ms = deadline_timer_due_ms();
+  if (due_ms == deadline_timer_ms) {
+    return;
+  }
+  deadline_timer_ms = due_ms;
+  if (due_ms == NO_DEADLINE) {
+    if (deadline_timer) {
+      app_timer_cancel(deadline_timer);
+      deadline_timer = NULL;
+    }
+    return;
+  }
+
+  const uint32_t timeout_ms = (due_ms > now_ms) ? due_ms - now_ms : 0;
+  if (!deadline_timer || !app_timer_reschedule(deadline_timer, timeout_ms)) {
+    deadline_timer = app_timer_register(timeout_ms, deadline_timer_handler, NULL);
+  }
+}
+
+static void deadline_timer_handler(void *data) {
+  deadline_timer = NULL;
+  deadline_timer_ms = NO_DEADLINE;
+
+  time_ms_t current_time;
+  store_current_time(&current_time);
+
+  last_batch_time_ms = current_time.milliseconds;
+
+  // Until the next batch is overdue the roll and activation timers are
+  // left to it, see deadline_timer_due_ms()
+  if (accelerometer_subscribed() && (current_time.milliseconds < next_batch_due_ms())) {
+    process_active_timers(current_time.milliseconds);
+  }
+  else {
+    process_timers(current_time.milliseconds);
+  }
+  sync_deadline_timer(current_time.milliseconds);
+  flush_glance_transitions();
+}
+
+// The accelerometer's own timestamp when it is plausible - not ahead of
+// now nor before the previous sample - else the time reconstructed from
+// the sampling rate
+static inline uint64_t sample_time_ms(const AccelData *sample, uint64_t estimate_ms, uint64_t now_ms) {
+  uint64_t t = sample->timestamp;
+  if ((t == 0) || (t > now_ms) || (t + GLANCE_MAX_SAMPLE_AGE_MS < now_ms)) {
+    t = estimate_ms;
+  }
+  if (t < last_sample_time_ms) {
+    t = last_sample_time_ms;
+  }
+  last_sample_time_ms = t;
+  return t;
 }
 
 static void prv_accel_handler(AccelData *data, uint32_t num_samples) {
   time_ms_t current_time;
   store_current_time(&current_time);
+  last_batch_time_ms = current_time.milliseconds;
 
+  // Estimated time of the first sample, for when timestamps are missing
   uint64_t input_time_ms;
 
   // Efficiency when idle, but has the downside of slowing down activation
@@ -440,31 +653,94 @@ static void prv_accel_handler(AccelData *data, uint32_t num_samples) {
     discard_sample = false;
   }
   
-  for (uint32_t i = first_sample; i < num_samples; i++) {
-    // APP_LOG(APP_LOG_LEVEL_DEBUG, "Sample %ud", i);
-    process_accelerometer_reading(&(data[i]), input_time_ms);
+  if (num_samples > GLANCE_ZONE_MAX_BATCH) {
+    num_samples = GLANCE_ZONE_MAX_BATCH;
+  }
+  glance_stats.batches++;
+  glance_stats.samples += num_samples;
+
+  if (glance_record_active()) {
+    // Raw, before anything is discarded or filtered
+    const uint64_t first_time_ms = (data[0].timestamp && (data[0].timestamp <= current_time.milliseconds)) ?
+                                   data[0].timestamp : current_time.milliseconds - num_samples * sample_duration_ms;
+    glance_record_batch(data, num_samples, first_time_ms, sample_duration_ms);
+  }
+
+  if (wake_time_ms) {
+    // First batch back from suspend
+    const uint32_t latency = current_time.milliseconds - wake_time_ms;
+    glance_stats.wake_latency_total_ms += latency;
+    if (latency > glance_stats.wake_latency_max_ms) {
+      glance_stats.wake_latency_max_ms = latency;
+    }
+    GLANCE_TRACE(GLANCE_TRACE_WAKE, wake_cause, latency, last_batch_time_ms);
+    wake_time_ms = 0;
+  }
+
+  // Hold the last quiet reading over any taken while vibrating, smooth,
+  // then classify the whole batch in one pass, then only step the FSMs at
+  // the samples where the zone changed.  The governor measures motion
+  // before smoothing, but without the vibe motor's shaking.
+  static AccelData readings[GLANCE_ZONE_MAX_BATCH];
+  uint8_t zones[GLANCE_ZONE_MAX_BATCH];
+  const uint32_t num_readings = (num_samples > first_sample) ? num_samples - first_sample : 0;
+  for (uint32_t i = 0; i < num_readings; i++) {
+    readings[i] = data[first_sample + i];
+    if (!readings[i].did_vibrate) {
+      last_quiet_reading = readings[i];
+      have_quiet_reading = true;
+    }
+    else {
+      glance_stats.vibrating_samples++;
+      if (have_quiet_reading) {
+        readings[i].x = last_quiet_reading.x;
+        readings[i].y = last_quiet_reading.y;
+        readings[i].z = last_quiet_reading.z;
+      }
+    }
+  }
+  const uint32_t energy = glance_governor_motion_energy(readings, num_readings);
+  if (num_readings) {
+    glance_filter_batch(readings, num_readings, readings);
+    glance_zone_classify_batch(current_zone, readings, num_readings, zones);
+  }
+
+  for (uint32_t i = 0; i < num_readings; i++) {
+    const uint64_t reading_time_ms = sample_time_ms(&readings[i], input_time_ms, current_time.milliseconds);
+    if (zones[i] != current_zone) {
+      process_zone_change(zones[i], reading_time_ms);
+    }
+    if (reading_time_ms >= next_deadline_ms) {
+      process_timers(reading_time_ms);
+    }
     input_time_ms += sample_duration_ms;
   }
+  sync_deadline_timer(current_time.milliseconds);
+  flush_glance_transitions();
 
   // Update the sampling speed
-  if (prefer_fast_sampling && slow_sampling_active) {
-    app_timer_register(10, start_fast_accelerometer_sampling, NULL);
-  }
-  else if (!prefer_fast_sampling && fast_sampling_active) {
-    app_timer_register(10, start_slow_accelerometer_sampling, NULL);
+  const GlanceGovernorInputs inputs = {
+    .prefer_fast = prefer_fast_sampling,
+    .roll_window = TIMER_ACTIVE(roll_timer, current_time.milliseconds),
+    .zone = current_zone,
+    // Recordings should show the wrist at rest too
+    .can_suspend = (state3 == GLANCE_STATE3_IDLE) && !glance_record_active(),
+    .suspend_after_ms = suspend_timer_duration,
+  };
+  GlanceSamplingTier tier = glance_governor_update(sampling_tier, sampling_tier_since_ms, &inputs,
+                                                   energy, current_time.milliseconds);
+  if ((tier != sampling_tier) || tier_switch_timer) {
+    request_sampling_tier(tier);
   }
 }
 
 static inline bool is_glancing() {
-  APP_LOG(APP_LOG_LEVEL_DEBUG, "is_glancing");
   return (state3 == GLANCE_STATE3_NEW_ACTIVE);
 }
 
 // Light interactive timer to save power by not turning on light in ambient sunlight
 bool holding_light_on = false;
 static void keep_light_on_while_active_internal(void *data) {
-  APP_LOG(APP_LOG_LEVEL_DEBUG, "keep_light_on_while_active");
-  
   if (!light_on_when_active) {
     return;
   }
@@ -472,18 +748,28 @@ static void keep_light_on_while_active_internal(void *data) {
   if (is_glancing()) { 
     app_timer_register(LIGHT_FADE_TIME_MS, keep_light_on_while_active_internal, data);
     light_enable_interaction();
+    if (!holding_light_on) {
+      GLANCE_TRACE(GLANCE_TRACE_LIGHT, 1, 0, last_batch_time_ms);
+      time_ms_t current_time;
+      store_current_time(&current_time);
+      light_on_since_ms = current_time.milliseconds;
+    }
     holding_light_on = true;
   } else {
     // no control over triggering fade-out from API
     // so just turn light off for now
     light_enable(false);
+    GLANCE_TRACE(GLANCE_TRACE_LIGHT, 0, 0, last_batch_time_ms);
+    if (holding_light_on) {
+      time_ms_t current_time;
+      store_current_time(&current_time);
+      glance_stats.light_on_ms += current_time.milliseconds - light_on_since_ms;
+    }
     holding_light_on = false;
   }
 }
 
 static void keep_light_on_while_active() {
-  APP_LOG(APP_LOG_LEVEL_DEBUG, "keep_light_on_while_active");
-  
   if (holding_light_on || !light_on_when_active) {
     return;
   }
@@ -494,10 +780,20 @@ static void keep_light_on_while_active() {
 static void tap_event_handler(AccelAxisType axis, int32_t direction) {
   time_ms_t current_time;
   store_current_time(&current_time);
+  GLANCE_TRACE(GLANCE_TRACE_TAP, axis, direction, current_time.milliseconds);
+
+  if (sampling_tier == GLANCE_TIER_SUSPENDED) {
+    wake_accelerometer_sampling(GLANCE_WAKE_TAP, current_time.milliseconds);
+  }
+  if (!light_on_when_active) {
+    // Only subscribed to wake from suspend
+    return;
+  }
 
   // If not glancing, optionally allow "flick backlight" behaviour
   if (!is_glancing(current_time.milliseconds)) {
     if (allow_flick_backlight_when_inactive) {
+      glance_stats.tap_lights++;
       light_enable_interaction();
     } else {
       light_enable(false);
@@ -505,39 +801,81 @@ static void tap_event_handler(AccelAxisType axis, int32_t direction) {
   }
 }
 
+typedef struct PersistedGlanceStats {
+  uint8_t version;
+  GlanceStats stats;
+} PersistedGlanceStats;
+
+#define GLANCE_STATS_VERSION 1
+
+// Stats are only written when they have changed since the last write, and
+// at most every GLANCE_STATS_SAVE_MS while subscribed, to spare the flash
+static uint32_t stats_persist_key;
+static bool stats_persisted = false;
+static GlanceStats saved_glance_stats;
+static AppTimer *stats_save_timer = NULL;
+
+static void save_glance_stats() {
+  if (!stats_persisted) {
+    return;
+  }
+  time_ms_t current_time;
+  store_current_time(&current_time);
+  account_sampling_time(current_time.milliseconds);
+  if (memcmp(&glance_stats, &saved_glance_stats, sizeof(glance_stats)) == 0) {
+    return;
+  }
+
+  PersistedGlanceStats persisted = {
+    .version = GLANCE_STATS_VERSION,
+    .stats = glance_stats,
+  };
+  if (persist_write_data(stats_persist_key, &persisted, sizeof(persisted)) == sizeof(persisted)) {
+    saved_glance_stats = glance_stats;
+  }
+}
+
+static void stats_save_timer_handler(void *data) {
+  save_glance_stats();
+  stats_save_timer = app_timer_register(GLANCE_STATS_SAVE_MS, stats_save_timer_handler, NULL);
+}
+
 void glancing_service_subscribe(bool control_backlight, 
                                 bool legacy_flick_backlight,
                                 GlanceResultHandler handler) {
   configured_glance_result_callback = handler;
+  if (handler) {
+    glancing_service_add_subscriber(GLANCE_EVENT_MASK_ALL, result_handler_adapter, NULL);
+  }
 
-  start_slow_accelerometer_sampling(NULL);
+  glance_zones_pack();
+  glance_governor_reset();
+  glance_filter_reset();
+  have_quiet_reading = false;
+  start_accelerometer_sampling(GLANCE_TIER_SLOW);
+
+  time_ms_t current_time;
+  store_current_time(&current_time);
+  sampling_accounted_ms = current_time.milliseconds;
+  if (stats_persisted) {
+    stats_save_timer = app_timer_register(GLANCE_STATS_SAVE_MS, stats_save_timer_handler, NULL);
+  }
  
   allow_flick_backlight_when_inactive = legacy_flick_backlight; 
   light_on_when_active = control_backlight;
   
-  if (light_on_when_active) {
-    // Setup tap service to support or disable flick to light behavior
-    accel_tap_service_subscribe(tap_event_handler);
-  } 
+  // Setup tap service to support or disable flick to light behavior
+  update_tap_subscription();
 }
 
 void glancing_service_update_control_backlight(bool control_backlight, 
                                 bool legacy_flick_backlight) {
 
-  bool old_light_on_when_active = light_on_when_active;
-  
   allow_flick_backlight_when_inactive = legacy_flick_backlight; 
   light_on_when_active = control_backlight;
   
-  if (old_light_on_when_active && !light_on_when_active) {
-    accel_tap_service_unsubscribe();
-  }
-  
-  else if (light_on_when_active && !old_light_on_when_active) {
-    // Setup tap service to support or disable flick to light behavior
-    accel_tap_service_subscribe(tap_event_handler);
-  } 
-  
+  // Setup tap service to support or disable flick to light behavior
+  update_tap_subscription();
 }
 
 void glancing_service_update_timers(int32_t light_time, int32_t active_time, int32_t roll_time) {
@@ -546,12 +884,66 @@ void glancing_service_update_timers(int32_t light_time, int32_t active_time, int
   old_active_timer_duration = active_time;
   roll_timer_duration = roll_time;
 } 
+
+void glancing_service_update_suspend_time(int32_t suspend_time) {
+  suspend_timer_duration = suspend_time;
+}
+
+void glancing_service_get_stats(GlanceStats *stats) {
+  time_ms_t current_time;
+  store_current_time(&current_time);
+  account_sampling_time(current_time.milliseconds);
+  *stats = glance_stats;
+}
+
+void glancing_service_reset_stats() {
+  memset(&glance_stats, 0, sizeof(glance_stats));
+}
+
+bool glancing_service_persist_stats(uint32_t persist_key) {
+  stats_persist_key = persist_key;
+  stats_persisted = true;
+
+  PersistedGlanceStats persisted;
+  if ((persist_read_data(persist_key, &persisted, sizeof(persisted)) != sizeof(persisted)) ||
+      (persisted.version != GLANCE_STATS_VERSION)) {
+    return false;
+  }
+  glance_stats = persisted.stats;
+  saved_glance_stats = glance_stats;
+  return true;
+}
   
 void glancing_service_unsubscribe() {
-  if (fast_sampling_active || slow_sampling_active) {
+  flush_glance_transitions();
+  glancing_service_remove_subscriber(result_handler_adapter, NULL);
+  configured_glance_result_callback = NULL;
+  if (tier_switch_timer) {
+    app_timer_cancel(tier_switch_timer);
+    tier_switch_timer = NULL;
+  }
+  if (peek_timer) {
+    app_timer_cancel(peek_timer);
+    peek_timer = NULL;
+  }
+  if (deadline_timer) {
+    app_timer_cancel(deadline_timer);
+    deadline_timer = NULL;
+    deadline_timer_ms = NO_DEADLINE;
+  }
+  if (stats_save_timer) {
+    app_timer_cancel(stats_save_timer);
+    stats_save_timer = NULL;
+  }
+  // Before unsubscribing, so the final sampling interval is still counted
+  save_glance_stats();
+  if (accelerometer_subscribed()) {
     accel_data_service_unsubscribe();
   }
-  if (light_on_when_active) {
+  sampling_tier = GLANCE_TIER_OFF;
+  sampling_accounted_ms = 0;
+  if (tap_subscribed) {
     accel_tap_service_unsubscribe();
+    tap_subscribed = false;
   }
 }
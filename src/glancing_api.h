@@ -28,13 +28,99 @@ typedef struct GlanceResult {
 
 typedef void (*GlanceResultHandler)(GlanceResult *data);
 
+// One zone or output change, at the time of the reading that caused it
+typedef struct GlanceTransition {
+  uint64_t time_ms;
+  uint8_t event;  // GlanceEvent
+  uint8_t value;  // GlanceZone or GlanceOutput, by event
+} GlanceTransition;
+
+#define GLANCE_EVENT_MASK(event) (1 << (event))
+#define GLANCE_EVENT_MASK_ALL (GLANCE_EVENT_MASK(GLANCE_EVENT_ZONE) | GLANCE_EVENT_MASK(GLANCE_EVENT_OUTPUT))
+
+// Most subscribers, and most transitions delivered in one call
+#define GLANCE_MAX_SUBSCRIBERS 4
+#define GLANCE_MAX_TRANSITIONS 16
+
+// transitions - changes since the last call, oldest first, only those
+//               matching the subscriber's event mask
+// state       - zone and output after the last of them
+typedef void (*GlanceTransitionHandler)(const GlanceTransition *transitions, uint8_t count,
+                                        const GlanceResult *state, void *context);
+
+typedef enum {
+  GLANCE_WAKE_TAP = 0,
+  GLANCE_WAKE_PEEK = 1,
+} GlanceWakeCause;
+
+// Histogram of the time from the wrist leaving the dropped zone to the
+// glance going active and the light coming on, in buckets of
+// GLANCE_LATENCY_BUCKET_MS, the last one catching everything slower.
+// Raises that take longer than GLANCE_RAISE_WINDOW_MS aren't counted.
+#define GLANCE_LATENCY_BUCKETS 16
+#define GLANCE_LATENCY_BUCKET_MS 200
+#define GLANCE_RAISE_WINDOW_MS 5000
+
+// Sample timestamps older than this are not trusted
+#define GLANCE_MAX_SAMPLE_AGE_MS 5000
+
+// An activation followed by a drop within this long counts as false
+#define GLANCE_FALSE_ACTIVATION_MS 2000
+
+// Persisted stats are saved this often, and on unsubscribe
+#define GLANCE_STATS_SAVE_MS (30 * 60 * 1000)
+
+typedef struct GlanceStats {
+  uint32_t activations;           // Glance output went active
+  uint32_t rolls;
+  uint32_t drops;                 // Wrist entered the dropped zone
+  uint32_t false_activations;     // Dropped within GLANCE_FALSE_ACTIVATION_MS of activating
+  uint32_t light_on_ms;           // Backlight held on by the service
+  uint32_t tap_lights;            // Backlight lit by a flick
+  uint32_t suspended_ms;          // Time at each sampling rate, or suspended
+  uint32_t sampling_10hz_ms;
+  uint32_t sampling_25hz_ms;
+  uint32_t sampling_50hz_ms;
+  uint32_t batches;               // Accelerometer batches handled, each a CPU wake
+  uint32_t samples;
+  uint32_t suspends;              // Times accelerometer sampling was suspended
+  uint32_t wakes_by_tap;
+  uint32_t wakes_by_peek;
+  uint32_t wake_latency_total_ms; // Wake to the first batch back, summed over wakes
+  uint32_t wake_latency_max_ms;
+  uint32_t vibrating_samples;     // Rejected because the vibe motor was running
+  uint32_t raise_to_light_total_ms;
+  uint16_t raise_to_light[GLANCE_LATENCY_BUCKETS];
+} GlanceStats;
+
 // control_backlight - switch on light while the glance is active
+// handler           - optional, called once for each transition
 void glancing_service_subscribe(bool control_backlight, 
                                 bool legacy_flick_backlight,
                                 GlanceResultHandler handler);
 
+// Transitions are collected over each accelerometer batch and delivered
+// together once it has been processed.  Returns false when all
+// GLANCE_MAX_SUBSCRIBERS slots are taken.
+bool glancing_service_add_subscriber(uint8_t event_mask, GlanceTransitionHandler handler, void *context);
+
+void glancing_service_remove_subscriber(GlanceTransitionHandler handler, void *context);
+
 void glancing_service_update_control_backlight(bool control_backlight, bool legacy_flick_backlight);
 
 void glancing_service_update_timers(int32_t light_timer, int32_t active_timer, int32_t roll_time);
 
+// suspend_time - ms still in the dropped zone before the accelerometer is
+// suspended until a tap or movement, 0 to keep sampling
+void glancing_service_update_suspend_time(int32_t suspend_time);
+
+void glancing_service_get_stats(GlanceStats *stats);
+
+// Continue the stats saved under persist_key, and keep saving them there
+// every GLANCE_STATS_SAVE_MS and on unsubscribe.  Call before subscribing.
+// Returns false if there were no saved stats, starting from zero.
+bool glancing_service_persist_stats(uint32_t persist_key);
+
+void glancing_service_reset_stats();
+
 void glancing_service_unsubscribe();
@@ -0,0 +1,196 @@
+#pragma once
+
+#include <pebble.h>
+
+// Transition tables for the two glance state machines in glancing_api.c.
+//
+// FSM2 turns zone changes and timer expiries into glance events, FSM3
+// turns those into the GlanceOutput.  Each step is one table load giving
+// the next state and a bitmask of actions for glancing_api.c to run, so
+// the per-sample path has no branching on state, and every transition
+// can be enumerated (see tools/glance_replay/fsm_check.c).
+
+typedef enum {
+  GLANCE_STATE3_IDLE = 0,         // User is probably not looking at the watch
+  GLANCE_STATE3_NEW_ACTIVE = 1,   // User might well be looking at the watch
+  GLANCE_STATE3_OLD_ACTIVE = 2,   // User might well be looking at the watch
+  GLANCE_STATE3_IDLE_ACTIVE = 3,  // Activity expired, but not yet idle
+  GLANCE_STATE3_COUNT
+} GlanceFSMState3;
+
+typedef enum {
+  GLANCE_INPUT3_DROPPED = 0,
+  GLANCE_INPUT3_ROLLED = 1,
+  GLANCE_INPUT3_ACTIVE = 2,
+  GLANCE_INPUT3_SHORT_TIMER_EXPIRED = 3,
+  GLANCE_INPUT3_LONG_TIMER_EXPIRED = 4,
+  GLANCE_INPUT3_COUNT,
+  GLANCE_INPUT3_NONE = GLANCE_INPUT3_COUNT  // FSM2 action: nothing to pass on
+} GlanceFSMInput3;
+
+// FSM3 actions, run in bit order after the state is looked up
+#define GLANCE_ACTION3_RESET_TIMERS     (1 << 0)  // Clear new_active_timer and old_active_timer
+#define GLANCE_ACTION3_START_NEW_TIMER  (1 << 1)
+#define GLANCE_ACTION3_START_OLD_TIMER  (1 << 2)
+#define GLANCE_ACTION3_OUTPUT_IDLE      (1 << 3)  // set_output_state(GLANCE_OUTPUT_IDLE)
+#define GLANCE_ACTION3_OUTPUT_ACTIVE    (1 << 4)  // set_output_state(GLANCE_OUTPUT_ACTIVE)
+#define GLANCE_ACTION3_OUTPUT_ROLL      (1 << 5)  // Always sent, repeated rolls are counted
+#define GLANCE_ACTION3_FAST_SAMPLING    (1 << 6)
+#define GLANCE_ACTION3_SLOW_SAMPLING    (1 << 7)
+#define GLANCE_ACTION3_LIGHT_ON         (1 << 8)  // Only after the new state is stored
+
+typedef struct GlanceTransition3 {
+  uint8_t next_state;
+  uint16_t actions;
+} GlanceTransition3;
+
+#define T3_DROP      { GLANCE_STATE3_IDLE, GLANCE_ACTION3_RESET_TIMERS | GLANCE_ACTION3_OUTPUT_IDLE | \
+                                           GLANCE_ACTION3_SLOW_SAMPLING }
+#define T3_ACTIVATE  { GLANCE_STATE3_NEW_ACTIVE, GLANCE_ACTION3_RESET_TIMERS | GLANCE_ACTION3_START_NEW_TIMER | \
+                                                 GLANCE_ACTION3_OUTPUT_ACTIVE | GLANCE_ACTION3_LIGHT_ON | \
+                                                 GLANCE_ACTION3_FAST_SAMPLING }
+#define T3_REROLL    { GLANCE_STATE3_NEW_ACTIVE, GLANCE_ACTION3_RESET_TIMERS | GLANCE_ACTION3_START_NEW_TIMER | \
+                                                 GLANCE_ACTION3_OUTPUT_ROLL | GLANCE_ACTION3_LIGHT_ON | \
+                                                 GLANCE_ACTION3_FAST_SAMPLING }
+#define T3_STAY(S)   { (S), 0 }
+
+static const GlanceTransition3 glance_fsm3_table[GLANCE_STATE3_COUNT][GLANCE_INPUT3_COUNT] = {
+  [GLANCE_STATE3_IDLE] = {
+    [GLANCE_INPUT3_DROPPED] = T3_DROP,
+    [GLANCE_INPUT3_ROLLED] = T3_ACTIVATE,
+    [GLANCE_INPUT3_ACTIVE] = T3_ACTIVATE,
+    [GLANCE_INPUT3_SHORT_TIMER_EXPIRED] = T3_STAY(GLANCE_STATE3_IDLE),
+    [GLANCE_INPUT3_LONG_TIMER_EXPIRED] = T3_STAY(GLANCE_STATE3_IDLE),
+  },
+  [GLANCE_STATE3_NEW_ACTIVE] = {
+    [GLANCE_INPUT3_DROPPED] = T3_DROP,
+    [GLANCE_INPUT3_ROLLED] = T3_REROLL,
+    [GLANCE_INPUT3_ACTIVE] = T3_STAY(GLANCE_STATE3_NEW_ACTIVE),
+    [GLANCE_INPUT3_SHORT_TIMER_EXPIRED] = { GLANCE_STATE3_OLD_ACTIVE, GLANCE_ACTION3_START_OLD_TIMER |
+                                                                      GLANCE_ACTION3_OUTPUT_ACTIVE |
+                                                                      GLANCE_ACTION3_SLOW_SAMPLING },
+    [GLANCE_INPUT3_LONG_TIMER_EXPIRED] = T3_STAY(GLANCE_STATE3_NEW_ACTIVE),
+  },
+  [GLANCE_STATE3_OLD_ACTIVE] = {
+    [GLANCE_INPUT3_DROPPED] = T3_DROP,
+    [GLANCE_INPUT3_ROLLED] = T3_REROLL,
+    [GLANCE_INPUT3_ACTIVE] = T3_STAY(GLANCE_STATE3_OLD_ACTIVE),
+    [GLANCE_INPUT3_SHORT_TIMER_EXPIRED] = T3_STAY(GLANCE_STATE3_OLD_ACTIVE),
+    [GLANCE_INPUT3_LONG_TIMER_EXPIRED] = { GLANCE_STATE3_IDLE_ACTIVE, GLANCE_ACTION3_OUTPUT_IDLE |
+                                                                      GLANCE_ACTION3_SLOW_SAMPLING },
+  },
+  [GLANCE_STATE3_IDLE_ACTIVE] = {
+    [GLANCE_INPUT3_DROPPED] = T3_DROP,
+    [GLANCE_INPUT3_ROLLED] = T3_ACTIVATE,
+    [GLANCE_INPUT3_ACTIVE] = T3_STAY(GLANCE_STATE3_IDLE_ACTIVE),
+    [GLANCE_INPUT3_SHORT_TIMER_EXPIRED] = T3_STAY(GLANCE_STATE3_IDLE_ACTIVE),
+    [GLANCE_INPUT3_LONG_TIMER_EXPIRED] = T3_STAY(GLANCE_STATE3_IDLE_ACTIVE),
+  },
+};
+
+#undef T3_DROP
+#undef T3_ACTIVATE
+#undef T3_REROLL
+#undef T3_STAY
+
+
+typedef enum {
+  GLANCE_STATE2_NONE = 0,  // User is probably not looking at the watch
+  GLANCE_STATE2_ROLL = 1,  // User might be part way through a wrist roll
+  GLANCE_STATE2_COUNT
+} GlanceFSMState2;
+
+typedef enum {
+  GLANCE_INPUT2_DROPPED_ZONE = 0,
+  GLANCE_INPUT2_ACTIVE_ZONE = 1,
+  GLANCE_INPUT2_ROLL_ZONE = 2,
+  GLANCE_INPUT2_UNKNOWN_ZONE = 3,
+  GLANCE_INPUT2_SHORT_TIMER_EXPIRED = 4,
+  GLANCE_INPUT2_LONG_TIMER_EXPIRED = 5,
+  GLANCE_INPUT2_ROLL_TIMER_EXPIRED = 6,
+  GLANCE_INPUT2_ACTIVATION_TIMER_EXPIRED = 7,
+  GLANCE_INPUT2_COUNT
+} GlanceFSMInput2;
+
+// FSM2 guards, computed once per step and used as the third table index
+#define GLANCE_GUARD2_ROLL_TIMER_RUNNING  (1 << 0)
+#define GLANCE_GUARD2_WAS_ACTIVE_ZONE     (1 << 1)  // current_zone before this input
+#define GLANCE_GUARD2_COUNT               4
+
+// FSM2 actions, run in bit order, then the FSM3 input is passed on
+#define GLANCE_ACTION2_RESET_ROLL_TIMER        (1 << 0)
+#define GLANCE_ACTION2_RESET_ACTIVATION_TIMER  (1 << 1)
+#define GLANCE_ACTION2_START_ROLL_TIMER        (1 << 2)
+#define GLANCE_ACTION2_START_ACTIVATION_TIMER  (1 << 3)
+#define GLANCE_ACTION2_FAST_SAMPLING           (1 << 4)
+#define GLANCE_ACTION2_SLOW_SAMPLING           (1 << 5)
+
+typedef struct GlanceTransition2 {
+  uint8_t next_state;
+  uint8_t actions;
+  uint8_t fsm3_input;  // GLANCE_INPUT3_NONE if FSM3 is not involved
+} GlanceTransition2;
+
+#define T2(S, A, I)            { (S), (A), (I) }
+#define T2_ANY_GUARD(S, A, I)  { T2(S, A, I), T2(S, A, I), T2(S, A, I), T2(S, A, I) }
+
+// Leaving the active zone starts the roll window
+#define T2_ROLL_WINDOW(S)  T2(S, GLANCE_ACTION2_RESET_ACTIVATION_TIMER | GLANCE_ACTION2_START_ROLL_TIMER | \
+                                 GLANCE_ACTION2_FAST_SAMPLING, GLANCE_INPUT3_NONE)
+
+#define T2_COMMON_ROWS(S) \
+  [GLANCE_INPUT2_DROPPED_ZONE] = T2_ANY_GUARD(GLANCE_STATE2_NONE, GLANCE_ACTION2_RESET_ROLL_TIMER | \
+                                              GLANCE_ACTION2_RESET_ACTIVATION_TIMER, GLANCE_INPUT3_DROPPED), \
+  [GLANCE_INPUT2_SHORT_TIMER_EXPIRED] = T2_ANY_GUARD(S, 0, GLANCE_INPUT3_SHORT_TIMER_EXPIRED), \
+  [GLANCE_INPUT2_LONG_TIMER_EXPIRED] = T2_ANY_GUARD(S, 0, GLANCE_INPUT3_LONG_TIMER_EXPIRED), \
+  [GLANCE_INPUT2_ROLL_TIMER_EXPIRED] = T2_ANY_GUARD(GLANCE_STATE2_NONE, GLANCE_ACTION2_SLOW_SAMPLING, \
+                                                    GLANCE_INPUT3_NONE), \
+  [GLANCE_INPUT2_ACTIVATION_TIMER_EXPIRED] = T2_ANY_GUARD(S, GLANCE_ACTION2_SLOW_SAMPLING, GLANCE_INPUT3_ACTIVE)
+
+// Indexed [state][input][guards]
+static const GlanceTransition2 glance_fsm2_table[GLANCE_STATE2_COUNT][GLANCE_INPUT2_COUNT][GLANCE_GUARD2_COUNT] = {
+  [GLANCE_STATE2_NONE] = {
+    T2_COMMON_ROWS(GLANCE_STATE2_NONE),
+    [GLANCE_INPUT2_ACTIVE_ZONE] = T2_ANY_GUARD(GLANCE_STATE2_NONE, GLANCE_ACTION2_START_ACTIVATION_TIMER,
+                                               GLANCE_INPUT3_NONE),
+    [GLANCE_INPUT2_ROLL_ZONE] = {
+      T2(GLANCE_STATE2_NONE, GLANCE_ACTION2_RESET_ACTIVATION_TIMER, GLANCE_INPUT3_NONE),
+      T2(GLANCE_STATE2_ROLL, GLANCE_ACTION2_RESET_ACTIVATION_TIMER, GLANCE_INPUT3_NONE),
+      T2_ROLL_WINDOW(GLANCE_STATE2_ROLL),
+      T2(GLANCE_STATE2_ROLL, GLANCE_ACTION2_RESET_ACTIVATION_TIMER, GLANCE_INPUT3_NONE),
+    },
+    [GLANCE_INPUT2_UNKNOWN_ZONE] = {
+      T2(GLANCE_STATE2_NONE, GLANCE_ACTION2_RESET_ACTIVATION_TIMER, GLANCE_INPUT3_NONE),
+      T2(GLANCE_STATE2_NONE, GLANCE_ACTION2_RESET_ACTIVATION_TIMER, GLANCE_INPUT3_NONE),
+      T2_ROLL_WINDOW(GLANCE_STATE2_NONE),
+      T2_ROLL_WINDOW(GLANCE_STATE2_NONE),
+    },
+  },
+  [GLANCE_STATE2_ROLL] = {
+    T2_COMMON_ROWS(GLANCE_STATE2_ROLL),
+    [GLANCE_INPUT2_ACTIVE_ZONE] = {
+      // Back in the active zone within the roll window completes the roll
+      T2(GLANCE_STATE2_ROLL, GLANCE_ACTION2_START_ACTIVATION_TIMER, GLANCE_INPUT3_NONE),
+      T2(GLANCE_STATE2_ROLL, GLANCE_ACTION2_RESET_ROLL_TIMER, GLANCE_INPUT3_ROLLED),
+      T2(GLANCE_STATE2_ROLL, GLANCE_ACTION2_START_ACTIVATION_TIMER, GLANCE_INPUT3_NONE),
+      T2(GLANCE_STATE2_ROLL, GLANCE_ACTION2_RESET_ROLL_TIMER, GLANCE_INPUT3_ROLLED),
+    },
+    [GLANCE_INPUT2_ROLL_ZONE] = {
+      T2(GLANCE_STATE2_ROLL, GLANCE_ACTION2_RESET_ACTIVATION_TIMER, GLANCE_INPUT3_NONE),
+      T2(GLANCE_STATE2_ROLL, GLANCE_ACTION2_RESET_ACTIVATION_TIMER, GLANCE_INPUT3_NONE),
+      T2_ROLL_WINDOW(GLANCE_STATE2_ROLL),
+      T2(GLANCE_STATE2_ROLL, GLANCE_ACTION2_RESET_ACTIVATION_TIMER, GLANCE_INPUT3_NONE),
+    },
+    [GLANCE_INPUT2_UNKNOWN_ZONE] = {
+      T2(GLANCE_STATE2_ROLL, GLANCE_ACTION2_RESET_ACTIVATION_TIMER, GLANCE_INPUT3_NONE),
+      T2(GLANCE_STATE2_ROLL, GLANCE_ACTION2_RESET_ACTIVATION_TIMER, GLANCE_INPUT3_NONE),
+      T2_ROLL_WINDOW(GLANCE_STATE2_NONE),
+      T2_ROLL_WINDOW(GLANCE_STATE2_NONE),
+    },
+  },
+};
+
+#undef T2
+#undef T2_ANY_GUARD
+#undef T2_ROLL_WINDOW
+#undef T2_COMMON_ROWS
@@ -1,6 +1,70 @@
-var ForecastIoWeather = function() {
-  
+// Sends AppMessages with up to `window` of them waiting for an ack, and
+// resends one that is nacked after a backoff that doubles each time, up to
+// `attempts` tries.  done(true) is called once every message has been
+// acked, or done(false) once one has run out of tries.
+var AppMessageQueue = function(window, attempts, backoffMs) {
+  this.window = window;
+  this.attempts = attempts;
+  this.backoffMs = backoffMs;
+};
+
+AppMessageQueue.prototype.send = function(messages, done) {
+  var self = this;
+  var next = 0;
+  var inFlight = 0;
+  var acked = 0;
+  var failed = false;
+
+  var attempt = function(index, tries) {
+    Pebble.sendAppMessage(messages[index], function() {
+      inFlight--;
+      acked++;
+      if (acked == messages.length) {
+        done(true);
+      } else {
+        fill();
+      }
+    }, function() {
+      if (failed) {
+        return;
+      }
+      if (tries + 1 >= self.attempts) {
+        console.log('weather: message ' + index + ' of ' + messages.length + ' failed ' + (tries + 1) + ' times');
+        failed = true;
+        done(false);
+        return;
+      }
+      // Still holds its place in the window while it waits
+      setTimeout(function() {
+        attempt(index, tries + 1);
+      }, self.backoffMs * Math.pow(2, tries));
+    });
+  };
+
+  var fill = function() {
+    while (!failed && inFlight < self.window && next < messages.length) {
+      inFlight++;
+      attempt(next++, 0);
+    }
+  };
+
+  if (!messages.length) {
+    done(true);
+    return;
+  }
+  fill();
+};
+
+// options, all optional, for testing against a local server:
+//   xhr(url, type, callback)  makes a request, calling callback(req) with
+//                             req.status and req.response when it's done
+//   forecastUrl, geocodeUrl   where to send them
+var ForecastIoWeather = function(options) {
+  options = options || {};
+
   this._apiKey    = '';
+  this._forecastUrl = options.forecastUrl || 'https://api.forecast.io/forecast/';
+  this._geocodeUrl = options.geocodeUrl || 'http://nominatim.openstreetmap.org/reverse';
 
   var conditions = {
     ClearSky        : 0,
@@ -15,15 +79,64 @@ var ForecastIoWeather = function() {
     Unknown         : 1000,
   };
 
-  this._xhrWrapper = function(url, type, callback) {
+  this._xhrWrapper = options.xhr || function(url, type, callback) {
     var xhr = new XMLHttpRequest();
     xhr.onload = function () {
       callback(xhr);
     };
+    xhr.onerror = function () {
+      callback({ status: 0, response: '' });
+    };
     xhr.open(type, url);
     xhr.send();
   };
 
+  // Responses to GET requests, by a key naming what was asked for, each
+  // with the time it was fetched.  One younger than the max age the caller
+  // gives is used without a request; an older one is fetched again, but
+  // still used if that fails.
+  this._httpCacheKey = 'weather-http-cache';
+  this._httpCacheMax = 16;
+
+  this._cachedGet = function(key, url, maxAgeMs, callback) {
+    var cache;
+    try {
+      cache = JSON.parse(localStorage.getItem(this._httpCacheKey)) || {};
+    } catch (e) {
+      cache = {};
+    }
+    var hit = cache[key];
+    if (hit && Date.now() - hit.time < maxAgeMs) {
+      console.log('weather: ' + key + ' from cache');
+      callback({ status: 200, response: hit.response });
+      return;
+    }
+
+    this._xhrWrapper(url, 'GET', function(req) {
+      if (req.status != 200) {
+        if (hit) {
+          console.log('weather: ' + key + ' failed (HTTP Status: ' + req.status + '), using cached');
+          callback({ status: 200, response: hit.response });
+        } else {
+          callback(req);
+        }
+        return;
+      }
+      cache[key] = { time: Date.now(), response: req.response };
+      var keys = Object.keys(cache).sort(function(a, b) {
+        return cache[b].time - cache[a].time;
+      });
+      for (var ii = this._httpCacheMax; ii < keys.length; ii++) {
+        delete cache[keys[ii]];
+      }
+      localStorage.setItem(this._httpCacheKey, JSON.stringify(cache));
+      callback(req);
+    }.bind(this));
+  };
+
+  // Place names hardly change, so are kept for days
+  this._geocodeMaxAgeMs = 7 * 24 * 3600 * 1000;
+
   this.beaufort_from_ms = function(speed_ms) {
     if (speed_ms < 5.5) {
       if (speed_ms < 1.6) {
@@ -76,10 +189,398 @@ var ForecastIoWeather = function() {
     }
   };
   
+  // 5 bytes/hour * 168 hours = 840 bytes.   Or 120 bytes/day.
+  // "time":1467068400,     - not required, we know the sequence.
+  // "precipIntensity":0,   - mm/hour, 1 byte (= 1 inch!)
+  // "precipProbability":0, - 0->1, scale to 1 byte
+  // "temperature":10.88,   - 1 byte, no decimal 0 is -50.
+  // "windSpeed":4.22,      - 16 directions * 12bft = 128 options.  1 byte.
+  // "windBearing":236,
+  // "cloudCover":0.27,     - 0->1, scale to 1 byte
+  // Probability and cloud cover only have 16 levels, level * 17, to fit
+  // the packed format
+  this._encodeHour = function(hour) {
+    var wind_val = Math.round(hour.windBearing / 22.5) % 16;
+    wind_val += 16 * this.beaufort_from_ms(hour.windSpeed);
+    return [
+      hour.precipIntensity > 255 ? 255 : Math.ceil(hour.precipIntensity),
+      Math.round(hour.precipProbability * 15) * 17,
+      // 0 is kept for hours missing from the feed
+      Math.min(255, Math.max(1, Math.round(hour.temperature) + 50)),
+      wind_val,
+      Math.round(hour.cloudCover * 15) * 17
+    ];
+  };
+
+  // Bit pack a day's 120 bytes for FIOW_PACKED, see get_weather.h
+  this._packDay = function(bytes) {
+    var out = [];
+    var bits = 0;
+    var put = function(value, width) {
+      for (var b = width - 1; b >= 0; b--, bits++) {
+        if ((bits & 7) === 0) {
+          out.push(0);
+        }
+        if ((value >> b) & 1) {
+          out[out.length - 1] |= 0x80 >> (bits & 7);
+        }
+      }
+    };
+    var field = function(hour, offset) {
+      return bytes[5 * hour + offset];
+    };
+    var hour;
+
+    put(field(0, 2), 8);
+    for (hour = 1; hour < 24; hour++) {
+      var step = field(hour, 2) - field(hour - 1, 2);
+      if (step === 0) {
+        put(0, 1);
+      } else if (step >= -2 && step <= 2) {
+        put(2, 2);
+        put(step < 0 ? step + 2 : step + 1, 2);
+      } else {
+        put(3, 2);
+        put(field(hour, 2), 8);
+      }
+    }
+
+    hour = 0;
+    while (hour < 24) {
+      var run = 0;
+      while (hour + run < 24 && run < 32 && field(hour + run, 0) === 0 && field(hour + run, 1) === 0) {
+        run++;
+      }
+      if (run) {
+        put(0, 1);
+        put(run - 1, 5);
+        hour += run;
+        continue;
+      }
+      put(1, 1);
+      put(field(hour, 1) / 17, 4);
+      if (field(hour, 0) < 15) {
+        put(field(hour, 0), 4);
+      } else {
+        put(15, 4);
+        put(field(hour, 0), 8);
+      }
+      hour++;
+    }
+
+    put(field(0, 3), 8);
+    for (hour = 1; hour < 24; hour++) {
+      if (field(hour, 3) == field(hour - 1, 3)) {
+        put(0, 1);
+      } else {
+        put(1, 1);
+        put(field(hour, 3), 8);
+      }
+    }
+
+    put(field(0, 4) / 17, 4);
+    for (hour = 1; hour < 24; hour++) {
+      if (field(hour, 4) == field(hour - 1, 4)) {
+        put(0, 1);
+      } else {
+        put(1, 1);
+        put(field(hour, 4) / 17, 4);
+      }
+    }
+    return out;
+  };
+
+  // Group new days into as few FIOW_PACKED messages as fit the watch's
+  // inbox, less room for the dictionary and the other tuples
+  this._packDays = function(days, inboxSize) {
+    var PACKED_VERSION = 1;
+    var OVERHEAD = 48;
+    var messages = [];
+    var packed = null;
+    for (var ii = 0; ii < days.length; ii++) {
+      var bits = this._packDay(days[ii].bytes);
+      var day = days[ii].header.concat([bits.length]).concat(bits);
+      if (!packed || packed.length + day.length > inboxSize - OVERHEAD) {
+        packed = [PACKED_VERSION];
+        messages.push({ 'FIOW_REPLY': 1, 'FIOW_PACKED': packed });
+      }
+      Array.prototype.push.apply(packed, day);
+    }
+    return messages;
+  };
+
+  // The forecast the watch holds, as last acknowledged, is kept here: the
+  // version it was named, the time of the first hour of day 0, and the
+  // slots of the ring of days (see get_weather.h), each the time of its
+  // first hour and its 120 bytes.
+  this._syncKey = 'weather-forecast-sync';
+  this._watchVersion = 0;
+  // Inbox size the watch reported, 0 for one that only takes FIOW_DATA
+  this._watchInbox = 0;
+
+  this._loadSync = function() {
+    try {
+      return JSON.parse(localStorage.getItem(this._syncKey));
+    } catch (e) {
+      return null;
+    }
+  };
+
+  this._saveSync = function(sync) {
+    if (sync) {
+      localStorage.setItem(this._syncKey, JSON.stringify(sync));
+    } else {
+      localStorage.removeItem(this._syncKey);
+    }
+  };
+
+  // Runs of hours that differ, as FIOW_PATCH wants them: first hour,
+  // count, then the hours
+  this._changedRuns = function(before, after) {
+    var runs = [];
+    var hour = 0;
+    var same = function(h) {
+      for (var b = 5 * h; b < 5 * h + 5; b++) {
+        if (before[b] != after[b]) {
+          return false;
+        }
+      }
+      return true;
+    };
+    while (hour < 24) {
+      if (same(hour)) {
+        hour++;
+        continue;
+      }
+      var first = hour;
+      while (hour < 24 && !same(hour)) {
+        hour++;
+      }
+      runs.push(first, hour - first);
+      runs = runs.concat(after.slice(5 * first, 5 * hour));
+    }
+    return runs;
+  };
+
+  // Forecasts for the last few places we fetched one, most recent first,
+  // each keyed by its coordinates to about 1km, with when it was fetched,
+  // the time of its first hour, its hours (5 bytes each, or null if
+  // missing from the feed) and the location name
+  this._locationsKey = 'weather-forecast-locations';
+  this._locationsMax = 4;
+  // How old a forecast the watch will take, from FIOW_MAXAGE
+  this._maxAgeMs = 30 * 60 * 1000;
+
+  this._locationKey = function(coords) {
+    return Math.round(coords.latitude * 100) + ',' + Math.round(coords.longitude * 100);
+  };
+
+  this._loadLocations = function() {
+    try {
+      return JSON.parse(localStorage.getItem(this._locationsKey)) || [];
+    } catch (e) {
+      return [];
+    }
+  };
+
+  // The forecast cached for coords, if it is fresh enough, as start and
+  // hours for _syncForecast, and the name
+  this._cachedForecast = function(coords) {
+    var key = this._locationKey(coords);
+    var entry = this._loadLocations().filter(function(location) {
+      return location.key == key;
+    })[0];
+    if (!entry || Date.now() - entry.fetched >= this._maxAgeMs) {
+      return null;
+    }
+    var hours = {};
+    for (var ii = 0; ii < entry.hours.length; ii++) {
+      if (entry.hours[ii]) {
+        hours[entry.start + ii * 3600] = entry.hours[ii];
+      }
+    }
+    return { start: entry.start, hours: hours, name: entry.name };
+  };
+
+  // Cache a forecast, or with only name given, name the one cached for
+  // coords
+  this._cacheForecast = function(coords, start, hours, name) {
+    var key = this._locationKey(coords);
+    var locations = this._loadLocations();
+    var entry = locations.filter(function(location) {
+      return location.key == key;
+    })[0];
+    if (start !== undefined) {
+      var list = [];
+      for (var ii = 0; ii < 168; ii++) {
+        list.push(hours[start + ii * 3600] || null);
+      }
+      locations = locations.filter(function(location) {
+        return location.key != key;
+      });
+      entry = { key: key, fetched: Date.now(), start: start, hours: list, name: entry ? entry.name : undefined };
+      locations.unshift(entry);
+      locations = locations.slice(0, this._locationsMax);
+    }
+    if (name !== undefined && entry) {
+      entry.name = name;
+    }
+    localStorage.setItem(this._locationsKey, JSON.stringify(locations));
+  };
+
+  this._queue = new AppMessageQueue(3, 4, 250);
+  // The sync being sent: its messages, the state the watch will be in
+  // once they are all through, and when they were last sent
+  this._pending = null;
+  // How long after a sync was sent the watch's requests for its gaps are
+  // answered from it.  The watch asks 10 s after the last message it got,
+  // so a request later than this is a scheduled refresh, which wants a
+  // new forecast rather than the rest of an old one.
+  this._resendWindowMs = 60 * 1000;
+
+  this._sendSync = function(pending, messages) {
+    this._pending = pending;
+    pending.sent = Date.now();
+    this._queue.send(messages, function(ok) {
+      if (ok && this._pending === pending) {
+        this._pending = null;
+        this._watchVersion = pending.sync.version;
+        this._saveSync(pending.sync);
+      }
+    }.bind(this));
+  };
+
+  // The watch gave up waiting for some of a sync's messages; send them
+  // again if it is the sync we are still sending, and recently
+  this._resendMissing = function(bytes) {
+    var version = (bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | (bytes[3] << 24)) >>> 0;
+    var missing = (bytes[4] | (bytes[5] << 8) | (bytes[6] << 16) | (bytes[7] << 24)) >>> 0;
+    var pending = this._pending;
+    if (pending && Date.now() - pending.sent >= this._resendWindowMs) {
+      console.log('weather: forecast sync ' + pending.sync.version + ' abandoned');
+      this._pending = pending = null;
+    }
+    if (!pending || pending.sync.version != version) {
+      return false;
+    }
+    var messages = pending.messages.filter(function(message, ii) {
+      return (missing >>> ii) & 1;
+    });
+    console.log('weather: resending ' + messages.length + ' of ' + pending.messages.length + ' forecast messages');
+    this._sendSync(pending, messages);
+    return true;
+  };
+
+  // Bring the watch up to date with hours (epoch time -> 5 bytes) starting
+  // at start, sending only the hours that changed if the watch still holds
+  // the forecast we last sent it
+  this._syncForecast = function(start, hours) {
+    var DAY = 24 * 3600;
+    var sync = this._loadSync();
+    if (!sync || !this._watchVersion || sync.version != this._watchVersion || start < sync.anchor) {
+      sync = { version: 0, anchor: start, days: [] };
+    }
+
+    var messages = [];
+    var newDays = [];
+    var bytesSent = 0;
+    var firstDay = Math.floor((start - sync.anchor) / DAY);
+    for (var k = firstDay; k < firstDay + 7; k++) {
+      var slot = k % 7;
+      var dayTime = sync.anchor + k * DAY;
+      var held = sync.days[slot] && sync.days[slot].time == dayTime;
+      var bytes = held ? sync.days[slot].bytes.slice() : [];
+      for (var hour = 0; hour < 24; hour++) {
+        var encoded = hours[dayTime + hour * 3600];
+        for (var b = 0; b < 5; b++) {
+          bytes[5 * hour + b] = encoded ? encoded[b] : (held ? bytes[5 * hour + b] : 0);
+        }
+      }
+
+      var header = [dayTime & 0xff, (dayTime >>> 8) & 0xff, (dayTime >>> 16) & 0xff, (dayTime >>> 24) & 0xff, slot];
+      var runs = held ? this._changedRuns(sync.days[slot].bytes, bytes) : [];
+      if (!held || (this._watchInbox && runs.length > this._packDay(bytes).length)) {
+        // New, or packing the whole day is smaller than the patch
+        newDays.push({ header: header, bytes: bytes });
+      } else if (runs.length) {
+        messages.push({ 'FIOW_REPLY': 1, 'FIOW_PATCH': header.concat(runs) });
+        bytesSent += header.length + runs.length;
+      }
+      sync.days[slot] = { time: dayTime, bytes: bytes };
+    }
+
+    if (this._watchInbox) {
+      var packed = this._packDays(newDays, this._watchInbox);
+      for (var pp = 0; pp < packed.length; pp++) {
+        bytesSent += packed[pp]['FIOW_PACKED'].length;
+      }
+      messages = packed.concat(messages);
+    } else {
+      for (var dd = 0; dd < newDays.length; dd++) {
+        messages.push({ 'FIOW_REPLY': 1, 'FIOW_DATA': newDays[dd].header.concat(newDays[dd].bytes) });
+        bytesSent += newDays[dd].header.length + newDays[dd].bytes.length;
+      }
+    }
+
+    console.log('weather: forecast sync of ' + messages.length + ' messages, ' + bytesSent + ' bytes');
+    if (!messages.length) {
+      // The watch is up to date, and should know it
+      this._queue.send([{ 'FIOW_REPLY': 1, 'FIOW_VERSION': sync.version }], function() {});
+      return;
+    }
+    // Each message names the sync and its place in it, so the watch can
+    // take them in any order and knows when it has them all
+    sync.version = 1 + Math.floor(Math.random() * 0x7ffffffe);
+    for (var mm = 0; mm < messages.length; mm++) {
+      messages[mm]['FIOW_VERSION'] = sync.version;
+      messages[mm]['FIOW_SEQ'] = mm | (messages.length << 8);
+    }
+
+    // Until every message is through we don't know what the watch holds
+    this._saveSync(null);
+    this._sendSync({ sync: sync, messages: messages }, messages);
+  };
+
+  // The name is what shows the weather as available on the watch, so it
+  // goes as soon as we have it, ahead of the forecast
+  this._sendName = function(name) {
+    this._queue.send([{ 'FIOW_REPLY': 1, 'FIOW_NAME': name }], function(ok) {
+      if (!ok) {
+        console.log('weather: location name not sent');
+      }
+    });
+  };
+
   this._getWeatherF_IO = function(coords) {
-    var url = 'https://api.forecast.io/forecast/' + this._apiKey + '/' +
-      coords.latitude + ',' + coords.longitude + '?exclude=currently,minutely,daily,alerts,flag&units=si&extend=hourly';
+    // A place we have been recently needs no request, and only what the
+    // watch doesn't have is sent
+    var cached = this._cachedForecast(coords);
+    if (cached) {
+      console.log('weather: forecast for ' + this._locationKey(coords) + ' from cache');
+      if (cached.name !== undefined) {
+        this._sendName(cached.name);
+      }
+      this._syncForecast(cached.start, cached.hours);
+      return;
+    }
+
+    // The name and the forecast are asked for together, rather than one
+    // after the other
+    var name;
+    var url = this._geocodeUrl + '?format=json&lat=' + coords.latitude + '&lon=' + coords.longitude;
+    this._cachedGet('geocode ' + this._locationKey(coords), url, this._geocodeMaxAgeMs, function(req) {
+      if(req.status == 200) {
+        var json = JSON.parse(req.response);
+        name = json.address.village || json.address.town || json.address.city || json.address.county || '';
+        this._cacheForecast(coords, undefined, undefined, name);
+        this._sendName(name);
+      } else {
+        // console.log('weather: Error fetching data (HTTP Status: ' + req.status + ')');
+      }
+    }.bind(this));
 
+    url = this._forecastUrl + this._apiKey + '/' +
+      coords.latitude + ',' + coords.longitude + '?exclude=currently,minutely,daily,alerts,flag&units=si&extend=hourly';
     console.log('weather: Contacting forecast.io... ' + url);
     // console.log(url);
 
@@ -87,91 +588,15 @@ var ForecastIoWeather = function() {
       console.log('weather: Got API response!');
       if(req.status == 200) {
         
-        // Send the hourly data as 7 messages of 24 hours
         var json = JSON.parse(req.response);
         var data = json.hourly.data;
-        var day = 0;
-        var data_list = [data[0].time & 0xff, (data[0].time >> 8) & 0xff, (data[0].time >> 16) & 0xff, (data[0].time >> 24) & 0xff, day];
-        var next_time = data[0].time;
-        for (var ii in data) {
-          //var time = data[ii].time;
-        
-          
-          // "time":1467068400,     - not required, we know the sequence.  1 byte to confirm, if seperate messages
-          //                          increases by 3600 each hour
-          
-          // 5 bytes/hour * 168 hours = 840 bytes.   Or 120 bytes/day.
-          // "precipIntensity":0,   - mm/hour, 1 byte (= 1 inch!)
-          // "precipProbability":0, - 0->1, scale to 1 byte
-          // "temperature":10.88,   - 1 byte, no decimal 0 is -50.
-          // "windSpeed":4.22,      - 16 directions * 12bft = 128 options.  1 byte.
-          // "windBearing":236,
-          // "cloudCover":0.27,     - 0->1, scale to 1 byte
-
-          // If results are missing, create empty results
-          while (next_time < data[ii].time) {
-            next_time += 3600;
-            data_list.push(0);
-            data_list.push(0);
-            data_list.push(0);
-            data_list.push(0);
-            data_list.push(0);
-            
-            if (data_list.length == (24 * 5)) {
-              var message = {
-                'FIOW_REPLY': 1,
-                'FIOW_DATA': data_list
-              };
-              Pebble.sendAppMessage(message);            
-              data_list = [(next_time + 3600) & 0xff, ((next_time + 3600) >> 8) & 0xff, ((next_time + 3600) >> 16) & 0xff, ((next_time + 3600) >> 24) & 0xff, day];
-              day += 1;
-            }            
-          }
-          
-          next_time = data[ii].time + 3600;
-          
-          if (data[ii].precipIntensity > 255) {
-            data_list.push(255);
-          }
-          else {
-            data_list.push(Math.ceil(data[ii].precipIntensity));
-          }
-          data_list.push(Math.floor(data[ii].precipProbability * 255 ));
-          
-          data_list.push(Math.round(data[ii].temperature) + 50);
-          var wind_val = Math.round(data[ii].windBearing / 22.5) % 16;
-          wind_val += 16 * this.beaufort_from_ms(data[ii].windSpeed);
-          data_list.push(wind_val);
-          data_list.push(Math.floor(data[ii].cloudCover * 255 ));
-          
-          if (data_list.length == (24 * 5)) {
-            var message3 = {
-              'FIOW_REPLY': 1,
-              'FIOW_DATA': data_list
-            };
-            Pebble.sendAppMessage(message3);            
-            data_list = [next_time & 0xff, (next_time >> 8) & 0xff, (next_time >> 16) & 0xff, (next_time >> 24) & 0xff, day];
-            day += 1;
-          }
+        var hours = {};
+        for (var ii = 0; ii < data.length; ii++) {
+          hours[data[ii].time] = this._encodeHour(data[ii]);
         }
-  
-        // Send the location information
-        var message2 = {
-          'FIOW_REPLY': 1,
-        };
-
-        url = 'http://nominatim.openstreetmap.org/reverse?format=json&lat=' + coords.latitude + '&lon=' + coords.longitude;
-        this._xhrWrapper(url, 'GET', function(req) {
-          if(req.status == 200) {
-            var json = JSON.parse(req.response);
-            var city = json.address.village || json.address.town || json.address.city || json.address.county || '';
-            message2['FIOW_NAME'] = city;
-            Pebble.sendAppMessage(message2);
-          } else {
-            // console.log('weather: Error fetching data (HTTP Status: ' + req.status + ')');
-          }
-        }.bind(this));
-
+        this._syncForecast(data[0].time, hours);
+        // With the name, if it came first
+        this._cacheForecast(coords, data[0].time, hours, name);
       } else {
         console.log('weather: Error fetching data (HTTP Status: ' + req.status + ')');
         Pebble.sendAppMessage({ 'FIOW_BADKEY': 1 });
@@ -201,6 +626,15 @@ var ForecastIoWeather = function() {
 
       console.log('weather: Got fetch request from C app');
 
+      this._watchVersion = dict.payload['FIOW_VERSION'] || 0;
+      this._watchInbox = dict.payload['FIOW_INBOX'] || 0;
+      if (dict.payload['FIOW_MAXAGE']) {
+        this._maxAgeMs = dict.payload['FIOW_MAXAGE'] * 1000;
+      }
+      if (dict.payload['FIOW_MISSING'] && this._resendMissing(dict.payload['FIOW_MISSING'])) {
+        return;
+      }
+
       this._apiKey = '';
 
       if(options && 'apiKey' in options){
@@ -239,8 +673,149 @@ var ForecastIoWeather = function() {
 
 var weather = new ForecastIoWeather();
 
+// Decode the binary glance trace ring (see glance_trace.h) to the log
+var glanceTraceEvents = {
+  1: 'SAMPLING',
+  2: 'ZONE',
+  3: 'FSM2',
+  4: 'FSM3',
+  5: 'OUTPUT',
+  6: 'LIGHT',
+  7: 'TAP',
+  8: 'WAKE'
+};
+
+var logGlanceTrace = function(bytes) {
+  var version = bytes[0];
+  var entrySize = bytes[1];
+  var count = bytes[2] | (bytes[3] << 8);
+  var lastMs = (bytes[4] | (bytes[5] << 8) | (bytes[6] << 16) | (bytes[7] << 24)) >>> 0;
+  if (version != 1 || entrySize != 6) {
+    console.log('glance: unknown trace format ' + version + '/' + entrySize);
+    return;
+  }
+
+  // Entries carry the delta from the previous one, so walk back from the
+  // newest to find the start time.
+  var entries = [];
+  var offset = 8;
+  var elapsed = 0;
+  for (var ii = 0; ii < count; ii++, offset += entrySize) {
+    var delta = bytes[offset + 2] | (bytes[offset + 3] << 8);
+    var arg1 = bytes[offset + 4] | (bytes[offset + 5] << 8);
+    entries.push({
+      event: glanceTraceEvents[bytes[offset]] || bytes[offset],
+      arg0: bytes[offset + 1],
+      arg1: (arg1 & 0x8000) ? arg1 - 0x10000 : arg1,
+      delta: delta
+    });
+    if (ii > 0) {
+      elapsed += delta;
+    }
+  }
+
+  var t = lastMs - elapsed;
+  console.log('glance: trace of ' + count + ' events');
+  for (var jj = 0; jj < entries.length; jj++) {
+    if (jj > 0) {
+      t += entries[jj].delta;
+    }
+    console.log('glance: ' + t + ' ' + entries[jj].event + ' ' + entries[jj].arg0 + ' ' + entries[jj].arg1);
+  }
+};
+
+var logGlanceLatency = function(bytes) {
+  var version = bytes[0];
+  var buckets = bytes[1];
+  var bucketMs = bytes[2] | (bytes[3] << 8);
+  var totalMs = (bytes[4] | (bytes[5] << 8) | (bytes[6] << 16) | (bytes[7] << 24)) >>> 0;
+  if (version != 1) {
+    console.log('glance: unknown latency format ' + version);
+    return;
+  }
+
+  var counts = [];
+  var total = 0;
+  for (var ii = 0; ii < buckets; ii++) {
+    counts.push(bytes[8 + 2 * ii] | (bytes[9 + 2 * ii] << 8));
+    total += counts[ii];
+  }
+  console.log('glance: raise to light over ' + total + ' glances, average ' +
+              (total ? Math.round(totalMs / total) : 0) + 'ms');
+  for (var jj = 0; jj < buckets; jj++) {
+    var label = (jj == buckets - 1) ? '>=' + (jj * bucketMs) : (jj * bucketMs) + '-' + ((jj + 1) * bucketMs);
+    console.log('glance: ' + label + 'ms ' + counts[jj]);
+  }
+};
+
+// Decodes accelerometer recording chunks, see src/glance_record.h, into
+// the trace CSV tools/glance_replay reads, times from the first chunk
+var glanceRecordStartMs = null;
+var glanceRecordLastSeq = null;
+
+var logGlanceRecord = function(bytes) {
+  if (bytes[0] != 1) {
+    console.log('glance: unknown recording format ' + bytes[0]);
+    return;
+  }
+  var seq = bytes[2] | (bytes[3] << 8);
+  var t = (bytes[4] | (bytes[5] << 8) | (bytes[6] << 16) | (bytes[7] << 24)) >>> 0;
+  if (glanceRecordLastSeq !== null && seq != ((glanceRecordLastSeq + 1) & 0xffff)) {
+    console.log('glance-record: # gap before chunk ' + seq);
+  }
+  glanceRecordLastSeq = seq;
+  if (glanceRecordStartMs === null) {
+    glanceRecordStartMs = t;
+    console.log('glance-record: # t_ms,x,y,z,glance,vibrate');
+  }
+
+  var offset = bytes[1];
+  var getVarint = function() {
+    var value = 0;
+    for (var shift = 0; offset < bytes.length; shift += 7) {
+      var b = bytes[offset++];
+      value += (b & 0x7f) * Math.pow(2, shift);
+      if (!(b & 0x80)) {
+        break;
+      }
+    }
+    return value;
+  };
+  var unzigzag = function(z) {
+    return (z % 2) ? -(z + 1) / 2 : z / 2;
+  };
+
+  var prev = [0, 0, 0];
+  while (offset < bytes.length) {
+    t += getVarint();
+    var period = getVarint();
+    var vibrate = bytes[offset] & 1;
+    var count = bytes[offset++] >> 1;
+    for (var ii = 0; ii < count; ii++) {
+      for (var axis = 0; axis < 3; axis++) {
+        prev[axis] += unzigzag(getVarint());
+      }
+      var rel = (t + ii * period - glanceRecordStartMs) >>> 0;
+      console.log('glance-record: ' + rel + ',' + prev[0] + ',' + prev[1] + ',' + prev[2] + ',0,' + vibrate);
+    }
+  }
+};
+
 Pebble.addEventListener('appmessage', function(e) {
   console.log('weather: appmessage received');
+  if (e.payload['GlanceRecord']) {
+    logGlanceRecord(e.payload['GlanceRecord']);
+    return;
+  }
+  if (e.payload['GlanceTrace'] || e.payload['GlanceLatency']) {
+    if (e.payload['GlanceTrace']) {
+      logGlanceTrace(e.payload['GlanceTrace']);
+    }
+    if (e.payload['GlanceLatency']) {
+      logGlanceLatency(e.payload['GlanceLatency']);
+    }
+    return;
+  }
   weather.appMessageHandler(e);
 });
 
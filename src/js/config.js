@@ -52,6 +52,43 @@ module.exports = [
         "max": 5000,
         "step": 200
       },
+      {
+        "type": "slider",
+        "messageKey": "CfgSuspendTime",
+        "defaultValue": "30",
+        "label": "Sleep accelerometer after arm down (s, 0 never)",
+        "min": 0,
+        "max": 300,
+        "step": 15
+      },
+      {
+        "type": "input",
+        "messageKey": "CfgZoneBounds",
+        "defaultValue": "",
+        "label": "Zone bounds override, from zone_fit (blank for built-in)",
+        "attributes": {
+          "limit": 128
+        }
+      },
+      {
+        "type": "toggle",
+        "messageKey": "CfgGlanceTrace",
+        "defaultValue": false,
+        "label": "Send glance trace to phone log"
+      },
+      {
+        "type": "toggle",
+        "messageKey": "CfgGlanceLatency",
+        "defaultValue": false,
+        "label": "Send glance latency histogram to phone log"
+      },
+      {
+        "type": "toggle",
+        "messageKey": "CfgGlanceRecord",
+        "defaultValue": false,
+        "label": "Record accelerometer to phone log",
+        "description": "As trace CSV lines for tools/glance_replay"
+      },
     ]
   },
   {
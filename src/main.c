@@ -1,15 +1,15 @@
 #include <pebble.h>
 #include "glancing_api.h"
 #include "get_weather.h"
+#include "glance_trace.h"
+#include "glance_zones.h"
+#include "energy_model.h"
+#include "glance_record.h"
 #include <pebble-events/pebble-events.h>
 
 /*
 Next up...
 
-- Glance
-  - Consider writing a zone-testing program
-    - monitor for 30s, then buzz, then monitor the next 10s while displaying the last results.
-
 - Weather retrieval
   - Store GPS co-ords, and re-use if location unavailable
 
@@ -51,7 +51,26 @@ static TextLayer *battery_text_layer;
 char bt_string[16] = "BTOK";
 static TextLayer *bluetooth_text_layer;
 
+// Estimated and measured battery cost since the last config change
+char energy_string[24] = "";
+static TextLayer *energy_text_layer;
+
 static EventHandle s_cfg_event_handle;
+static EventHandle s_sent_event_handle;
+static EventHandle s_failed_event_handle;
+
+// Persist keys holding the glance trace from the last run
+#define GLANCE_TRACE_PERSIST_KEY 100
+// Persist key holding zone bounds set through CfgZoneBounds
+#define GLANCE_ZONES_PERSIST_KEY 110
+// Persist key holding the running glance stats
+#define GLANCE_STATS_PERSIST_KEY 120
+// Persist keys holding accelerometer recording not yet sent to the phone
+#define GLANCE_RECORD_PERSIST_KEY 130
+// The weather library keeps its forecast in keys from
+// FORECASTIO_WEATHER_PERSIST_KEY_FIRST
+
+static void send_glance_recording(void *context);
 
 static GlanceOutput state = GLANCE_OUTPUT_IDLE;
 
@@ -65,20 +84,38 @@ void tick_handler(struct tm *tick_time, TimeUnits units_changed){
         clock_is_24h_style() ? "%H:%M" : "%I:%M", tick_time);
   }
   layer_mark_dirty(text_layer_get_layer(time_text_layer));
+
+  if (units_changed & MINUTE_UNIT) {
+    energy_model_format(energy_string, sizeof(energy_string));
+    layer_mark_dirty(text_layer_get_layer(energy_text_layer));
+    // Pick up any recording the outbox was too busy for
+    send_glance_recording(NULL);
+  }
+}
+
+static void set_seconds_mode(bool enable) {
+  if (enable == seconds_mode) {
+    return;
+  }
+  seconds_mode = enable;
+  tick_timer_service_subscribe(enable ? SECOND_UNIT : MINUTE_UNIT, tick_handler);
+  //Kick the tick_handler for instant update
+  time_t current_time = time(NULL);
+  tick_handler(localtime(&current_time), enable ? SECOND_UNIT : MINUTE_UNIT);
 }
 
-void glancing_callback(GlanceResult *data) {
-  time_t current_time;
- 
-  switch (data->event) {
-    case GLANCE_EVENT_OUTPUT:
-      switch (data->result) {
+// Called once per accelerometer batch with everything that changed, so
+// each layer is marked dirty at most once per batch
+static void glance_transitions_handler(const GlanceTransition *transitions, uint8_t count,
+                                       const GlanceResult *glance, void *context) {
+  bool output_changed = false;
+  bool zone_changed = false;
+
+  for (uint8_t i = 0; i < count; i++) {
+    if (transitions[i].event == GLANCE_EVENT_OUTPUT) {
+      output_changed = true;
+      switch (transitions[i].value) {
         case GLANCE_OUTPUT_ACTIVE:
-          seconds_mode = true;
-          tick_timer_service_subscribe((SECOND_UNIT), tick_handler);
-          //Kick the tick_handler for instant update
-          current_time = time(NULL);
-          tick_handler(localtime(&current_time),SECOND_UNIT);
           strncpy(glance_string, active_str, sizeof(glance_string) - 1);
           //window_set_background_color(window, GColorGreen); // Green for active
           break;
@@ -93,40 +130,44 @@ void glancing_callback(GlanceResult *data) {
         case GLANCE_OUTPUT_IDLE:
         default:
           roll_count = 0;
-          seconds_mode = false;
-          //Kick the tick_handler for instant update
-          current_time = time(NULL);
-          tick_handler(localtime(&current_time),MINUTE_UNIT);
-          tick_timer_service_subscribe((MINUTE_UNIT), tick_handler);
           strncpy(glance_string, inactive_str, sizeof(glance_string) - 1);
           //window_set_background_color(window, GColorRed);  // Red for inactive
           break;
       }
-      layer_mark_dirty(text_layer_get_layer(glance_text_layer));
-      state = data->result;
-      break;
+    }
+    else {
+      zone_changed = true;
+    }
+  }
 
-    case GLANCE_EVENT_ZONE:
-      switch (data->zone) {
-        case GLANCE_ZONE_INACTIVE:
-          strncpy(zone_string, "INACTIVE", sizeof(zone_string) - 1);
-          break;
-          
-        case GLANCE_ZONE_ACTIVE:
-          strncpy(zone_string, "ACTIVE", sizeof(zone_string) - 1);
-          break;
-          
-        case GLANCE_ZONE_ROLL:
-          strncpy(zone_string, "ROLL", sizeof(zone_string) - 1);
-          break;
-          
-        case GLANCE_ZONE_NONE:
-          strncpy(zone_string, "NONE", sizeof(zone_string) - 1);
-          break;
+  if (output_changed) {
+    // Roll keeps whatever mode the glance was in
+    if (glance->result != GLANCE_OUTPUT_ROLL) {
+      set_seconds_mode(glance->result == GLANCE_OUTPUT_ACTIVE);
+    }
+    layer_mark_dirty(text_layer_get_layer(glance_text_layer));
+    state = glance->result;
+  }
 
-      }
-      layer_mark_dirty(text_layer_get_layer(zone_text_layer));
-      break;
+  if (zone_changed) {
+    switch (glance->zone) {
+      case GLANCE_ZONE_INACTIVE:
+        strncpy(zone_string, "INACTIVE", sizeof(zone_string) - 1);
+        break;
+        
+      case GLANCE_ZONE_ACTIVE:
+        strncpy(zone_string, "ACTIVE", sizeof(zone_string) - 1);
+        break;
+        
+      case GLANCE_ZONE_ROLL:
+        strncpy(zone_string, "ROLL", sizeof(zone_string) - 1);
+        break;
+        
+      case GLANCE_ZONE_NONE:
+        strncpy(zone_string, "NONE", sizeof(zone_string) - 1);
+        break;
+    }
+    layer_mark_dirty(text_layer_get_layer(zone_text_layer));
   }
 }
 
@@ -176,17 +217,133 @@ static void handle_battery(BatteryChargeState charge_state) {
     snprintf(battery_string, sizeof(battery_string), "%d%%", charge_state.charge_percent);
   }
   text_layer_set_text(battery_text_layer, battery_string);
+  energy_model_battery(charge_state);
 }
 
 static void handle_bluetooth(bool connected) {
   text_layer_set_text(bluetooth_text_layer, connected ? "BTOK" : "NOBT");
 }
 
+// Serialized raise-to-light histogram: version, bucket count, bucket
+// width in ms, summed latency in ms, then a count per bucket, all little
+// endian
+#define GLANCE_LATENCY_VERSION 1
+#define GLANCE_LATENCY_HEADER_SIZE 8
+#define GLANCE_LATENCY_SIZE (GLANCE_LATENCY_HEADER_SIZE + 2 * GLANCE_LATENCY_BUCKETS)
+
+static uint16_t glance_latency_copy(uint8_t *buffer) {
+  GlanceStats stats;
+  glancing_service_get_stats(&stats);
+
+  buffer[0] = GLANCE_LATENCY_VERSION;
+  buffer[1] = GLANCE_LATENCY_BUCKETS;
+  buffer[2] = GLANCE_LATENCY_BUCKET_MS & 0xff;
+  buffer[3] = GLANCE_LATENCY_BUCKET_MS >> 8;
+  for (int i = 0; i < 4; i++) {
+    buffer[4 + i] = (stats.raise_to_light_total_ms >> (8 * i)) & 0xff;
+  }
+  uint8_t *counts = buffer + GLANCE_LATENCY_HEADER_SIZE;
+  for (int i = 0; i < GLANCE_LATENCY_BUCKETS; i++) {
+    counts[2 * i] = stats.raise_to_light[i] & 0xff;
+    counts[2 * i + 1] = stats.raise_to_light[i] >> 8;
+  }
+  return GLANCE_LATENCY_SIZE;
+}
+
+// Send the glance trace ring and/or the latency histogram to the phone,
+// where app.js logs them, in one message so neither finds the outbox busy
+static void send_glance_diagnostics(bool trace, bool latency) {
+  uint8_t trace_buffer[GLANCE_TRACE_DUMP_SIZE];
+  uint16_t trace_length = trace ? glance_trace_copy(trace_buffer, sizeof(trace_buffer)) : 0;
+  if (trace_length == 0 && !latency) {
+    return;
+  }
+
+  DictionaryIterator *out;
+  if (app_message_outbox_begin(&out) != APP_MSG_OK) {
+    return;
+  }
+  if (trace_length) {
+    dict_write_data(out, MESSAGE_KEY_GlanceTrace, trace_buffer, trace_length);
+  }
+  if (latency) {
+    uint8_t latency_buffer[GLANCE_LATENCY_SIZE];
+    dict_write_data(out, MESSAGE_KEY_GlanceLatency, latency_buffer, glance_latency_copy(latency_buffer));
+  }
+  app_message_outbox_send();
+}
+
+// A chunk the phone didn't get, or the outbox was too busy for, is still
+// the oldest, so goes again
+#define GLANCE_RECORD_RETRY_MS 2000
+static AppTimer *s_record_retry_timer = NULL;
+
+static void record_retry_timer_handler(void *context) {
+  s_record_retry_timer = NULL;
+  send_glance_recording(NULL);
+}
+
+static void retry_glance_recording(void) {
+  if (!s_record_retry_timer) {
+    s_record_retry_timer = app_timer_register(GLANCE_RECORD_RETRY_MS, record_retry_timer_handler, NULL);
+  }
+}
+
+// Send the oldest unsent chunk of accelerometer recording to the phone,
+// where app.js logs it as trace CSV.  It is dropped once the phone acks
+// it, and the rest follow.
+static void send_glance_recording(void *context) {
+  uint16_t length;
+  const uint8_t *chunk = glance_record_peek_chunk(&length);
+  if (!chunk) {
+    return;
+  }
+
+  DictionaryIterator *out;
+  if (app_message_outbox_begin(&out) != APP_MSG_OK) {
+    retry_glance_recording();
+    return;
+  }
+  dict_write_data(out, MESSAGE_KEY_GlanceRecord, chunk, length);
+  app_message_outbox_send();
+}
+
+static void outbox_sent_handler(DictionaryIterator *iter, void *context) {
+  Tuple *record_t = dict_find(iter, MESSAGE_KEY_GlanceRecord);
+  if (!record_t) {
+    return;
+  }
+  glance_record_chunk_sent(record_t->value->data);
+  // A weather fetch waiting on the outbox goes ahead of the rest
+  if (forecast_io_weather_fetch_waiting()) {
+    retry_glance_recording();
+  }
+  else {
+    send_glance_recording(NULL);
+  }
+}
+
+static void outbox_failed_handler(DictionaryIterator *iter, AppMessageResult reason, void *context) {
+  if (dict_find(iter, MESSAGE_KEY_GlanceRecord)) {
+    retry_glance_recording();
+  }
+}
+
+// Take *value from the tuple, if there is one, and say whether it changed
+static bool update_setting(int32_t *value, const Tuple *tuple) {
+  if (!tuple || (tuple->value->int32 == *value)) {
+    return false;
+  }
+  *value = tuple->value->int32;
+  return true;
+}
+
 static bool backlight = true;
 static bool flick_backlight = true;
 static int32_t active_time = 5;
 static int32_t light_time = 30;
 static int32_t roll_time = 1000;
+static int32_t suspend_time = 30;
 static void cfg_inbox_received_handler(DictionaryIterator *iter, void *context) {
   Tuple *backlight_t = dict_find(iter, MESSAGE_KEY_CfgBacklight);
   Tuple *flick_backlight_t = dict_find(iter, MESSAGE_KEY_CfgFlickBacklight);
@@ -195,28 +352,98 @@ static void cfg_inbox_received_handler(DictionaryIterator *iter, void *context)
   Tuple *roll_time_t = dict_find(iter, MESSAGE_KEY_CfgRollTime);
   Tuple *api_key_t = dict_find(iter, MESSAGE_KEY_CfgApiKey);
   Tuple *weather_freq_t = dict_find(iter, MESSAGE_KEY_CfgWeatherFreq);
+  Tuple *glance_trace_t = dict_find(iter, MESSAGE_KEY_CfgGlanceTrace);
+  Tuple *glance_latency_t = dict_find(iter, MESSAGE_KEY_CfgGlanceLatency);
+  Tuple *glance_record_t = dict_find(iter, MESSAGE_KEY_CfgGlanceRecord);
+  Tuple *suspend_time_t = dict_find(iter, MESSAGE_KEY_CfgSuspendTime);
+  Tuple *zone_bounds_t = dict_find(iter, MESSAGE_KEY_CfgZoneBounds);
+
+  // Clay sends every setting on each save, so note which actually changed
+  bool changed = false;
 
   if (backlight_t || flick_backlight_t) {
-    if (backlight_t) backlight = backlight_t->value->int32 == 1;
-    if (flick_backlight_t) flick_backlight = flick_backlight_t->value->int32 == 1;
-    glancing_service_update_control_backlight(backlight, flick_backlight);
+    const bool new_backlight = backlight_t ? backlight_t->value->int32 == 1 : backlight;
+    const bool new_flick_backlight = flick_backlight_t ? flick_backlight_t->value->int32 == 1 : flick_backlight;
+    if ((new_backlight != backlight) || (new_flick_backlight != flick_backlight)) {
+      backlight = new_backlight;
+      flick_backlight = new_flick_backlight;
+      glancing_service_update_control_backlight(backlight, flick_backlight);
+      changed = true;
+    }
   }
 
-  if (light_time_t || active_time_t || roll_time_t) {
-    if (active_time_t) active_time = active_time_t->value->int32;
-    if (light_time_t) light_time = light_time_t->value->int32;
-    if (roll_time_t) roll_time = roll_time_t->value->int32;
+  bool timers_changed = update_setting(&active_time, active_time_t);
+  timers_changed |= update_setting(&light_time, light_time_t);
+  timers_changed |= update_setting(&roll_time, roll_time_t);
+  if (timers_changed) {
     glancing_service_update_timers(1000*light_time, 1000*active_time, roll_time);
+    changed = true;
+  }
+
+  if (update_setting(&suspend_time, suspend_time_t)) {
+    glancing_service_update_suspend_time(1000*suspend_time);
+    changed = true;
   }
 
-  if (weather_freq_t) {
+  // Clay sends every setting on each save, so the zones, and their
+  // storage, are only touched when the bounds change
+  if (zone_bounds_t) {
+    const char *text = zone_bounds_t->value->cstring;
+    int16_t bounds[GLANCE_ZONE_BOUNDS_COUNT];
+    int16_t current_bounds[GLANCE_ZONE_BOUNDS_COUNT];
+    glance_zones_get_bounds(current_bounds);
+    if (text[0] == '\0') {
+      // An override is only in use while it is stored
+      if (persist_exists(GLANCE_ZONES_PERSIST_KEY)) {
+        glance_zones_reset_bounds();
+        persist_delete(GLANCE_ZONES_PERSIST_KEY);
+        changed = true;
+      }
+    }
+    else if (!glance_zones_parse_bounds(text, bounds)) {
+      APP_LOG(APP_LOG_LEVEL_WARNING, "Ignoring bad zone bounds: %s", text);
+    }
+    else if (memcmp(bounds, current_bounds, sizeof(bounds)) != 0) {
+      if (glance_zones_set_bounds(bounds)) {
+        glance_zones_save(GLANCE_ZONES_PERSIST_KEY);
+        changed = true;
+      }
+      else {
+        APP_LOG(APP_LOG_LEVEL_WARNING, "Ignoring bad zone bounds: %s", text);
+      }
+    }
+  }
+
+  if (weather_freq_t && ((uint32_t)weather_freq_t->value->int32 != forecast_io_weather_get_update_frequency())) {
     forecast_io_weather_set_update_frequency(weather_freq_t->value->int32);
+    changed = true;
   }
   
   
   if (api_key_t) {
     forecast_io_weather_set_api_key(api_key_t->value->cstring);
   }
+
+  if (glance_record_t) {
+    if (glance_record_t->value->int32 == 1) {
+      if (!glance_record_start(send_glance_recording, NULL)) {
+        APP_LOG(APP_LOG_LEVEL_WARNING, "No memory to record");
+      }
+    }
+    else {
+      glance_record_stop();
+    }
+  }
+
+  // Judge the new settings by their own battery cost
+  if (changed) {
+    energy_model_restart();
+    energy_model_format(energy_string, sizeof(energy_string));
+    layer_mark_dirty(text_layer_get_layer(energy_text_layer));
+  }
+
+  send_glance_diagnostics(glance_trace_t && glance_trace_t->value->int32 == 1,
+                          glance_latency_t && glance_latency_t->value->int32 == 1);
 }
 
 static void window_load(Window *window) {
@@ -272,6 +499,14 @@ static void window_load(Window *window) {
   text_layer_set_text_alignment(bluetooth_text_layer, GTextAlignmentCenter);
   layer_add_child(window_layer, text_layer_get_layer(bluetooth_text_layer));
 
+  energy_text_layer = text_layer_create(GRect (0, center.y + 60, bounds.size.w, 24)); 
+  text_layer_set_text(energy_text_layer, energy_string);
+  text_layer_set_font(energy_text_layer, fonts_get_system_font(FONT_KEY_GOTHIC_18_BOLD));
+  text_layer_set_text_color(energy_text_layer, GColorWhite);
+  text_layer_set_background_color(energy_text_layer, GColorClear);
+  text_layer_set_text_alignment(energy_text_layer, GTextAlignmentCenter);
+  layer_add_child(window_layer, text_layer_get_layer(energy_text_layer));
+
   // Force time update
   time_t current_time = time(NULL);
   struct tm *current_tm = localtime(&current_time);
@@ -282,12 +517,19 @@ static void window_load(Window *window) {
 
   battery_state_service_subscribe(handle_battery);
 
-  connection_service_subscribe((ConnectionHandlers) {
+  // Shared with the weather library, which waits for the phone to retry
+  events_connection_service_subscribe((ConnectionHandlers) {
     .pebble_app_connection_handler = handle_bluetooth
-  });  
+  });
   
+  // Zone bounds from CfgZoneBounds, if any, else those compiled in
+  glance_zones_load(GLANCE_ZONES_PERSIST_KEY);
+  glancing_service_persist_stats(GLANCE_STATS_PERSIST_KEY);
+
   // Enable Glancing with normal 5 second timeout, takeover backlight
-  glancing_service_subscribe(backlight, flick_backlight, glancing_callback);
+  glancing_service_subscribe(backlight, flick_backlight, NULL);
+  glancing_service_add_subscriber(GLANCE_EVENT_MASK_ALL, glance_transitions_handler, NULL);
+  energy_model_restart();
   
   handle_battery(battery_state_service_peek());  
 }
@@ -299,6 +541,7 @@ static void window_unload(Window *window) {
   text_layer_destroy(zone_text_layer);
   text_layer_destroy(battery_text_layer);
   text_layer_destroy(bluetooth_text_layer);
+  text_layer_destroy(energy_text_layer);
 }
 
 static void init(void) {
@@ -314,16 +557,40 @@ static void init(void) {
   forecast_io_weather_set_api_key("ddb8191c20d47e3cd47c91912e5c200c");
   
   // Set up sizes for config messages
-  events_app_message_request_inbox_size(128);
+  events_app_message_request_inbox_size(256);
+  // The outbox takes the largest of our messages: the diagnostics, which
+  // carry the trace ring only when it is compiled in, and recording chunks
+#if GLANCE_TRACE_LEVEL
+  events_app_message_request_outbox_size(dict_calc_buffer_size(2, GLANCE_TRACE_DUMP_SIZE, GLANCE_LATENCY_SIZE));
+#else
+  events_app_message_request_outbox_size(dict_calc_buffer_size(1, GLANCE_LATENCY_SIZE));
+#endif
+  events_app_message_request_outbox_size(dict_calc_buffer_size(1, GLANCE_RECORD_CHUNK_SIZE));
   s_cfg_event_handle = events_app_message_register_inbox_received(cfg_inbox_received_handler, NULL);
+  s_sent_event_handle = events_app_message_register_outbox_sent(outbox_sent_handler, NULL);
+  s_failed_event_handle = events_app_message_register_outbox_failed(outbox_failed_handler, NULL);
     
   events_app_message_open();
+
+  // Recording left over from the last run goes to the phone first
+  glance_record_load(GLANCE_RECORD_PERSIST_KEY);
+  send_glance_recording(NULL);
 }
 
 static void deinit(void) {
+  // Flushes the glance stats, which are otherwise only saved periodically
+  glancing_service_unsubscribe();
+  glance_trace_save(GLANCE_TRACE_PERSIST_KEY);
+  glance_record_stop();
+  glance_record_save(GLANCE_RECORD_PERSIST_KEY);
   window_destroy(window);
   forecast_io_weather_deinit();
   events_app_message_unsubscribe(s_cfg_event_handle);
+  events_app_message_unsubscribe(s_sent_event_handle);
+  events_app_message_unsubscribe(s_failed_event_handle);
+  if (s_record_retry_timer) {
+    app_timer_cancel(s_record_retry_timer);
+  }
 }
 
 int main(void) {
@@ -0,0 +1,255 @@
+#include <stdarg.h>
+#include <stdlib.h>
+
+#include "pebble.h"
+#include "pebble-events/pebble-events.h"
+
+static AppMessageInboxReceived s_inbox_handler = NULL;
+static AppMessageOutboxSent s_sent_handler = NULL;
+static AppMessageOutboxFailed s_failed_handler = NULL;
+// Registered through pebble-events, only called once events_app_message_open()
+// has put its dispatchers in place of any direct handlers
+static AppMessageOutboxSent s_event_sent_handler = NULL;
+static AppMessageOutboxFailed s_event_failed_handler = NULL;
+static ConnectionHandler s_connection_handler = NULL;
+static bool s_connected = true;
+static bool s_send_fails = false;
+static uint32_t s_messages_sent = 0;
+// Failing sends waiting to be reported, which keep the outbox busy
+static uint32_t s_in_flight = 0;
+static DictionaryIterator s_outbox;
+static uint8_t s_outbox_data[256];
+static size_t s_outbox_used = 0;
+static uint32_t s_inbox_size_maximum = 8200;
+// Largest outbox asked for through pebble-events, 0 until one is
+static uint32_t s_outbox_size = 0;
+
+Tuple *dict_find(const DictionaryIterator *iter, const uint32_t key) {
+  for (uint8_t i = 0; i < iter->count; i++) {
+    if (iter->tuples[i].key == key) {
+      return (Tuple *)&iter->tuples[i];
+    }
+  }
+  return NULL;
+}
+
+// As on the watch: a count byte, then a 7 byte header per tuple
+uint32_t dict_size(DictionaryIterator *iter) {
+  uint32_t size = 1;
+  for (uint8_t i = 0; i < iter->count; i++) {
+    size += 7 + iter->tuples[i].length;
+  }
+  return size;
+}
+
+uint32_t dict_calc_buffer_size(const uint8_t tuple_count, ...) {
+  va_list args;
+  va_start(args, tuple_count);
+  uint32_t size = 1 + 7 * tuple_count;
+  for (uint8_t i = 0; i < tuple_count; i++) {
+    size += va_arg(args, size_t);
+  }
+  va_end(args);
+  return size;
+}
+
+static TupleValue *add_tuple(DictionaryIterator *iter, uint32_t key, uint16_t length) {
+  if (iter->count == STUB_DICT_TUPLES) {
+    fprintf(stderr, "app_message_stub: dictionary full\n");
+    abort();
+  }
+  Tuple *tuple = &iter->tuples[iter->count++];
+  memset(tuple, 0, sizeof(*tuple));
+  tuple->key = key;
+  tuple->length = length;
+  return tuple->value;
+}
+
+void dict_write_uint8(DictionaryIterator *iter, const uint32_t key, const uint8_t value) {
+  add_tuple(iter, key, 1)->uint8 = value;
+}
+
+void dict_write_uint16(DictionaryIterator *iter, const uint32_t key, const uint16_t value) {
+  add_tuple(iter, key, 2)->uint16 = value;
+}
+
+void dict_write_uint32(DictionaryIterator *iter, const uint32_t key, const uint32_t value) {
+  add_tuple(iter, key, 4)->uint32 = value;
+}
+
+void dict_write_int32(DictionaryIterator *iter, const uint32_t key, const int32_t value) {
+  add_tuple(iter, key, 4)->int32 = value;
+}
+
+// Data written to the outbox is copied, as the caller's buffer may go
+void dict_write_data(DictionaryIterator *iter, const uint32_t key, const uint8_t *data, const uint16_t size) {
+  if (s_outbox_used + size > sizeof(s_outbox_data)) {
+    fprintf(stderr, "app_message_stub: outbox full\n");
+    abort();
+  }
+  uint8_t *copy = &s_outbox_data[s_outbox_used];
+  memcpy(copy, data, size);
+  s_outbox_used += size;
+  add_tuple(iter, key, size)->data = copy;
+}
+
+void dict_write_cstring(DictionaryIterator *iter, const uint32_t key, const char *value) {
+  add_tuple(iter, key, strlen(value) + 1)->cstring = (char *)value;
+}
+
+AppMessageResult app_message_outbox_begin(DictionaryIterator **iterator) {
+  if (s_in_flight) {
+    return APP_MSG_BUSY;
+  }
+  memset(&s_outbox, 0, sizeof(s_outbox));
+  s_outbox_used = 0;
+  *iterator = &s_outbox;
+  return APP_MSG_OK;
+}
+
+// The failed message is reported, not whatever was sent since.  Only its
+// keys and inline values are kept, data and strings may have gone.
+static void fail_timer_handler(void *context) {
+  DictionaryIterator *failed = context;
+  s_in_flight--;
+  if (s_failed_handler) {
+    s_failed_handler(failed, APP_MSG_SEND_TIMEOUT, NULL);
+  }
+  free(failed);
+}
+
+// Unless sends are set to fail, every message gets through, and is acked
+// at once
+AppMessageResult app_message_outbox_send(void) {
+  // The watch would have refused to write what didn't fit
+  if (s_outbox_size && (dict_size(&s_outbox) > s_outbox_size)) {
+    fprintf(stderr, "app_message_stub: %u byte message in a %u byte outbox\n", dict_size(&s_outbox), s_outbox_size);
+    abort();
+  }
+  s_messages_sent++;
+  if (s_send_fails || !s_connected) {
+    DictionaryIterator *failed = malloc(sizeof(*failed));
+    *failed = s_outbox;
+    s_in_flight++;
+    app_timer_register(STUB_SEND_FAIL_MS, fail_timer_handler, failed);
+  }
+  else if (s_sent_handler) {
+    s_sent_handler(&s_outbox, NULL);
+  }
+  return APP_MSG_OK;
+}
+
+uint32_t app_message_inbox_size_maximum(void) {
+  return s_inbox_size_maximum;
+}
+
+AppMessageOutboxSent app_message_register_outbox_sent(AppMessageOutboxSent sent_callback) {
+  AppMessageOutboxSent previous = s_sent_handler;
+  s_sent_handler = sent_callback;
+  return previous;
+}
+
+AppMessageOutboxFailed app_message_register_outbox_failed(AppMessageOutboxFailed failed_callback) {
+  AppMessageOutboxFailed previous = s_failed_handler;
+  s_failed_handler = failed_callback;
+  return previous;
+}
+
+bool bluetooth_connection_service_peek(void) {
+  return s_connected;
+}
+
+bool connection_service_peek_pebble_app_connection(void) {
+  return s_connected;
+}
+
+EventHandle events_connection_service_subscribe(ConnectionHandlers conn_handlers) {
+  s_connection_handler = conn_handlers.pebble_app_connection_handler;
+  return &s_connection_handler;
+}
+
+void events_connection_service_unsubscribe(EventHandle handle) {
+  s_connection_handler = NULL;
+}
+
+void events_app_message_request_inbox_size(uint32_t size) {
+}
+
+void events_app_message_request_outbox_size(uint32_t size) {
+  if (size > s_outbox_size) {
+    s_outbox_size = size;
+  }
+}
+
+EventHandle events_app_message_register_inbox_received(AppMessageInboxReceived received_callback, void *context) {
+  s_inbox_handler = received_callback;
+  return &s_inbox_handler;
+}
+
+EventHandle events_app_message_register_outbox_sent(AppMessageOutboxSent sent_callback, void *context) {
+  s_event_sent_handler = sent_callback;
+  return &s_event_sent_handler;
+}
+
+EventHandle events_app_message_register_outbox_failed(AppMessageOutboxFailed failed_callback, void *context) {
+  s_event_failed_handler = failed_callback;
+  return &s_event_failed_handler;
+}
+
+void events_app_message_unsubscribe(EventHandle handle) {
+  if (handle == &s_inbox_handler) {
+    s_inbox_handler = NULL;
+  }
+  else if (handle == &s_event_sent_handler) {
+    s_event_sent_handler = NULL;
+  }
+  else if (handle == &s_event_failed_handler) {
+    s_event_failed_handler = NULL;
+  }
+}
+
+static void dispatch_sent(DictionaryIterator *iterator, void *context) {
+  if (s_event_sent_handler) {
+    s_event_sent_handler(iterator, NULL);
+  }
+}
+
+static void dispatch_failed(DictionaryIterator *iterator, AppMessageResult reason, void *context) {
+  if (s_event_failed_handler) {
+    s_event_failed_handler(iterator, reason, NULL);
+  }
+}
+
+// As on the watch, pebble-events takes the AppMessage callbacks over,
+// replacing any registered directly
+void events_app_message_open(void) {
+  s_sent_handler = dispatch_sent;
+  s_failed_handler = dispatch_failed;
+}
+
+AppMessageInboxReceived stub_inbox_handler(void) {
+  return s_inbox_handler;
+}
+
+DictionaryIterator *stub_last_outbox(void) {
+  return &s_outbox;
+}
+
+uint32_t stub_messages_sent(void) {
+  return s_messages_sent;
+}
+
+void stub_set_send_fails(bool fails) {
+  s_send_fails = fails;
+}
+
+void stub_set_connected(bool connected) {
+  s_connected = connected;
+  if (s_connection_handler) {
+    s_connection_handler(connected);
+  }
+}
+
+void stub_set_inbox_size_maximum(uint32_t size) {
+  s_inbox_size_maximum = size;
+}
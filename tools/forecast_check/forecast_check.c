@@ -0,0 +1,488 @@
+// Replays the AppMessages forecast_sync.js has src/js/app.js send into
+// src/get_weather.c, and checks the watch ends up holding every hour the
+// phone thinks it does, under the version the phone gave it.  Reports the
+// messages and bytes each sync took, and the persist writes it cost.
+//
+// First it checks fetches are retried with backoff, given up on, and
+// held while the phone is away, and that a restart starts from the stored
+// forecast without fetching it again.
+//
+//   node forecast_sync.js | ./forecast_check
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pebble.h"
+#include "pebble-events/pebble-events.h"
+#include "../glance_replay/sim.h"
+#include "get_weather.h"
+
+#define INBOX_SIZE 512
+// A key of the watchface's own, as GlanceRecord is
+#define OTHER_KEY 100
+
+static const struct { const char *name; uint32_t key; } KEYS[] = {
+  { "FIOW_REPLY", MESSAGE_KEY_FIOW_REPLY },
+  { "FIOW_NAME", MESSAGE_KEY_FIOW_NAME },
+  { "FIOW_DATA", MESSAGE_KEY_FIOW_DATA },
+  { "FIOW_PATCH", MESSAGE_KEY_FIOW_PATCH },
+  { "FIOW_VERSION", MESSAGE_KEY_FIOW_VERSION },
+  { "FIOW_PACKED", MESSAGE_KEY_FIOW_PACKED },
+  { "FIOW_SEQ", MESSAGE_KEY_FIOW_SEQ },
+};
+
+typedef struct Sync {
+  char label[32];
+  int max_messages;
+  int messages;
+  uint32_t bytes;
+  uint32_t largest;
+  int max_writes;
+  uint32_t writes_before;
+} Sync;
+
+static uint32_t s_failures = 0;
+
+static ForecastIOWeatherStatus s_status;
+static char s_name[FORECASTIO_WEATHER_BUFFER_SIZE];
+
+static void weather_callback(ForecastIOWeatherInfo *info, ForecastIOWeatherStatus status) {
+  s_status = status;
+  snprintf(s_name, sizeof(s_name), "%s", info->name);
+}
+
+static void restart(void) {
+  forecast_io_weather_deinit();
+  stub_set_inbox_size_maximum(INBOX_SIZE);
+  forecast_io_weather_init(weather_callback);
+  // As main.c does, after the library has registered its handlers
+  events_app_message_open();
+}
+
+static int hex_value(char c) {
+  return (c <= '9') ? c - '0' : c - 'a' + 10;
+}
+
+// Build the dictionary the watch would receive and hand it to the library
+static void deliver(char *fields, Sync *sync, uint8_t buffers[][INBOX_SIZE]) {
+  DictionaryIterator iter = { .count = 0 };
+  for (char *field = strtok(fields, " "); field; field = strtok(NULL, " ")) {
+    char *value = strchr(field, '=');
+    *value++ = '\0';
+    uint32_t key = 0;
+    for (size_t k = 0; k < sizeof(KEYS) / sizeof(KEYS[0]); k++) {
+      if (strcmp(KEYS[k].name, field) == 0) {
+        key = KEYS[k].key;
+      }
+    }
+    if (!key) {
+      printf("  unknown key %s\n", field);
+      s_failures++;
+      continue;
+    }
+
+    Tuple *tuple = &iter.tuples[iter.count];
+    memset(tuple, 0, sizeof(*tuple));
+    tuple->key = key;
+    if (strncmp(value, "s:", 2) == 0) {
+      tuple->length = strlen(value + 2) + 1;
+      tuple->value->cstring = value + 2;
+    }
+    else if (strncmp(value, "x:", 2) == 0) {
+      value += 2;
+      uint8_t *bytes = buffers[iter.count];
+      tuple->length = strlen(value) / 2;
+      if (tuple->length > INBOX_SIZE) {
+        printf("  %s: %s of %u bytes doesn't fit the inbox\n", sync->label, field, tuple->length);
+        s_failures++;
+        return;
+      }
+      for (int i = 0; i < tuple->length; i++) {
+        bytes[i] = hex_value(value[2 * i]) << 4 | hex_value(value[2 * i + 1]);
+      }
+      tuple->value->data = bytes;
+    }
+    else {
+      // PebbleKit JS sends numbers as int32
+      tuple->length = 4;
+      tuple->value->uint32 = strtoul(value, NULL, 10);
+      tuple->value->int32 = tuple->value->uint32;
+    }
+    iter.count++;
+  }
+
+  const uint32_t size = dict_size(&iter);
+  if (size > INBOX_SIZE) {
+    printf("  %s: message of %u bytes doesn't fit the inbox\n", sync->label, size);
+    s_failures++;
+  }
+  sync->messages++;
+  sync->bytes += size;
+  if (size > sync->largest) {
+    sync->largest = size;
+  }
+  stub_inbox_handler()(&iter, NULL);
+}
+
+static void check_hour(char *line) {
+  long t;
+  int b[5];
+  if (sscanf(line, "%ld %d %d %d %d %d", &t, &b[0], &b[1], &b[2], &b[3], &b[4]) != 6) {
+    printf("  bad line: HOUR %s\n", line);
+    s_failures++;
+    return;
+  }
+
+  ForecastIOWeatherHour hour;
+  if (!forecast_io_weather_forecast_at(t, &hour)) {
+    printf("  hour %ld missing\n", t);
+    s_failures++;
+    return;
+  }
+  const int temperature = (b[2] == 0) ? FORECASTIO_WEATHER_NO_TEMPERATURE : b[2] - 50;
+  if ((hour.time != t) || (hour.precip_mm != b[0]) || (hour.precip_probability != b[1]) ||
+      (hour.temperature_c != temperature) || (hour.wind_bearing != b[3] % 16) ||
+      (hour.wind_beaufort != b[3] / 16) || (hour.cloud_cover != b[4])) {
+    printf("  hour %ld: %d %d %d %d/%d %d, phone sent %d %d %d %d %d\n", t, hour.precip_mm,
+           hour.precip_probability, hour.temperature_c, hour.wind_beaufort, hour.wind_bearing,
+           hour.cloud_cover, b[0], b[1], b[2], b[3], b[4]);
+    s_failures++;
+  }
+}
+
+// The run of hours comes back in one piece, wherever its days are in the ring
+static void check_range(char *line) {
+  long t;
+  int hours;
+  if (sscanf(line, "%ld %d", &t, &hours) != 2) {
+    printf("  bad line: RANGE %s\n", line);
+    s_failures++;
+    return;
+  }
+
+  ForecastIOWeatherRange range;
+  if (!forecast_io_weather_forecast_range(t, hours, &range) || (range.start != t) || (range.count != hours)) {
+    printf("  range from %ld has %d hours, %d expected\n", t, range.count, hours);
+    s_failures++;
+    return;
+  }
+  for (int i = 0; i < range.count; i++) {
+    ForecastIOWeatherHour hour;
+    forecast_io_weather_forecast_at(t + i * SECONDS_PER_HOUR, &hour);
+    if ((range.temperature_c[i] != hour.temperature_c) || (range.precip_mm[i] != hour.precip_mm) ||
+        (range.precip_probability[i] != hour.precip_probability) || (range.wind_bearing[i] != hour.wind_bearing) ||
+        (range.wind_beaufort[i] != hour.wind_beaufort) || (range.cloud_cover[i] != hour.cloud_cover)) {
+      printf("  range from %ld differs from hour %ld\n", t, t + i * SECONDS_PER_HOUR);
+      s_failures++;
+      return;
+    }
+  }
+}
+
+static void check_version(uint32_t expected) {
+  // The version goes back to the phone with the next request
+  forecast_io_weather_fetch();
+  Tuple *version = dict_find(stub_last_outbox(), MESSAGE_KEY_FIOW_VERSION);
+  if (!version || version->value->uint32 != expected) {
+    printf("  watch has version %u, phone sent %u\n", version ? version->value->uint32 : 0, expected);
+    s_failures++;
+  }
+}
+
+static void check_gaps(uint32_t version, uint32_t expected) {
+  // The watch asks for them again once it has given up waiting
+  sim_advance_to(sim_now() + FORECASTIO_WEATHER_GAP_TIMEOUT_MS);
+  sim_fire_due_timers();
+  Tuple *missing = dict_find(stub_last_outbox(), MESSAGE_KEY_FIOW_MISSING);
+  const uint8_t *b = missing ? missing->value->data : NULL;
+  if (!missing || missing->length != 8 ||
+      (b[0] | b[1] << 8 | b[2] << 16 | (uint32_t)b[3] << 24) != version ||
+      (b[4] | b[5] << 8 | b[6] << 16 | (uint32_t)b[7] << 24) != expected) {
+    printf("  watch didn't ask for messages %08x of sync %u\n", expected, version);
+    s_failures++;
+  }
+}
+
+// Run the timers due in the next ms
+static void run_for(uint64_t ms) {
+  const uint64_t end = sim_now() + ms;
+  while (sim_next_timer_deadline() <= end) {
+    sim_advance_to(sim_next_timer_deadline());
+    sim_fire_due_timers();
+  }
+  sim_advance_to(end);
+}
+
+static void expect_sends(const char *what, uint32_t since, uint32_t expected) {
+  const uint32_t sends = stub_messages_sent() - since;
+  if (sends != expected) {
+    printf("  %s sent %u messages, %u expected\n", what, sends, expected);
+    s_failures++;
+  }
+}
+
+// The longest the first try and every retry can take, unanswered
+static uint64_t retries_ms(void) {
+  uint64_t longest_ms = 0;
+  for (int attempt = 0; attempt < FORECASTIO_WEATHER_RETRY_MAX_ATTEMPTS; attempt++) {
+    const uint64_t delay_ms = (uint64_t)FORECASTIO_WEATHER_RETRY_BASE_MS << attempt;
+    longest_ms += STUB_SEND_FAIL_MS + (delay_ms < FORECASTIO_WEATHER_RETRY_MAX_MS ? delay_ms : FORECASTIO_WEATHER_RETRY_MAX_MS);
+  }
+  return longest_ms;
+}
+
+static void check_retries(void) {
+  ForecastIOWeatherStats stats;
+  restart();
+
+  // The phone never answers: the first try and every retry, within the
+  // time the backoff allows, then nothing until the next update
+  const uint64_t longest_ms = retries_ms();
+  stub_set_send_fails(true);
+  uint32_t before = stub_messages_sent();
+  forecast_io_weather_fetch();
+  run_for(longest_ms);
+  expect_sends("unanswered fetch", before, 1 + FORECASTIO_WEATHER_RETRY_MAX_ATTEMPTS);
+  before = stub_messages_sent();
+  run_for(10 * 60 * 1000);
+  expect_sends("given up fetch", before, 0);
+  forecast_io_weather_get_stats(&stats);
+  if ((stats.retries != FORECASTIO_WEATHER_RETRY_MAX_ATTEMPTS) || (stats.retry_give_ups != 1)) {
+    printf("  retry: %u retries and %u give ups, %d and 1 expected\n", stats.retries, stats.retry_give_ups,
+           FORECASTIO_WEATHER_RETRY_MAX_ATTEMPTS);
+    s_failures++;
+  }
+  const uint32_t retries = stats.retries;
+
+  // The phone goes while a retry is waiting: nothing more until it's back,
+  // then one fetch that gets through
+  restart();
+  before = stub_messages_sent();
+  forecast_io_weather_fetch();
+  run_for(STUB_SEND_FAIL_MS);
+  stub_set_connected(false);
+  run_for(10 * 60 * 1000);
+  expect_sends("fetch while disconnected", before, 1);
+  stub_set_send_fails(false);
+  stub_set_connected(true);
+  run_for(10 * 60 * 1000);
+  expect_sends("fetch on reconnection", before, 2);
+
+  // And a fetch asked for while the phone is away waits for it
+  stub_set_connected(false);
+  before = stub_messages_sent();
+  forecast_io_weather_fetch();
+  run_for(10 * 60 * 1000);
+  stub_set_connected(true);
+  expect_sends("fetch made disconnected", before, 1);
+
+  printf("retry: %u retries then gave up, held while disconnected\n", retries);
+}
+
+// A message of the watchface's own, through the same outbox if it's free
+static bool send_other(void) {
+  DictionaryIterator *out;
+  if (app_message_outbox_begin(&out) != APP_MSG_OK) {
+    return false;
+  }
+  dict_write_uint8(out, OTHER_KEY, 1);
+  app_message_outbox_send();
+  return true;
+}
+
+static void check_other_sends(void) {
+  ForecastIOWeatherStats before, after;
+  restart();
+
+  // Another message failing doesn't fail the weather, or fetch it again
+  forecast_io_weather_get_stats(&before);
+  const ForecastIOWeatherStatus status = s_status;
+  stub_set_send_fails(true);
+  send_other();
+  stub_set_send_fails(false);
+  run_for(STUB_SEND_FAIL_MS);
+  forecast_io_weather_get_stats(&after);
+  if ((s_status != status) || (after.retries != before.retries)) {
+    printf("  other failed send: status %d, was %d, and %u retries\n", s_status, status,
+           after.retries - before.retries);
+    s_failures++;
+  }
+
+  // Nor does one getting through count as the phone answering a fetch,
+  // which is still given up on in time
+  forecast_io_weather_get_stats(&before);
+  stub_set_send_fails(true);
+  forecast_io_weather_fetch();
+  const uint64_t end = sim_now() + retries_ms();
+  while (sim_now() < end) {
+    run_for(STUB_SEND_FAIL_MS / 2);
+    stub_set_send_fails(false);
+    send_other();
+    stub_set_send_fails(true);
+  }
+  stub_set_send_fails(false);
+  forecast_io_weather_get_stats(&after);
+  if ((after.retries - before.retries != FORECASTIO_WEATHER_RETRY_MAX_ATTEMPTS) ||
+      (after.retry_give_ups - before.retry_give_ups != 1)) {
+    printf("  other sends: %u retries and %u give ups, %d and 1 expected\n", after.retries - before.retries,
+           after.retry_give_ups - before.retry_give_ups, FORECASTIO_WEATHER_RETRY_MAX_ATTEMPTS);
+    s_failures++;
+  }
+
+  // A fetch finding the outbox busy waits for it, rather than failing
+  forecast_io_weather_get_stats(&before);
+  const uint32_t sent_before = stub_messages_sent();
+  const ForecastIOWeatherStatus waiting_status = s_status;
+  stub_set_send_fails(true);
+  send_other();
+  stub_set_send_fails(false);
+  forecast_io_weather_fetch();
+  if ((s_status != waiting_status) || !forecast_io_weather_fetch_waiting()) {
+    printf("  fetch behind another send: status %d, %swaiting\n", s_status,
+           forecast_io_weather_fetch_waiting() ? "" : "not ");
+    s_failures++;
+  }
+  run_for(STUB_SEND_FAIL_MS);
+  forecast_io_weather_get_stats(&after);
+  expect_sends("fetch behind another send", sent_before, 2);
+  if ((s_status != ForecastIOWeatherStatusPending) || (after.retries != before.retries) ||
+      (dict_find(stub_last_outbox(), MESSAGE_KEY_FIOW_REQUEST) == NULL)) {
+    printf("  fetch behind another send: status %d and %u retries\n", s_status, after.retries - before.retries);
+    s_failures++;
+  }
+
+  printf("other sends: their acks and failures left to them, a busy outbox waited for\n");
+}
+
+static void deliver_tuples(DictionaryIterator *iter) {
+  stub_inbox_handler()(iter, NULL);
+}
+
+static void check_warm_start(void) {
+  restart();
+  DictionaryIterator reply = { .count = 2 };
+  reply.tuples[0] = (Tuple){ .key = MESSAGE_KEY_FIOW_REPLY, .length = 4 };
+  reply.tuples[0].value->uint32 = 1;
+  reply.tuples[1] = (Tuple){ .key = MESSAGE_KEY_FIOW_NAME, .length = 10 };
+  reply.tuples[1].value->cstring = "Testville";
+  deliver_tuples(&reply);
+
+  // The name alone doesn't make the forecast fresh, it could have come
+  // ahead of a forecast that never arrived
+  DictionaryIterator ready = { .count = 1 };
+  ready.tuples[0] = (Tuple){ .key = MESSAGE_KEY_JSReady, .length = 4 };
+  restart();
+  uint32_t before = stub_messages_sent();
+  deliver_tuples(&ready);
+  expect_sends("name without a forecast", before, 1);
+
+  // The phone saying nothing has changed does
+  reply.tuples[1] = (Tuple){ .key = MESSAGE_KEY_FIOW_VERSION, .length = 4 };
+  reply.tuples[1].value->uint32 = 0;
+  deliver_tuples(&reply);
+
+  // Available from the start, and PebbleKit JS starting doesn't fetch
+  s_status = ForecastIOWeatherStatusNotYetFetched;
+  s_name[0] = '\0';
+  restart();
+  if ((s_status != ForecastIOWeatherStatusAvailable) || (strcmp(s_name, "Testville") != 0)) {
+    printf("  warm start: status %d, name \"%s\"\n", s_status, s_name);
+    s_failures++;
+  }
+  before = stub_messages_sent();
+  deliver_tuples(&ready);
+  expect_sends("warm start", before, 0);
+
+  // Until the forecast is older than the update frequency
+  before = stub_messages_sent();
+  forecast_io_weather_set_update_frequency(0);
+  expect_sends("stale forecast", before, 1);
+  forecast_io_weather_set_update_frequency(30);
+
+  // The frequency it was fetched under comes back with it
+  forecast_io_weather_set_update_frequency(240);
+  restart();
+  if (forecast_io_weather_get_update_frequency() != 240) {
+    printf("  warm start: update frequency %u, 240 expected\n", forecast_io_weather_get_update_frequency());
+    s_failures++;
+  }
+  forecast_io_weather_set_update_frequency(30);
+
+  printf("warm start: name, status and update frequency restored, no fetch while fresh\n");
+}
+
+static void report(const Sync *sync) {
+  if (!sync->label[0]) {
+    return;
+  }
+  const uint32_t writes = sim_counters()->persist_writes - sync->writes_before;
+  printf("%-20s %8d %8u %8u %8u\n", sync->label, sync->messages, sync->bytes, sync->largest, writes);
+  if (sync->max_messages && sync->messages > sync->max_messages) {
+    printf("  %s took %d messages, at most %d expected\n", sync->label, sync->messages, sync->max_messages);
+    s_failures++;
+  }
+  if ((sync->max_writes >= 0) && (writes > (uint32_t)sync->max_writes)) {
+    printf("  %s took %u persist writes, at most %d expected\n", sync->label, writes, sync->max_writes);
+    s_failures++;
+  }
+}
+
+int main(void) {
+  static char line[8192];
+  static uint8_t buffers[STUB_DICT_TUPLES][INBOX_SIZE];
+  Sync sync = { .label = "" };
+  uint32_t hours = 0;
+
+  check_retries();
+  check_other_sends();
+  check_warm_start();
+  printf("%-20s %8s %8s %8s %8s\n", "sync", "messages", "bytes", "largest", "writes");
+  while (fgets(line, sizeof(line), stdin)) {
+    line[strcspn(line, "\n")] = '\0';
+    if (strcmp(line, "RESTART") == 0) {
+      restart();
+      // So requests, the gap checks' included, are as large as they get
+      forecast_io_weather_set_api_key("0123456789abcdef0123456789abcdef");
+      forecast_io_weather_set_location((ForecastIOWeatherCoordinates) { .latitude = -4212345, .longitude = -1235478 });
+    }
+    else if (strncmp(line, "SYNC ", 5) == 0) {
+      report(&sync);
+      memset(&sync, 0, sizeof(sync));
+      sync.max_writes = -1;
+      sync.writes_before = sim_counters()->persist_writes;
+      sscanf(line + 5, "%31s %d %d", sync.label, &sync.max_messages, &sync.max_writes);
+    }
+    else if (strncmp(line, "MSG ", 4) == 0) {
+      deliver(line + 4, &sync, buffers);
+    }
+    else if (strncmp(line, "HOUR ", 5) == 0) {
+      check_hour(line + 5);
+      hours++;
+    }
+    else if (strncmp(line, "RANGE ", 6) == 0) {
+      check_range(line + 6);
+    }
+    else if (strncmp(line, "GAPS ", 5) == 0) {
+      uint32_t version, missing;
+      sscanf(line + 5, "%u %x", &version, &missing);
+      check_gaps(version, missing);
+    }
+    else if (strncmp(line, "FAIL ", 5) == 0) {
+      printf("  %s\n", line + 5);
+      s_failures++;
+    }
+    else if (strncmp(line, "VERSION ", 8) == 0) {
+      check_version(strtoul(line + 8, NULL, 10));
+    }
+  }
+  report(&sync);
+  forecast_io_weather_deinit();
+
+  if (hours == 0) {
+    printf("forecast_check: no input, run as node forecast_sync.js | ./forecast_check\n");
+    return 1;
+  }
+  printf("forecast_check: %u hours checked, %u failures\n", hours, s_failures);
+  return s_failures ? 1 : 0;
+}
@@ -0,0 +1,399 @@
+// Drives the forecast sync in src/js/app.js over synthetic forecasts and
+// prints the AppMessages it sends, and what the watch should then hold,
+// for forecast_check to replay into src/get_weather.c:
+//
+//   SYNC <label> <most messages allowed, 0 for any> [<most persist writes>]
+//   MSG <key>=<number, x:hex bytes or s:string> ...
+//   RESTART                                 watchface restarted
+//   GAPS <version> <hex mask>               watch should ask for these again
+//   HOUR <epoch time> <5 bytes>             expected hour
+//   RANGE <epoch time> <hours>              expected run of consecutive hours
+//   VERSION <n>                             expected forecast version
+//   FAIL <reason>                           a check made here failed
+
+var fs = require('fs');
+var vm = require('vm');
+var path = require('path');
+
+var storage = {};
+var sent = [];
+
+// Acks, nacks and backoffs run in order from here, as the radio and timers
+// would
+var pending = [];
+var drain = function() {
+  while (pending.length) {
+    pending.shift()();
+  }
+};
+
+// What becomes of a send: 'ack', 'lost' (nacked, never arrives) or 'dup'
+// (arrives, but the ack is lost, so it is sent again)
+var fate = function(message, attempt) {
+  return 'ack';
+};
+var sandbox = {
+  console: { log: function() {} },
+  localStorage: {
+    getItem: function(key) { return key in storage ? storage[key] : null; },
+    setItem: function(key, value) { storage[key] = String(value); },
+    removeItem: function(key) { delete storage[key]; }
+  },
+  Pebble: {
+    addEventListener: function() {},
+    sendAppMessage: function(message, ack, nack) {
+      var outcome = fate(message, message._attempts = (message._attempts || 0) + 1);
+      pending.push(function() {
+        if (outcome != 'lost') {
+          sent.push(message);
+        }
+        if (outcome == 'ack') {
+          ack && ack();
+        } else {
+          nack && nack();
+        }
+      });
+    }
+  },
+  setTimeout: function(callback, ms) {
+    pending.push(callback);
+  },
+  navigator: {},
+  XMLHttpRequest: function() {},
+  // Clay and the config page aren't needed here
+  require: function() {
+    return function() {};
+  }
+};
+vm.createContext(sandbox);
+vm.runInContext(fs.readFileSync(path.join(__dirname, '../../src/js/app.js'), 'utf8'), sandbox);
+var weather = sandbox.weather;
+
+// The same hour always gets the same weather, so only the hours a test
+// changes differ from one sync to the next
+var seed = 0;
+var random = function() {
+  seed = (seed * 1103515245 + 12345) % 2147483648;
+  return seed / 2147483648;
+};
+
+var START = 1467068400;
+
+var SCENARIOS = {
+  dry: function(hour, t) {
+    return { temperature: 12 + 6 * Math.sin(2 * Math.PI * (hour % 24) / 24), precipIntensity: 0,
+             precipProbability: hour % 30 < 3 ? 0.05 : 0, windSpeed: 3 + (Math.floor(hour / 6) % 3),
+             windBearing: 45 * (Math.floor(hour / 12) % 8), cloudCover: 0.1 * (Math.floor(hour / 8) % 4) };
+  },
+  wet: function(hour, t) {
+    var raining = (hour % 24) > 14 || (hour > 80 && hour < 100);
+    return { temperature: 8 + 3 * Math.sin(2 * Math.PI * (hour % 24) / 24),
+             precipIntensity: raining ? 0.3 + 20 * random() : 0,
+             precipProbability: raining ? 0.4 + 0.6 * random() : 0,
+             windSpeed: 6 + 10 * random(), windBearing: 200 + 40 * random(), cloudCover: raining ? 1 : 0.6 };
+  },
+  wild: function(hour, t) {
+    if (hour % 37 == 5 || hour % 41 == 7) {
+      return null;    // Missing from the feed
+    }
+    return { temperature: (hour % 9 == 0) ? -45 : (hour % 13 == 0 ? 48 : 10 * random()),
+             precipIntensity: (hour % 5 == 0) ? 300 : 0, precipProbability: (hour % 5 == 0) ? 1 : 0,
+             windSpeed: 40, windBearing: 359, cloudCover: random() };
+  },
+  noise: function(hour, t) {
+    return { temperature: 60 * random() - 20, precipIntensity: 30 * random(), precipProbability: random(),
+             windSpeed: 35 * random(), windBearing: 360 * random(), cloudCover: random() };
+  }
+};
+
+// The hours app.js makes of a forecast from start, in the form
+// _getWeatherF_IO passes them on
+var forecast = function(scenario, start, change) {
+  var hours = {};
+  for (var hour = 0; hour < 168; hour++) {
+    var t = start + hour * 3600;
+    seed = Math.floor((t - START) / 3600) + 1;
+    var fields = SCENARIOS[scenario](Math.floor((t - START) / 3600), t);
+    if (!fields) {
+      continue;
+    }
+    if (change && hour >= change.from && hour < change.to) {
+      fields.temperature += 3;
+    }
+    fields.time = t;
+    hours[t] = weather._encodeHour(fields);
+  }
+  return hours;
+};
+
+var hex = function(bytes) {
+  return bytes.map(function(b) { return (b < 16 ? '0' : '') + b.toString(16); }).join('');
+};
+
+var printSent = function() {
+  sent.forEach(function(message) {
+    var fields = Object.keys(message).filter(function(key) {
+      return key[0] != '_';
+    }).map(function(key) {
+      var value = message[key];
+      return key + '=' + (Array.isArray(value) ? 'x:' + hex(value) : typeof value == 'string' ? 's:' + value : value);
+    });
+    console.log('MSG ' + fields.join(' '));
+  });
+  sent = [];
+};
+
+var sync = function(label, maxMessages, inbox, start, hours, maxWrites) {
+  sent = [];
+  weather._watchInbox = inbox;
+  weather._syncForecast(start, hours);
+  drain();
+  console.log('SYNC ' + label + ' ' + maxMessages + (maxWrites === undefined ? '' : ' ' + maxWrites));
+  printSent();
+};
+
+var expect = function() {
+  var held = JSON.parse(storage[weather._syncKey]);
+  held.days.forEach(function(day) {
+    if (!day) {
+      return;
+    }
+    for (var hour = 0; hour < 24; hour++) {
+      console.log('HOUR ' + (day.time + hour * 3600) + ' ' + day.bytes.slice(5 * hour, 5 * hour + 5).join(' '));
+    }
+  });
+  // The days from the earliest on, however they lie in the ring
+  var times = held.days.filter(function(day) {
+    return day;
+  }).map(function(day) {
+    return day.time;
+  }).sort(function(a, b) {
+    return a - b;
+  });
+  var days = 1;
+  while (days < times.length && times[days] == times[0] + days * 86400) {
+    days++;
+  }
+  console.log('RANGE ' + times[0] + ' ' + 24 * days);
+  console.log('VERSION ' + held.version);
+};
+
+var runs = [['dry', 512, 2], ['wet', 512, 2], ['wild', 512, 2], ['noise', 512, 0], ['dry', 0, 0]];
+runs.forEach(function(run) {
+  var scenario = run[0];
+  var inbox = run[1];
+  var label = scenario + (inbox ? '' : '-unpacked');
+  storage = {};
+  weather._watchVersion = 0;
+  console.log('RESTART');
+
+  // A week, then an hour later with three hours changed, then two days
+  // later after a restart
+  sync(label + '-week', run[2], inbox, START, forecast(scenario, START));
+  sync(label + '-hour', run[2] ? 1 : 0, inbox, START + 3600, forecast(scenario, START + 3600, { from: 50, to: 53 }));
+  expect();
+  console.log('RESTART');
+  sync(label + '-2days', run[2], inbox, START + 50 * 3600, forecast(scenario, START + 50 * 3600));
+  expect();
+});
+
+// The phone forgets what it sent, so sends the whole week again: the watch
+// already has every day, and should only write the header with the new
+// version
+storage = {};
+weather._watchVersion = 0;
+console.log('RESTART');
+sync('resent-week', 2, 512, START, forecast('wet', START));
+storage = {};
+weather._watchVersion = 0;
+sync('resent-same', 2, 512, START, forecast('wet', START), 1);
+expect();
+
+// Patches for two days, but the watch no longer holds the first of them:
+// the sync mustn't leave it with the phone's version, so the next sync
+// sends the whole week
+storage = {};
+weather._watchVersion = 0;
+console.log('RESTART');
+sync('rejected-week', 0, 0, START, forecast('dry', START));
+sent = [];
+weather._watchInbox = 0;
+weather._syncForecast(START + 3600, forecast('dry', START + 3600, { from: 20, to: 26 }));
+drain();
+console.log('SYNC rejected-patch 2');
+var patches = sent.filter(function(message) {
+  return 'FIOW_PATCH' in message;
+});
+if (patches.length != 2) {
+  console.log('FAIL rejected-patch sent ' + patches.length + ' patches, 2 expected');
+}
+// Not the day the watch holds in that slot
+patches[0]['FIOW_PATCH'][2] ^= 0x01;
+printSent();
+console.log('VERSION 0');
+weather._watchVersion = 0;
+sync('rejected-resent', 0, 0, START + 3600, forecast('dry', START + 3600, { from: 20, to: 26 }));
+expect();
+
+// A week in small messages over a poor link: the second is lost once, the
+// third arrives twice, and the fourth never gets through, until the watch
+// asks for it again
+storage = {};
+weather._watchVersion = 0;
+console.log('RESTART');
+fate = function(message, attempt) {
+  var index = message['FIOW_SEQ'] & 0xff;
+  if (message._resend) {
+    return 'ack';
+  }
+  return (index == 1 && attempt == 1) ? 'lost' : (index == 2 && attempt == 1) ? 'dup' : (index == 3) ? 'lost' : 'ack';
+};
+sync('lossy-week', 0, 200, START, forecast('wet', START));
+var lost = weather._pending;
+console.log('GAPS ' + lost.sync.version + ' ' + (1 << 3).toString(16));
+lost.messages.forEach(function(message) {
+  message._resend = true;
+});
+weather.appMessageHandler({ payload: { 'FIOW_REQUEST': 1, 'FIOW_MISSING': [
+  lost.sync.version & 0xff, (lost.sync.version >>> 8) & 0xff, (lost.sync.version >>> 16) & 0xff, lost.sync.version >>> 24,
+  8, 0, 0, 0] } });
+drain();
+console.log('SYNC lossy-resend 1');
+printSent();
+expect();
+
+// Fetches at home, at the office, then back home: the last comes from the
+// phone's cache without asking forecast.io, and sends the watch only what
+// differs from the office forecast it holds.  The requests go to a stub
+// server, which can be set to fail.
+var requests = 0;
+var geocodes = 0;
+// Requests to URLs containing this fail
+var failing = null;
+var stubServer = function(url, type, callback) {
+  var query = url.split('/').pop().split('?')[0].split(',');
+  var response;
+  if (failing && url.indexOf(failing) >= 0) {
+    callback({ status: 503, response: '' });
+    return;
+  }
+  if (url.indexOf('stub-forecast') >= 0) {
+    requests++;
+    var scenario = parseFloat(query[0]) > 52 ? 'wet' : 'dry';
+    var data = [];
+    for (var hour = 0; hour < 168; hour++) {
+      var t = START + hour * 3600;
+      seed = hour + 1;
+      var fields = SCENARIOS[scenario](hour, t);
+      fields.time = t;
+      data.push(fields);
+    }
+    response = { hourly: { data: data } };
+  } else {
+    geocodes++;
+    response = { address: { town: url.indexOf('lat=52.2') >= 0 ? 'Home' : 'Office' } };
+  }
+  callback({ status: 200, response: JSON.stringify(response) });
+};
+weather = new sandbox.ForecastIoWeather({
+  xhr: stubServer, forecastUrl: 'http://localhost/stub-forecast/', geocodeUrl: 'http://localhost/stub-geocode'
+});
+
+// As if the phone's caches had been filled ms earlier
+var ageCaches = function(ms) {
+  var locations = JSON.parse(storage[weather._locationsKey]);
+  locations.forEach(function(location) {
+    location.fetched -= ms;
+  });
+  storage[weather._locationsKey] = JSON.stringify(locations);
+  var http = JSON.parse(storage[weather._httpCacheKey]);
+  Object.keys(http).forEach(function(key) {
+    http[key].time -= ms;
+  });
+  storage[weather._httpCacheKey] = JSON.stringify(http);
+};
+
+var fetchAt = function(label, latitude, longitude, expectRequests, expectGeocodes, expectName) {
+  sent = [];
+  weather.appMessageHandler({ payload: { 'FIOW_REQUEST': 1, 'FIOW_VERSION': weather._watchVersion, 'FIOW_INBOX': 512,
+                                         'FIOW_MAXAGE': 1800, 'FIOW_LATITUDE': Math.round(latitude * 100000),
+                                         'FIOW_LONGITUDE': Math.round(longitude * 100000) } });
+  drain();
+  var named = sent.filter(function(message) {
+    return 'FIOW_NAME' in message;
+  });
+  var firstSent = sent[0];
+  console.log('SYNC ' + label + ' 2');
+  printSent();
+  expect();
+  if (requests != expectRequests || geocodes != expectGeocodes) {
+    console.log('FAIL ' + label + ' made ' + requests + ' forecast and ' + geocodes + ' geocode requests, ' +
+                expectRequests + ' and ' + expectGeocodes + ' expected');
+  }
+  if (!named.length || named[0]['FIOW_NAME'] != expectName) {
+    console.log('FAIL ' + label + ' named ' + (named.length ? named[0]['FIOW_NAME'] : 'nowhere') + ', not ' + expectName);
+  }
+  // Ahead of the forecast, so the watch shows it as available sooner
+  if (named.length && firstSent !== named[0]) {
+    console.log('FAIL ' + label + ' sent the name after the forecast');
+  }
+};
+storage = {};
+fate = function() {
+  return 'ack';
+};
+weather._watchVersion = 0;
+console.log('RESTART');
+fetchAt('locations-home', 52.2053, 0.1218, 1, 1, 'Home');
+fetchAt('locations-office', 51.5072, -0.1276, 2, 2, 'Office');
+fetchAt('locations-home-again', 52.2071, 0.1195, 2, 2, 'Home');
+
+// An hour on the forecast is stale, but the name isn't
+ageCaches(3600 * 1000);
+fetchAt('geocode-cached', 52.2053, 0.1218, 3, 2, 'Home');
+
+// A week on the name is stale too, but if nominatim is down the old one
+// does
+ageCaches(8 * 24 * 3600 * 1000);
+failing = 'stub-geocode';
+fetchAt('geocode-stale', 51.5072, -0.1276, 4, 2, 'Office');
+
+// The queue gives up on a sync whose first message never gets through,
+// and the watch's scheduled refresh, long after, still has its gaps: that
+// gets a new forecast, not the rest of the old one
+failing = null;
+fate = function(message, attempt) {
+  return ('FIOW_SEQ' in message && (message['FIOW_SEQ'] & 0xff) == 0) ? 'lost' : 'ack';
+};
+requests = 0;
+geocodes = 0;
+sent = [];
+weather.appMessageHandler({ payload: { 'FIOW_REQUEST': 1, 'FIOW_VERSION': weather._watchVersion, 'FIOW_INBOX': 200,
+                                       'FIOW_MAXAGE': 1800, 'FIOW_LATITUDE': 5220530, 'FIOW_LONGITUDE': 12180 } });
+drain();
+console.log('SYNC queue-gave-up 0');
+printSent();
+var abandoned = weather._pending;
+if (!abandoned) {
+  console.log('FAIL queue-gave-up left no sync to answer the gaps from');
+} else {
+  abandoned.sent -= 30 * 60 * 1000;
+  var version = abandoned.sync.version;
+  fate = function() {
+    return 'ack';
+  };
+  weather.appMessageHandler({ payload: { 'FIOW_REQUEST': 1, 'FIOW_VERSION': weather._watchVersion, 'FIOW_INBOX': 512,
+                                         'FIOW_MAXAGE': 1800, 'FIOW_LATITUDE': 5220530, 'FIOW_LONGITUDE': 12180,
+                                         'FIOW_MISSING': [version & 0xff, (version >>> 8) & 0xff, (version >>> 16) & 0xff,
+                                                          version >>> 24, 1, 0, 0, 0] } });
+  drain();
+  var resent = sent.filter(function(message) {
+    return message['FIOW_VERSION'] == version;
+  });
+  console.log('SYNC refresh-after-give-up 2');
+  if (resent.length) {
+    console.log('FAIL refresh-after-give-up resent ' + resent.length + ' messages of the abandoned sync');
+  }
+  printSent();
+  expect();
+}
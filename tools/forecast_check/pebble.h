@@ -0,0 +1,105 @@
+#pragma once
+
+// The stub pebble.h from tools/glance_replay, plus enough of AppMessage
+// and the dictionary API to build src/get_weather.c on a Linux host.
+
+#include "../glance_replay/pebble.h"
+
+#define SECONDS_PER_MINUTE 60
+#define SECONDS_PER_HOUR 3600
+#define SECONDS_PER_DAY 86400
+
+typedef enum {
+  APP_MSG_OK = 0,
+  APP_MSG_SEND_TIMEOUT = 2,
+  APP_MSG_BUSY = 64,
+} AppMessageResult;
+
+typedef struct TupleValue {
+  uint8_t *data;
+  char *cstring;
+  uint8_t uint8;
+  uint16_t uint16;
+  uint32_t uint32;
+  int32_t int32;
+} TupleValue;
+
+typedef struct Tuple {
+  uint32_t key;
+  uint16_t length;
+  TupleValue value[1];
+} Tuple;
+
+#define STUB_DICT_TUPLES 8
+
+typedef struct DictionaryIterator {
+  Tuple tuples[STUB_DICT_TUPLES];
+  uint8_t count;
+} DictionaryIterator;
+
+typedef void (*AppMessageInboxReceived)(DictionaryIterator *iterator, void *context);
+typedef void (*AppMessageOutboxSent)(DictionaryIterator *iterator, void *context);
+typedef void (*AppMessageOutboxFailed)(DictionaryIterator *iterator, AppMessageResult reason, void *context);
+
+Tuple *dict_find(const DictionaryIterator *iter, const uint32_t key);
+uint32_t dict_size(DictionaryIterator *iter);
+void dict_write_uint8(DictionaryIterator *iter, const uint32_t key, const uint8_t value);
+void dict_write_uint16(DictionaryIterator *iter, const uint32_t key, const uint16_t value);
+void dict_write_uint32(DictionaryIterator *iter, const uint32_t key, const uint32_t value);
+void dict_write_int32(DictionaryIterator *iter, const uint32_t key, const int32_t value);
+void dict_write_data(DictionaryIterator *iter, const uint32_t key, const uint8_t *data, const uint16_t size);
+void dict_write_cstring(DictionaryIterator *iter, const uint32_t key, const char *value);
+// The lengths of the values are passed as size_t
+uint32_t dict_calc_buffer_size(const uint8_t tuple_count, ...);
+
+AppMessageResult app_message_outbox_begin(DictionaryIterator **iterator);
+AppMessageResult app_message_outbox_send(void);
+uint32_t app_message_inbox_size_maximum(void);
+AppMessageOutboxSent app_message_register_outbox_sent(AppMessageOutboxSent sent_callback);
+AppMessageOutboxFailed app_message_register_outbox_failed(AppMessageOutboxFailed failed_callback);
+
+bool bluetooth_connection_service_peek(void);
+bool connection_service_peek_pebble_app_connection(void);
+
+typedef void (*ConnectionHandler)(bool connected);
+typedef struct ConnectionHandlers {
+  ConnectionHandler pebble_app_connection_handler;
+  ConnectionHandler pebblekit_connection_handler;
+} ConnectionHandlers;
+
+// The messageKeys from package.json that the weather library uses
+enum {
+  MESSAGE_KEY_FIOW_REQUEST = 1,
+  MESSAGE_KEY_FIOW_APIKEY,
+  MESSAGE_KEY_FIOW_LATITUDE,
+  MESSAGE_KEY_FIOW_LONGITUDE,
+  MESSAGE_KEY_FIOW_REPLY,
+  MESSAGE_KEY_FIOW_NAME,
+  MESSAGE_KEY_FIOW_BADKEY,
+  MESSAGE_KEY_FIOW_LOCATIONUNAVAILABLE,
+  MESSAGE_KEY_JSReady,
+  MESSAGE_KEY_FIOW_DATA,
+  MESSAGE_KEY_FIOW_PATCH,
+  MESSAGE_KEY_FIOW_VERSION,
+  MESSAGE_KEY_FIOW_PACKED,
+  MESSAGE_KEY_FIOW_INBOX,
+  MESSAGE_KEY_FIOW_SEQ,
+  MESSAGE_KEY_FIOW_MISSING,
+  MESSAGE_KEY_FIOW_MAXAGE,
+};
+
+// Harness side: the inbox handler the weather library registered, and
+// the last message it sent
+AppMessageInboxReceived stub_inbox_handler(void);
+DictionaryIterator *stub_last_outbox(void);
+void stub_set_inbox_size_maximum(uint32_t size);
+
+// Messages sent so far, and whether the next ones fail, as if the phone
+// didn't answer, STUB_SEND_FAIL_MS after they are sent.  Until then the
+// outbox is busy.
+#define STUB_SEND_FAIL_MS 200
+uint32_t stub_messages_sent(void);
+void stub_set_send_fails(bool fails);
+
+// Connect or disconnect the phone, telling the connection handlers
+void stub_set_connected(bool connected);
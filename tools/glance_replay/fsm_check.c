@@ -0,0 +1,199 @@
+// Exhaustive check of the glance transition tables in src/glancing_fsm.h.
+//
+// Every (state, input, guard) cell is compared against a reference model
+// written the way the state machines were originally expressed, as
+// if/switch chains, and then checked against a few invariants that the
+// rest of glancing_api.c relies on.
+
+#include <stdio.h>
+#include "glancing_fsm.h"
+
+typedef struct Effect {
+  uint8_t next_state;
+  uint16_t actions;
+  uint8_t fsm3_input;
+} Effect;
+
+static Effect ref_fsm3(GlanceFSMState3 state, GlanceFSMInput3 input) {
+  Effect e = { state, 0, GLANCE_INPUT3_NONE };
+
+  if (input == GLANCE_INPUT3_DROPPED) {
+    e.next_state = GLANCE_STATE3_IDLE;
+    e.actions = GLANCE_ACTION3_RESET_TIMERS | GLANCE_ACTION3_OUTPUT_IDLE | GLANCE_ACTION3_SLOW_SAMPLING;
+  }
+  else if (input == GLANCE_INPUT3_ROLLED) {
+    e.next_state = GLANCE_STATE3_NEW_ACTIVE;
+    e.actions = GLANCE_ACTION3_RESET_TIMERS | GLANCE_ACTION3_START_NEW_TIMER |
+                GLANCE_ACTION3_LIGHT_ON | GLANCE_ACTION3_FAST_SAMPLING;
+    if ((state == GLANCE_STATE3_IDLE) || (state == GLANCE_STATE3_IDLE_ACTIVE)) {
+      e.actions |= GLANCE_ACTION3_OUTPUT_ACTIVE;
+    }
+    else {
+      e.actions |= GLANCE_ACTION3_OUTPUT_ROLL;
+    }
+  }
+  else if ((input == GLANCE_INPUT3_ACTIVE) && (state == GLANCE_STATE3_IDLE)) {
+    e.next_state = GLANCE_STATE3_NEW_ACTIVE;
+    e.actions = GLANCE_ACTION3_RESET_TIMERS | GLANCE_ACTION3_START_NEW_TIMER |
+                GLANCE_ACTION3_OUTPUT_ACTIVE | GLANCE_ACTION3_LIGHT_ON | GLANCE_ACTION3_FAST_SAMPLING;
+  }
+  else if ((input == GLANCE_INPUT3_SHORT_TIMER_EXPIRED) && (state == GLANCE_STATE3_NEW_ACTIVE)) {
+    e.next_state = GLANCE_STATE3_OLD_ACTIVE;
+    e.actions = GLANCE_ACTION3_START_OLD_TIMER | GLANCE_ACTION3_OUTPUT_ACTIVE | GLANCE_ACTION3_SLOW_SAMPLING;
+  }
+  else if ((input == GLANCE_INPUT3_LONG_TIMER_EXPIRED) && (state == GLANCE_STATE3_OLD_ACTIVE)) {
+    e.next_state = GLANCE_STATE3_IDLE_ACTIVE;
+    e.actions = GLANCE_ACTION3_OUTPUT_IDLE | GLANCE_ACTION3_SLOW_SAMPLING;
+  }
+  return e;
+}
+
+static Effect ref_fsm2(GlanceFSMState2 state, GlanceFSMInput2 input, uint8_t guards) {
+  Effect e = { state, 0, GLANCE_INPUT3_NONE };
+  const bool roll_timer_running = guards & GLANCE_GUARD2_ROLL_TIMER_RUNNING;
+  const bool was_active = guards & GLANCE_GUARD2_WAS_ACTIVE_ZONE;
+
+  switch (input) {
+    case GLANCE_INPUT2_DROPPED_ZONE:
+      e.actions = GLANCE_ACTION2_RESET_ROLL_TIMER | GLANCE_ACTION2_RESET_ACTIVATION_TIMER;
+      e.next_state = GLANCE_STATE2_NONE;
+      e.fsm3_input = GLANCE_INPUT3_DROPPED;
+      break;
+
+    case GLANCE_INPUT2_ACTIVE_ZONE:
+      if (roll_timer_running && (state == GLANCE_STATE2_ROLL)) {
+        e.actions = GLANCE_ACTION2_RESET_ROLL_TIMER;
+        e.fsm3_input = GLANCE_INPUT3_ROLLED;
+      }
+      else {
+        e.actions = GLANCE_ACTION2_START_ACTIVATION_TIMER;
+      }
+      break;
+
+    case GLANCE_INPUT2_ROLL_ZONE:
+      e.actions = GLANCE_ACTION2_RESET_ACTIVATION_TIMER;
+      if (roll_timer_running) {
+        e.next_state = GLANCE_STATE2_ROLL;
+      }
+      else if (was_active) {
+        e.actions |= GLANCE_ACTION2_START_ROLL_TIMER | GLANCE_ACTION2_FAST_SAMPLING;
+        e.next_state = GLANCE_STATE2_ROLL;
+      }
+      break;
+
+    case GLANCE_INPUT2_UNKNOWN_ZONE:
+      e.actions = GLANCE_ACTION2_RESET_ACTIVATION_TIMER;
+      if (was_active) {
+        e.actions |= GLANCE_ACTION2_START_ROLL_TIMER | GLANCE_ACTION2_FAST_SAMPLING;
+        e.next_state = GLANCE_STATE2_NONE;
+      }
+      break;
+
+    case GLANCE_INPUT2_ROLL_TIMER_EXPIRED:
+      e.actions = GLANCE_ACTION2_SLOW_SAMPLING;
+      e.next_state = GLANCE_STATE2_NONE;
+      break;
+
+    case GLANCE_INPUT2_ACTIVATION_TIMER_EXPIRED:
+      e.actions = GLANCE_ACTION2_SLOW_SAMPLING;
+      e.fsm3_input = GLANCE_INPUT3_ACTIVE;
+      break;
+
+    case GLANCE_INPUT2_SHORT_TIMER_EXPIRED:
+      e.fsm3_input = GLANCE_INPUT3_SHORT_TIMER_EXPIRED;
+      break;
+
+    case GLANCE_INPUT2_LONG_TIMER_EXPIRED:
+      e.fsm3_input = GLANCE_INPUT3_LONG_TIMER_EXPIRED;
+      break;
+
+    default:
+      break;
+  }
+  return e;
+}
+
+static int s_failures = 0;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+      printf("FAIL: " __VA_ARGS__); \
+      printf("\n"); \
+      s_failures++; \
+    } \
+  } while (0)
+
+static void check_fsm3(void) {
+  bool reachable[GLANCE_STATE3_COUNT] = { [GLANCE_STATE3_IDLE] = true };
+
+  // Breadth-first closure from IDLE
+  for (int pass = 0; pass < GLANCE_STATE3_COUNT; pass++) {
+    for (int s = 0; s < GLANCE_STATE3_COUNT; s++) {
+      if (!reachable[s]) continue;
+      for (int i = 0; i < GLANCE_INPUT3_COUNT; i++) {
+        reachable[glance_fsm3_table[s][i].next_state] = true;
+      }
+    }
+  }
+
+  for (int s = 0; s < GLANCE_STATE3_COUNT; s++) {
+    CHECK(reachable[s], "FSM3 state %d unreachable from IDLE", s);
+
+    for (int i = 0; i < GLANCE_INPUT3_COUNT; i++) {
+      const GlanceTransition3 *t = &glance_fsm3_table[s][i];
+      Effect ref = ref_fsm3(s, i);
+
+      CHECK(t->next_state < GLANCE_STATE3_COUNT, "FSM3[%d][%d] next state %d out of range", s, i, t->next_state);
+      CHECK(t->next_state == ref.next_state, "FSM3[%d][%d] next state %d, expected %d",
+            s, i, t->next_state, ref.next_state);
+      CHECK(t->actions == ref.actions, "FSM3[%d][%d] actions 0x%x, expected 0x%x", s, i, t->actions, ref.actions);
+
+      CHECK(i != GLANCE_INPUT3_DROPPED || t->next_state == GLANCE_STATE3_IDLE,
+            "FSM3[%d] DROPPED must return to IDLE", s);
+      // keep_light_on_while_active switches the light straight off unless is_glancing()
+      CHECK(!(t->actions & GLANCE_ACTION3_LIGHT_ON) || t->next_state == GLANCE_STATE3_NEW_ACTIVE,
+            "FSM3[%d][%d] turns the light on outside NEW_ACTIVE", s, i);
+      CHECK((t->actions & (GLANCE_ACTION3_OUTPUT_IDLE | GLANCE_ACTION3_OUTPUT_ACTIVE)) !=
+            (GLANCE_ACTION3_OUTPUT_IDLE | GLANCE_ACTION3_OUTPUT_ACTIVE),
+            "FSM3[%d][%d] sends both IDLE and ACTIVE", s, i);
+      CHECK((t->actions & (GLANCE_ACTION3_FAST_SAMPLING | GLANCE_ACTION3_SLOW_SAMPLING)) !=
+            (GLANCE_ACTION3_FAST_SAMPLING | GLANCE_ACTION3_SLOW_SAMPLING),
+            "FSM3[%d][%d] asks for both fast and slow sampling", s, i);
+    }
+  }
+}
+
+static void check_fsm2(void) {
+  for (int s = 0; s < GLANCE_STATE2_COUNT; s++) {
+    for (int i = 0; i < GLANCE_INPUT2_COUNT; i++) {
+      for (int g = 0; g < GLANCE_GUARD2_COUNT; g++) {
+        const GlanceTransition2 *t = &glance_fsm2_table[s][i][g];
+        Effect ref = ref_fsm2(s, i, g);
+
+        CHECK(t->next_state < GLANCE_STATE2_COUNT, "FSM2[%d][%d][%d] next state %d out of range",
+              s, i, g, t->next_state);
+        CHECK(t->fsm3_input <= GLANCE_INPUT3_NONE, "FSM2[%d][%d][%d] FSM3 input %d out of range",
+              s, i, g, t->fsm3_input);
+        CHECK(t->next_state == ref.next_state, "FSM2[%d][%d][%d] next state %d, expected %d",
+              s, i, g, t->next_state, ref.next_state);
+        CHECK(t->actions == ref.actions, "FSM2[%d][%d][%d] actions 0x%x, expected 0x%x",
+              s, i, g, t->actions, ref.actions);
+        CHECK(t->fsm3_input == ref.fsm3_input, "FSM2[%d][%d][%d] FSM3 input %d, expected %d",
+              s, i, g, t->fsm3_input, ref.fsm3_input);
+        CHECK((t->actions & (GLANCE_ACTION2_FAST_SAMPLING | GLANCE_ACTION2_SLOW_SAMPLING)) !=
+              (GLANCE_ACTION2_FAST_SAMPLING | GLANCE_ACTION2_SLOW_SAMPLING),
+              "FSM2[%d][%d][%d] asks for both fast and slow sampling", s, i, g);
+      }
+    }
+  }
+}
+
+int main(void) {
+  check_fsm3();
+  check_fsm2();
+
+  int cells = GLANCE_STATE3_COUNT * GLANCE_INPUT3_COUNT +
+              GLANCE_STATE2_COUNT * GLANCE_INPUT2_COUNT * GLANCE_GUARD2_COUNT;
+  printf("fsm_check: %d transitions, %d failures\n", cells, s_failures);
+  return s_failures ? 1 : 0;
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+// Minimal stand-in for the Pebble SDK header, sufficient to build
+// src/glancing_api.c on a Linux host.  Time is simulated: nothing here
+// touches the wall clock, so traces replay as fast as the CPU allows.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef enum {
+  APP_LOG_LEVEL_ERROR = 1,
+  APP_LOG_LEVEL_WARNING = 50,
+  APP_LOG_LEVEL_INFO = 100,
+  APP_LOG_LEVEL_DEBUG = 200,
+  APP_LOG_LEVEL_DEBUG_VERBOSE = 255,
+} AppLogLevel;
+
+void app_log(uint8_t log_level, const char *src_filename, int src_line_number, const char *fmt, ...);
+
+#define APP_LOG(level, fmt, args...) \
+  app_log(level, __FILE__, __LINE__, fmt, ## args)
+
+typedef struct __attribute__((__packed__)) AccelData {
+  int16_t x;
+  int16_t y;
+  int16_t z;
+  bool did_vibrate;
+  uint64_t timestamp;
+} AccelData;
+
+typedef enum {
+  ACCEL_AXIS_X = 0,
+  ACCEL_AXIS_Y = 1,
+  ACCEL_AXIS_Z = 2,
+} AccelAxisType;
+
+typedef enum {
+  ACCEL_SAMPLING_10HZ = 10,
+  ACCEL_SAMPLING_25HZ = 25,
+  ACCEL_SAMPLING_50HZ = 50,
+  ACCEL_SAMPLING_100HZ = 100,
+} AccelSamplingRate;
+
+typedef void (*AccelDataHandler)(AccelData *data, uint32_t num_samples);
+typedef void (*AccelTapHandler)(AccelAxisType axis, int32_t direction);
+
+void accel_data_service_subscribe(uint32_t samples_per_update, AccelDataHandler handler);
+void accel_data_service_unsubscribe(void);
+int accel_service_set_sampling_rate(AccelSamplingRate rate);
+int accel_service_set_samples_per_update(uint32_t num_samples);
+void accel_tap_service_subscribe(AccelTapHandler handler);
+void accel_tap_service_unsubscribe(void);
+int accel_service_peek(AccelData *data);
+
+typedef struct AppTimer AppTimer;
+typedef void (*AppTimerCallback)(void *data);
+
+AppTimer *app_timer_register(uint32_t timeout_ms, AppTimerCallback callback, void *callback_data);
+bool app_timer_reschedule(AppTimer *timer_handle, uint32_t new_timeout_ms);
+void app_timer_cancel(AppTimer *timer_handle);
+
+uint16_t time_ms(time_t *tloc, uint16_t *out_ms);
+
+void light_enable_interaction(void);
+void light_enable(bool enable);
+
+#define PERSIST_DATA_MAX_LENGTH 256
+
+bool persist_exists(const uint32_t key);
+int persist_get_size(const uint32_t key);
+int persist_read_data(const uint32_t key, void *buffer, const size_t buffer_size);
+int persist_write_data(const uint32_t key, const void *data, const size_t size);
+int32_t persist_read_int(const uint32_t key);
+int persist_write_int(const uint32_t key, const int32_t value);
+int persist_delete(const uint32_t key);
@@ -0,0 +1,318 @@
+#include <stdarg.h>
+#include "pebble.h"
+#include "sim.h"
+
+#define MAX_TIMERS 32
+#define MAX_PERSIST_KEYS 64
+
+struct AppTimer {
+  bool in_use;
+  uint64_t deadline_ms;
+  uint64_t seq;             // Tie-break so equal deadlines fire in registration order
+  AppTimerCallback callback;
+  void *data;
+};
+
+static AppTimer s_timers[MAX_TIMERS];
+static uint64_t s_timer_seq = 0;
+
+static uint64_t s_now_ms = 0;
+static bool s_verbose = false;
+
+static AccelDataHandler s_accel_handler = NULL;
+static AccelTapHandler s_tap_handler = NULL;
+static SimPeekSource s_peek_source = NULL;
+static uint32_t s_samples_per_update = 25;
+static uint32_t s_rate_hz = ACCEL_SAMPLING_25HZ;
+static uint32_t s_config_epoch = 0;
+
+static SimCounters s_counters;
+
+typedef struct PersistEntry {
+  bool in_use;
+  uint32_t key;
+  size_t size;
+  uint8_t data[PERSIST_DATA_MAX_LENGTH];
+} PersistEntry;
+
+static PersistEntry s_persist[MAX_PERSIST_KEYS];
+
+void sim_reset(uint64_t start_ms) {
+  memset(s_timers, 0, sizeof(s_timers));
+  memset(&s_counters, 0, sizeof(s_counters));
+  memset(s_persist, 0, sizeof(s_persist));
+  s_timer_seq = 0;
+  s_now_ms = start_ms;
+  s_accel_handler = NULL;
+  s_tap_handler = NULL;
+  s_samples_per_update = 25;
+  s_rate_hz = ACCEL_SAMPLING_25HZ;
+  s_config_epoch = 0;
+}
+
+uint64_t sim_now(void) {
+  return s_now_ms;
+}
+
+void sim_advance_to(uint64_t t_ms) {
+  if (t_ms <= s_now_ms) {
+    return;
+  }
+  if (s_accel_handler) {
+    s_counters.ms_at_rate[s_rate_hz] += t_ms - s_now_ms;
+  }
+  else {
+    s_counters.ms_unsubscribed += t_ms - s_now_ms;
+  }
+  s_now_ms = t_ms;
+}
+
+static AppTimer *earliest_timer(void) {
+  AppTimer *best = NULL;
+  for (int i = 0; i < MAX_TIMERS; i++) {
+    AppTimer *t = &s_timers[i];
+    if (!t->in_use) {
+      continue;
+    }
+    if (!best || t->deadline_ms < best->deadline_ms ||
+        (t->deadline_ms == best->deadline_ms && t->seq < best->seq)) {
+      best = t;
+    }
+  }
+  return best;
+}
+
+uint64_t sim_next_timer_deadline(void) {
+  AppTimer *t = earliest_timer();
+  return t ? t->deadline_ms : SIM_NO_DEADLINE;
+}
+
+void sim_fire_due_timers(void) {
+  AppTimer *t;
+  while ((t = earliest_timer()) && t->deadline_ms <= s_now_ms) {
+    AppTimerCallback callback = t->callback;
+    void *data = t->data;
+    t->in_use = false;
+    callback(data);
+  }
+}
+
+bool sim_accel_subscribed(void) {
+  return s_accel_handler != NULL;
+}
+
+AccelDataHandler sim_accel_handler(void) {
+  return s_accel_handler;
+}
+
+uint32_t sim_samples_per_update(void) {
+  return s_samples_per_update;
+}
+
+uint32_t sim_sampling_rate_hz(void) {
+  return s_rate_hz;
+}
+
+AccelTapHandler sim_tap_handler(void) {
+  return s_tap_handler;
+}
+
+void sim_set_peek_source(SimPeekSource source) {
+  s_peek_source = source;
+}
+
+uint32_t sim_accel_config_epoch(void) {
+  return s_config_epoch;
+}
+
+void sim_set_verbose(bool verbose) {
+  s_verbose = verbose;
+}
+
+const SimCounters *sim_counters(void) {
+  return &s_counters;
+}
+
+// ---------------------------------------------------------------------------
+// Pebble SDK surface
+
+void app_log(uint8_t log_level, const char *src_filename, int src_line_number, const char *fmt, ...) {
+  if (!s_verbose) {
+    return;
+  }
+  va_list args;
+  va_start(args, fmt);
+  fprintf(stderr, "[%8llu] %s:%d ", (unsigned long long)s_now_ms, src_filename, src_line_number);
+  vfprintf(stderr, fmt, args);
+  fputc('\n', stderr);
+  va_end(args);
+}
+
+void accel_data_service_subscribe(uint32_t samples_per_update, AccelDataHandler handler) {
+  s_accel_handler = handler;
+  s_samples_per_update = samples_per_update;
+  s_config_epoch++;
+  s_counters.rate_changes++;
+}
+
+void accel_data_service_unsubscribe(void) {
+  s_accel_handler = NULL;
+  s_config_epoch++;
+}
+
+int accel_service_set_sampling_rate(AccelSamplingRate rate) {
+  if (s_rate_hz != (uint32_t)rate) {
+    s_rate_hz = rate;
+    s_config_epoch++;
+    s_counters.rate_changes++;
+  }
+  return 0;
+}
+
+int accel_service_set_samples_per_update(uint32_t num_samples) {
+  if (s_samples_per_update != num_samples) {
+    s_samples_per_update = num_samples;
+    s_config_epoch++;
+    s_counters.rate_changes++;
+  }
+  return 0;
+}
+
+void accel_tap_service_subscribe(AccelTapHandler handler) {
+  s_tap_handler = handler;
+}
+
+void accel_tap_service_unsubscribe(void) {
+  s_tap_handler = NULL;
+}
+
+// As on the watch, a peek fails while the data service is subscribed
+int accel_service_peek(AccelData *data) {
+  if (s_accel_handler || !s_peek_source) {
+    return -1;
+  }
+  s_counters.peeks++;
+  s_peek_source(s_now_ms, data);
+  return 0;
+}
+
+AppTimer *app_timer_register(uint32_t timeout_ms, AppTimerCallback callback, void *callback_data) {
+  for (int i = 0; i < MAX_TIMERS; i++) {
+    AppTimer *t = &s_timers[i];
+    if (!t->in_use) {
+      t->in_use = true;
+      t->deadline_ms = s_now_ms + timeout_ms;
+      t->seq = s_timer_seq++;
+      t->callback = callback;
+      t->data = callback_data;
+      s_counters.timers_registered++;
+      return t;
+    }
+  }
+  fprintf(stderr, "pebble_stub: out of AppTimers\n");
+  abort();
+}
+
+bool app_timer_reschedule(AppTimer *timer_handle, uint32_t new_timeout_ms) {
+  if (!timer_handle || !timer_handle->in_use) {
+    return false;
+  }
+  timer_handle->deadline_ms = s_now_ms + new_timeout_ms;
+  timer_handle->seq = s_timer_seq++;
+  return true;
+}
+
+void app_timer_cancel(AppTimer *timer_handle) {
+  if (timer_handle) {
+    timer_handle->in_use = false;
+  }
+}
+
+uint16_t time_ms(time_t *tloc, uint16_t *out_ms) {
+  uint16_t ms = s_now_ms % 1000;
+  if (tloc) {
+    *tloc = (time_t)(s_now_ms / 1000);
+  }
+  if (out_ms) {
+    *out_ms = ms;
+  }
+  return ms;
+}
+
+void light_enable_interaction(void) {
+  s_counters.light_interactions++;
+}
+
+void light_enable(bool enable) {
+  if (!enable) {
+    s_counters.light_off++;
+  }
+}
+
+static PersistEntry *persist_find(uint32_t key, bool create) {
+  PersistEntry *free_entry = NULL;
+  for (int i = 0; i < MAX_PERSIST_KEYS; i++) {
+    if (s_persist[i].in_use && s_persist[i].key == key) {
+      return &s_persist[i];
+    }
+    if (!s_persist[i].in_use && !free_entry) {
+      free_entry = &s_persist[i];
+    }
+  }
+  if (create && free_entry) {
+    free_entry->in_use = true;
+    free_entry->key = key;
+    free_entry->size = 0;
+    return free_entry;
+  }
+  return NULL;
+}
+
+bool persist_exists(const uint32_t key) {
+  return persist_find(key, false) != NULL;
+}
+
+int persist_get_size(const uint32_t key) {
+  PersistEntry *e = persist_find(key, false);
+  return e ? (int)e->size : -1;
+}
+
+int persist_read_data(const uint32_t key, void *buffer, const size_t buffer_size) {
+  PersistEntry *e = persist_find(key, false);
+  if (!e) {
+    return -1;
+  }
+  size_t n = e->size < buffer_size ? e->size : buffer_size;
+  memcpy(buffer, e->data, n);
+  return (int)n;
+}
+
+int persist_write_data(const uint32_t key, const void *data, const size_t size) {
+  PersistEntry *e = persist_find(key, true);
+  if (!e) {
+    return -1;
+  }
+  size_t n = size < PERSIST_DATA_MAX_LENGTH ? size : PERSIST_DATA_MAX_LENGTH;
+  memcpy(e->data, data, n);
+  e->size = n;
+  s_counters.persist_writes++;
+  return (int)n;
+}
+
+int32_t persist_read_int(const uint32_t key) {
+  int32_t value = 0;
+  persist_read_data(key, &value, sizeof(value));
+  return value;
+}
+
+int persist_write_int(const uint32_t key, const int32_t value) {
+  return persist_write_data(key, &value, sizeof(value));
+}
+
+int persist_delete(const uint32_t key) {
+  PersistEntry *e = persist_find(key, false);
+  if (e) {
+    e->in_use = false;
+  }
+  return 0;
+}
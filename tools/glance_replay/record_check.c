@@ -0,0 +1,215 @@
+// Checks src/glance_record.c: every synthetic scenario, recorded in the
+// batches the service would see, decodes back to the same samples, times
+// and vibe motor flags, both when chunks are streamed as they complete and
+// when they go through persistent storage.  Reports the bytes per sample.
+//
+// The decoder here mirrors the one in src/js/app.js.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pebble.h"
+#include "trace.h"
+#include "glance_record.h"
+
+#define START_MS 1467068400000ULL
+#define PERSIST_KEY 130
+// The vibe motor runs for the first VIBE_MS of every VIBE_EVERY_MS, so it
+// starts and stops part way through batches
+#define VIBE_EVERY_MS 3000
+#define VIBE_MS 400
+
+typedef struct Sample {
+  uint32_t t_ms;
+  int16_t x, y, z;
+  bool vibrate;
+} Sample;
+
+typedef struct Decoded {
+  Sample *samples;
+  size_t count;
+  size_t capacity;
+  size_t bytes;
+  size_t chunks;
+  int last_seq;
+  uint32_t failures;
+} Decoded;
+
+static Decoded s_decoded;
+
+static void fail(const char *what) {
+  printf("  %s\n", what);
+  s_decoded.failures++;
+}
+
+static const uint8_t *get_varint(const uint8_t *in, const uint8_t *end, uint32_t *value) {
+  *value = 0;
+  for (int shift = 0; in < end && shift < 35; shift += 7) {
+    uint8_t byte = *in++;
+    *value |= (uint32_t)(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      return in;
+    }
+  }
+  return NULL;
+}
+
+static void append(Decoded *d, uint32_t t_ms, int x, int y, int z, bool vibrate) {
+  if (d->count == d->capacity) {
+    d->capacity = d->capacity ? 2 * d->capacity : 1024;
+    d->samples = realloc(d->samples, d->capacity * sizeof(Sample));
+  }
+  d->samples[d->count++] = (Sample) { t_ms, x, y, z, vibrate };
+}
+
+static void decode_chunk(Decoded *d, const uint8_t *chunk, uint16_t length) {
+  if (length < GLANCE_RECORD_HEADER_SIZE || chunk[0] != GLANCE_RECORD_VERSION) {
+    fail("bad chunk header");
+    return;
+  }
+  int seq = chunk[2] | (chunk[3] << 8);
+  if (d->last_seq >= 0 && seq != d->last_seq + 1) {
+    fail("chunk out of sequence");
+  }
+  d->last_seq = seq;
+  d->chunks++;
+  d->bytes += length;
+
+  uint32_t t = chunk[4] | (chunk[5] << 8) | (chunk[6] << 16) | ((uint32_t)chunk[7] << 24);
+  uint16_t expected = chunk[8] | (chunk[9] << 8);
+  uint16_t samples = 0;
+  int prev[3] = { 0, 0, 0 };
+  const uint8_t *in = chunk + chunk[1];
+  const uint8_t *end = chunk + length;
+  while (in && in < end) {
+    uint32_t delta, period;
+    in = get_varint(in, end, &delta);
+    in = in ? get_varint(in, end, &period) : NULL;
+    if (!in || in >= end) {
+      break;
+    }
+    const bool vibrate = *in & 1;
+    uint8_t n = *in++ >> 1;
+    t += delta;
+    for (uint8_t i = 0; i < n && in; i++) {
+      for (int axis = 0; axis < 3 && in; axis++) {
+        uint32_t z;
+        in = get_varint(in, end, &z);
+        prev[axis] += (int32_t)(z >> 1) ^ -(int32_t)(z & 1);
+      }
+      append(d, t - (uint32_t)START_MS + i * period, prev[0], prev[1], prev[2], vibrate);
+      samples++;
+    }
+  }
+  if (!in || samples != expected) {
+    fail("chunk didn't decode to its sample count");
+  }
+}
+
+static void on_chunk_ready(void *context) {
+  uint16_t length;
+  const uint8_t *chunk;
+  while ((chunk = glance_record_peek_chunk(&length))) {
+    decode_chunk(&s_decoded, chunk, length);
+    glance_record_chunk_sent(chunk);
+  }
+}
+
+// Feed the trace to the recorder at rate_hz in batches of batch_size,
+// as the accelerometer service would.  With stream, chunks are decoded as
+// they complete; otherwise every few batches the recording is saved,
+// reloaded, and decoded, as across a restart of the watchface.
+static void record(const Trace *trace, Trace *expected, uint32_t rate_hz, uint32_t batch_size, bool stream) {
+  const uint32_t period = 1000 / rate_hz;
+  size_t cursor = 0;
+  AccelData batch[32];
+  trace_init(expected, trace->name);
+
+  glance_record_start(stream ? on_chunk_ready : NULL, NULL);
+  uint32_t batches = 0;
+  for (uint32_t t = 0; t + batch_size * period <= trace_duration_ms(trace); t += batch_size * period) {
+    for (uint32_t i = 0; i < batch_size; i++) {
+      const TraceSample *s = trace_sample_at(trace, t + i * period, &cursor);
+      const bool vibrate = (t + i * period) % VIBE_EVERY_MS < VIBE_MS;
+      batch[i] = (AccelData) { .x = s->x, .y = s->y, .z = s->z, .did_vibrate = vibrate,
+                               .timestamp = START_MS + t + i * period };
+      trace_append(expected, t + i * period, s->x, s->y, s->z, false);
+      expected->samples[expected->count - 1].vibrate = vibrate;
+    }
+    glance_record_batch(batch, batch_size, START_MS + t, period);
+
+    if (!stream && (++batches % 8 == 0)) {
+      glance_record_stop();
+      glance_record_save(PERSIST_KEY);
+      glance_record_load(PERSIST_KEY);
+      on_chunk_ready(NULL);
+      glance_record_start(NULL, NULL);
+    }
+  }
+  glance_record_stop();
+  if (!stream) {
+    glance_record_save(PERSIST_KEY);
+    glance_record_load(PERSIST_KEY);
+  }
+  on_chunk_ready(NULL);
+}
+
+static void compare(const Trace *expected) {
+  if (s_decoded.count != expected->count) {
+    printf("  decoded %zu samples, recorded %zu\n", s_decoded.count, expected->count);
+    s_decoded.failures++;
+    return;
+  }
+  for (size_t i = 0; i < expected->count; i++) {
+    const TraceSample *e = &expected->samples[i];
+    const Sample *d = &s_decoded.samples[i];
+    if (d->t_ms != e->t_ms || d->x != e->x || d->y != e->y || d->z != e->z || d->vibrate != e->vibrate) {
+      printf("  sample %zu: %u %d %d %d %d, recorded %u %d %d %d %d\n", i, d->t_ms, d->x, d->y, d->z,
+             d->vibrate, e->t_ms, e->x, e->y, e->z, e->vibrate);
+      s_decoded.failures++;
+      return;
+    }
+  }
+}
+
+int main(void) {
+  static const struct { uint32_t rate_hz, batch_size; bool stream; } RUNS[] = {
+    { 25, 5, true }, { 10, 7, true }, { 10, 15, true }, { 50, 10, true }, { 25, 5, false },
+  };
+  uint32_t failures = 0;
+  size_t total_samples = 0, total_bytes = 0;
+
+  printf("%-16s %5s %5s %6s %8s %7s %6s %7s\n", "trace", "rate", "batch", "mode", "samples", "chunks",
+         "B/smp", "s/chunk");
+  for (size_t i = 0; i < synth_scenario_count(); i++) {
+    Trace trace;
+    synth_generate(&trace, synth_scenario_name(i));
+    for (size_t r = 0; r < sizeof(RUNS) / sizeof(RUNS[0]); r++) {
+      Trace expected;
+      free(s_decoded.samples);
+      memset(&s_decoded, 0, sizeof(s_decoded));
+      s_decoded.last_seq = -1;
+
+      record(&trace, &expected, RUNS[r].rate_hz, RUNS[r].batch_size, RUNS[r].stream);
+      compare(&expected);
+      printf("%-16s %5u %5u %6s %8zu %7zu %6.2f %7.1f\n", trace.name, RUNS[r].rate_hz, RUNS[r].batch_size,
+             RUNS[r].stream ? "stream" : "saved", s_decoded.count, s_decoded.chunks,
+             s_decoded.count ? (double)s_decoded.bytes / s_decoded.count : 0.0,
+             s_decoded.chunks ? (double)s_decoded.count / RUNS[r].rate_hz / s_decoded.chunks : 0.0);
+      if (glance_record_dropped()) {
+        printf("  %u chunks dropped\n", glance_record_dropped());
+        failures++;
+      }
+      failures += s_decoded.failures;
+      total_samples += s_decoded.count;
+      total_bytes += s_decoded.bytes;
+      trace_free(&expected);
+    }
+    trace_free(&trace);
+  }
+
+  printf("record_check: %zu samples in %.2f bytes each, %u failures\n", total_samples,
+         total_samples ? (double)total_bytes / total_samples : 0.0, failures);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,110 @@
+// Replays accelerometer traces through src/glancing_api.c on a simulated
+// Pebble and reports what each trace cost and how well it was detected.
+//
+//   glance_replay                 run every built-in synthetic scenario
+//   glance_replay a.csv b.csv     run recorded traces (see trace.h)
+//   glance_replay -s roll         run one synthetic scenario
+//   glance_replay -d roll r.csv   write a synthetic scenario out as CSV
+//   glance_replay -v ...          also print the service's APP_LOG output
+//   glance_replay -t ...          print the service's glance trace ring after each trace
+//   glance_replay -l 300 ...      deliver each batch 300ms after its last sample
+//
+// Each trace runs in a forked child so that the service's static state
+// starts fresh every time.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim.h"
+#include "trace.h"
+#include "replay.h"
+
+static void usage(const char *prog) {
+  fprintf(stderr,
+          "usage: %s [-v] [-t] [-l ms] [-s scenario]... [trace.csv]...\n"
+          "       %s -d scenario out.csv\n"
+          "scenarios:", prog, prog);
+  for (size_t i = 0; i < synth_scenario_count(); i++) {
+    fprintf(stderr, " %s", synth_scenario_name(i));
+  }
+  fprintf(stderr, "\n");
+}
+
+int main(int argc, char **argv) {
+  ReplayResult total;
+  memset(&total, 0, sizeof(total));
+  bool ran_any = false;
+  bool ok = true;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-v") == 0) {
+      sim_set_verbose(true);
+    }
+    else if (strcmp(argv[i], "-t") == 0) {
+      replay_set_print_trace(true);
+    }
+    else if (strcmp(argv[i], "-l") == 0) {
+      if (i + 1 >= argc) {
+        usage(argv[0]);
+        return 2;
+      }
+      replay_set_delivery_lateness((uint32_t)atoi(argv[++i]));
+    }
+    else if (strcmp(argv[i], "-h") == 0) {
+      usage(argv[0]);
+      return 0;
+    }
+    else if (strcmp(argv[i], "-d") == 0) {
+      if (i + 2 >= argc) {
+        usage(argv[0]);
+        return 2;
+      }
+      Trace trace;
+      if (!synth_generate(&trace, argv[i + 1])) {
+        usage(argv[0]);
+        return 2;
+      }
+      ok = trace_save_csv(&trace, argv[i + 2]);
+      trace_free(&trace);
+      return ok ? 0 : 1;
+    }
+  }
+
+  replay_print_header();
+  for (int i = 1; i < argc; i++) {
+    Trace trace;
+    if (strcmp(argv[i], "-v") == 0 || strcmp(argv[i], "-t") == 0) {
+      continue;
+    }
+    if (strcmp(argv[i], "-l") == 0) {
+      i++;
+      continue;
+    }
+    if (strcmp(argv[i], "-s") == 0) {
+      if (++i >= argc || !synth_generate(&trace, argv[i])) {
+        usage(argv[0]);
+        return 2;
+      }
+    }
+    else if (!trace_load_csv(&trace, argv[i])) {
+      ok = false;
+      continue;
+    }
+    ok = replay_run_trace(&trace, &total) && ok;
+    trace_free(&trace);
+    ran_any = true;
+  }
+
+  if (!ran_any && ok) {
+    for (size_t i = 0; i < synth_scenario_count(); i++) {
+      Trace trace;
+      synth_generate(&trace, synth_scenario_name(i));
+      ok = replay_run_trace(&trace, &total) && ok;
+      trace_free(&trace);
+    }
+  }
+
+  replay_print_row("TOTAL", &total);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "trace.h"
+
+// Replay of accelerometer traces through the glancing service, shared by
+// glance_replay and zone_fit.
+
+typedef struct ReplayResult {
+  uint64_t duration_ms;
+  uint64_t batches;
+  uint64_t samples;
+  uint64_t cpu_ns;
+  uint32_t glances;           // Labelled glances in the trace
+  uint32_t detected;          // ... that reached GLANCE_OUTPUT_ACTIVE
+  uint64_t latency_sum_ms;    // Glance start to GLANCE_OUTPUT_ACTIVE
+  uint32_t latency_max_ms;
+  uint32_t false_activations; // GLANCE_OUTPUT_ACTIVE outside a labelled glance
+  uint32_t zone_events;
+  uint32_t deliveries;        // Subscriber calls, each a redraw on the watch
+  uint32_t output_events;
+  uint64_t ms_10hz;
+  uint64_t ms_25hz;
+  uint64_t ms_other_rate;
+  uint64_t ms_unsubscribed;
+  uint32_t light_interactions;
+  uint32_t taps;              // Delivered to the service
+  uint32_t wakes;             // From suspend, by tap or peek
+  uint64_t wake_latency_sum_ms;
+  uint32_t raises;            // Counted in the service's raise-to-light histogram
+  uint64_t raise_latency_sum_ms;
+} ReplayResult;
+
+// Print the service's glance trace ring after each replay
+void replay_set_print_trace(bool print);
+
+// Deliver each batch this long after its last sample was taken, as a busy
+// watch does; the samples keep their true timestamps
+void replay_set_delivery_lateness(uint32_t lateness_ms);
+
+// Run the replay in a child process, so every trace starts from the
+// service's initial static state.  Anything set up before the call, such
+// as zone bounds, is inherited by the child.
+bool replay_isolated(const Trace *trace, ReplayResult *result);
+
+void replay_print_header(void);
+void replay_print_row(const char *name, const ReplayResult *r);
+void replay_accumulate(ReplayResult *total, const ReplayResult *r);
+
+// replay_isolated(), then print and accumulate the result
+bool replay_run_trace(const Trace *trace, ReplayResult *total);
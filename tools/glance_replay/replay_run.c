@@ -0,0 +1,432 @@
+// Replays one trace through src/glancing_api.c on the simulated Pebble in
+// pebble_stub.c, see replay.h.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "sim.h"
+#include "trace.h"
+#include "glancing_api.h"
+#include "glance_trace.h"
+#include "replay.h"
+
+// Start the simulated clock at a realistic epoch - the service treats a
+// deadline of 0 as "not running".
+#define SIM_START_MS 1467068400000ULL
+
+// Rough model of the accelerometer's tap detector: a tap is reported when
+// the reading changes faster than this, in milli-g per 10ms summed over
+// the axes, and not again for the refractory time.
+#define SIM_TAP_JERK 400
+#define SIM_TAP_REFRACTORY_MS 500
+
+// Where the replay persists the glance stats, to check they survive exit
+#define REPLAY_STATS_PERSIST_KEY 1
+
+static const Trace *s_trace;
+static uint64_t s_start_ms;
+static ReplayResult s_result;
+static bool s_print_trace = false;
+static uint32_t s_lateness_ms = 0;
+static size_t s_peek_cursor;
+static size_t s_tap_cursor;
+
+// Ground-truth tracking, advanced lazily up to the simulated time
+static size_t s_label_cursor;
+static bool s_label;
+static bool s_glance_open;
+static bool s_glance_detected;
+static uint64_t s_glance_start_ms;
+
+static uint64_t cpu_now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void advance_labels(uint64_t now_ms) {
+  uint64_t rel = now_ms - s_start_ms;
+  while (s_label_cursor < s_trace->count && s_trace->samples[s_label_cursor].t_ms <= rel) {
+    bool label = s_trace->samples[s_label_cursor].glance;
+    if (label && !s_label) {
+      s_result.glances++;
+      s_glance_open = true;
+      s_glance_detected = false;
+      s_glance_start_ms = s_start_ms + s_trace->samples[s_label_cursor].t_ms;
+    }
+    else if (!label && s_label) {
+      s_glance_open = false;
+    }
+    s_label = label;
+    s_label_cursor++;
+  }
+}
+
+static void on_transition(const GlanceTransition *transition) {
+  uint64_t now = sim_now();
+  advance_labels(now);
+
+  if (transition->event == GLANCE_EVENT_ZONE) {
+    s_result.zone_events++;
+    return;
+  }
+
+  s_result.output_events++;
+  if (transition->value != GLANCE_OUTPUT_ACTIVE) {
+    return;
+  }
+
+  if (s_glance_open) {
+    if (!s_glance_detected) {
+      uint32_t latency = (uint32_t)(now - s_glance_start_ms);
+      s_glance_detected = true;
+      s_result.detected++;
+      s_result.latency_sum_ms += latency;
+      if (latency > s_result.latency_max_ms) {
+        s_result.latency_max_ms = latency;
+      }
+    }
+  }
+  else {
+    s_result.false_activations++;
+  }
+}
+
+// Like the watchface, one call - one redraw - per batch of transitions
+static void on_glance_transitions(const GlanceTransition *transitions, uint8_t count,
+                                  const GlanceResult *state, void *context) {
+  s_result.deliveries++;
+  for (uint8_t i = 0; i < count; i++) {
+    on_transition(&transitions[i]);
+  }
+}
+
+static uint64_t batch_period_ms(void) {
+  return (uint64_t)sim_samples_per_update() * 1000 / sim_sampling_rate_hz();
+}
+
+static void deliver_batch(size_t *cursor) {
+  uint32_t n = sim_samples_per_update();
+  uint32_t step_ms = 1000 / sim_sampling_rate_hz();
+  AccelData batch[32];
+  if (n > sizeof(batch) / sizeof(batch[0])) {
+    n = sizeof(batch) / sizeof(batch[0]);
+  }
+
+  uint64_t now = sim_now();
+  for (uint32_t i = 0; i < n; i++) {
+    uint64_t t = now - s_lateness_ms - (uint64_t)(n - 1 - i) * step_ms;
+    uint32_t rel = t > s_start_ms ? (uint32_t)(t - s_start_ms) : 0;
+    const TraceSample *s = trace_sample_at(s_trace, rel, cursor);
+    batch[i].x = s->x;
+    batch[i].y = s->y;
+    batch[i].z = s->z;
+    batch[i].did_vibrate = s->vibrate;
+    batch[i].timestamp = t;
+  }
+
+  uint64_t t0 = cpu_now_ns();
+  sim_accel_handler()(batch, n);
+  s_result.cpu_ns += cpu_now_ns() - t0;
+  s_result.batches++;
+  s_result.samples += n;
+}
+
+static void peek_source(uint64_t now_ms, AccelData *data) {
+  const TraceSample *s = trace_sample_at(s_trace, (uint32_t)(now_ms - s_start_ms), &s_peek_cursor);
+  data->x = s->x;
+  data->y = s->y;
+  data->z = s->z;
+  data->did_vibrate = s->vibrate;
+  data->timestamp = now_ms;
+}
+
+// Time of the next tap in the trace after after_ms, or SIM_NO_DEADLINE
+static uint64_t next_tap_ms(uint64_t after_ms, AccelAxisType *axis, int32_t *direction) {
+  for (; s_tap_cursor + 1 < s_trace->count; s_tap_cursor++) {
+    const TraceSample *a = &s_trace->samples[s_tap_cursor];
+    const TraceSample *b = &s_trace->samples[s_tap_cursor + 1];
+    uint64_t t = s_start_ms + b->t_ms;
+    if (t <= after_ms) {
+      continue;
+    }
+    int dx = b->x - a->x, dy = b->y - a->y, dz = b->z - a->z;
+    uint32_t dt = b->t_ms - a->t_ms;
+    uint32_t jerk = (uint32_t)(abs(dx) + abs(dy) + abs(dz)) * 10 / (dt ? dt : 1);
+    if (jerk > SIM_TAP_JERK) {
+      int largest = dx;
+      *axis = ACCEL_AXIS_X;
+      if (abs(dy) > abs(largest)) {
+        largest = dy;
+        *axis = ACCEL_AXIS_Y;
+      }
+      if (abs(dz) > abs(largest)) {
+        largest = dz;
+        *axis = ACCEL_AXIS_Z;
+      }
+      *direction = largest < 0 ? -1 : 1;
+      return t;
+    }
+  }
+  return SIM_NO_DEADLINE;
+}
+
+// Returns false if the stats saved on unsubscribe do not match the service's
+static bool replay(const Trace *trace, ReplayResult *result) {
+  s_trace = trace;
+  memset(&s_result, 0, sizeof(s_result));
+  s_label_cursor = 0;
+  s_label = false;
+  s_glance_open = false;
+  s_peek_cursor = 0;
+  s_tap_cursor = 0;
+
+  sim_reset(SIM_START_MS);
+  sim_set_peek_source(peek_source);
+  s_start_ms = sim_now();
+  uint64_t end_ms = s_start_ms + trace_duration_ms(trace);
+
+  glancing_service_reset_stats();
+  glancing_service_persist_stats(REPLAY_STATS_PERSIST_KEY);
+  glancing_service_subscribe(true, false, NULL);
+  glancing_service_add_subscriber(GLANCE_EVENT_MASK_ALL, on_glance_transitions, NULL);
+
+  size_t cursor = 0;
+  uint32_t epoch = sim_accel_config_epoch() - 1;
+  uint64_t next_batch_ms = 0;
+  AccelAxisType tap_axis = ACCEL_AXIS_X;
+  int32_t tap_direction = 0;
+  uint64_t tap_ms = next_tap_ms(s_start_ms, &tap_axis, &tap_direction);
+  for (;;) {
+    if (sim_accel_config_epoch() != epoch) {
+      // Subscription or rate changed - the next batch fills from now
+      epoch = sim_accel_config_epoch();
+      next_batch_ms = sim_now() + batch_period_ms();
+    }
+
+    uint64_t t = sim_next_timer_deadline();
+    enum { EVENT_TIMER, EVENT_BATCH, EVENT_TAP } event = EVENT_TIMER;
+    if (sim_accel_subscribed() && next_batch_ms <= t) {
+      t = next_batch_ms;
+      event = EVENT_BATCH;
+    }
+    if (tap_ms < t) {
+      t = tap_ms;
+      event = EVENT_TAP;
+    }
+    if (t == SIM_NO_DEADLINE || t > end_ms) {
+      break;
+    }
+
+    sim_advance_to(t);
+    if (event == EVENT_BATCH) {
+      next_batch_ms = t + batch_period_ms();
+      deliver_batch(&cursor);
+    }
+    else if (event == EVENT_TAP) {
+      // Taps while nobody is listening are lost
+      if (sim_tap_handler()) {
+        s_result.taps++;
+        sim_tap_handler()(tap_axis, tap_direction);
+      }
+      tap_ms = next_tap_ms(t + SIM_TAP_REFRACTORY_MS - 1, &tap_axis, &tap_direction);
+    }
+    else {
+      sim_fire_due_timers();
+    }
+  }
+  sim_advance_to(end_ms);
+  advance_labels(end_ms);
+
+  glancing_service_unsubscribe();
+  GlanceStats stats;
+  glancing_service_get_stats(&stats);
+
+  // Unsubscribing again must not write, and what was written is the lot
+  const SimCounters *c = sim_counters();
+  const uint32_t persist_writes = c->persist_writes;
+  glancing_service_unsubscribe();
+  GlanceStats saved;
+  glancing_service_reset_stats();
+  bool stats_ok = glancing_service_persist_stats(REPLAY_STATS_PERSIST_KEY);
+  glancing_service_get_stats(&saved);
+  stats_ok = stats_ok && (c->persist_writes == persist_writes) &&
+             (memcmp(&saved, &stats, sizeof(stats)) == 0);
+  if (!stats_ok) {
+    fprintf(stderr, "%s: glance stats not saved on unsubscribe\n", trace->name);
+  }
+
+  s_result.wakes = stats.wakes_by_tap + stats.wakes_by_peek;
+  s_result.wake_latency_sum_ms = stats.wake_latency_total_ms;
+  for (int i = 0; i < GLANCE_LATENCY_BUCKETS; i++) {
+    s_result.raises += stats.raise_to_light[i];
+  }
+  s_result.raise_latency_sum_ms = stats.raise_to_light_total_ms;
+  s_result.duration_ms = end_ms - s_start_ms;
+  s_result.ms_10hz = c->ms_at_rate[ACCEL_SAMPLING_10HZ];
+  s_result.ms_25hz = c->ms_at_rate[ACCEL_SAMPLING_25HZ];
+  s_result.ms_other_rate = c->ms_at_rate[ACCEL_SAMPLING_50HZ] + c->ms_at_rate[ACCEL_SAMPLING_100HZ];
+  s_result.ms_unsubscribed = c->ms_unsubscribed;
+  s_result.light_interactions = c->light_interactions;
+  *result = s_result;
+  return stats_ok;
+}
+
+static const char *trace_event_name(uint8_t event) {
+  switch (event) {
+    case GLANCE_TRACE_SAMPLING: return "SAMPLING";
+    case GLANCE_TRACE_ZONE: return "ZONE";
+    case GLANCE_TRACE_FSM2: return "FSM2";
+    case GLANCE_TRACE_FSM3: return "FSM3";
+    case GLANCE_TRACE_OUTPUT: return "OUTPUT";
+    case GLANCE_TRACE_LIGHT: return "LIGHT";
+    case GLANCE_TRACE_TAP: return "TAP";
+    case GLANCE_TRACE_WAKE: return "WAKE";
+    default: return "?";
+  }
+}
+
+// Decode the serialized ring the same way app.js does, times relative to
+// the start of the trace
+static void print_glance_trace(const char *name) {
+  uint8_t buffer[GLANCE_TRACE_DUMP_SIZE];
+  uint16_t length = glance_trace_copy(buffer, sizeof(buffer));
+  if (length < GLANCE_TRACE_HEADER_SIZE) {
+    printf("%s: tracing compiled out\n", name);
+    return;
+  }
+
+  uint16_t count = buffer[2] | (buffer[3] << 8);
+  uint32_t last_ms = buffer[4] | (buffer[5] << 8) | (buffer[6] << 16) | ((uint32_t)buffer[7] << 24);
+  const GlanceTraceEntry *entries = (const GlanceTraceEntry *)(buffer + GLANCE_TRACE_HEADER_SIZE);
+
+  uint32_t elapsed = 0;
+  for (uint16_t i = 1; i < count; i++) {
+    elapsed += entries[i].delta_ms;
+  }
+  uint32_t t = last_ms - elapsed - (uint32_t)s_start_ms;
+
+  printf("%s: last %u trace events\n", name, count);
+  for (uint16_t i = 0; i < count; i++) {
+    if (i > 0) {
+      t += entries[i].delta_ms;
+    }
+    printf("  %9.3f %-8s %3u %6d\n", t / 1000.0, trace_event_name(entries[i].event),
+           entries[i].arg0, entries[i].arg1);
+  }
+}
+
+void replay_set_print_trace(bool print) {
+  s_print_trace = print;
+}
+
+void replay_set_delivery_lateness(uint32_t lateness_ms) {
+  s_lateness_ms = lateness_ms;
+}
+
+bool replay_isolated(const Trace *trace, ReplayResult *result) {
+  int fds[2];
+  if (pipe(fds) != 0) {
+    perror("pipe");
+    return false;
+  }
+  fflush(stdout);
+  fflush(stderr);
+
+  pid_t pid = fork();
+  if (pid < 0) {
+    perror("fork");
+    return false;
+  }
+  if (pid == 0) {
+    close(fds[0]);
+    ReplayResult r;
+    const bool ok = replay(trace, &r);
+    if (s_print_trace) {
+      print_glance_trace(trace->name);
+    }
+    fflush(stdout);
+    ssize_t written = write(fds[1], &r, sizeof(r));
+    _exit((ok && (written == sizeof(r))) ? 0 : 1);
+  }
+
+  close(fds[1]);
+  ssize_t got = read(fds[0], result, sizeof(*result));
+  close(fds[0]);
+  int status = 0;
+  waitpid(pid, &status, 0);
+  return got == sizeof(*result) && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+void replay_print_header(void) {
+  printf("%-16s %7s %7s %8s %9s %7s %5s %7s %7s %5s %6s %5s %7s %7s %7s %7s %5s %7s %6s %6s\n",
+         "trace", "dur_s", "batches", "samples", "ns/sample", "glances", "hit",
+         "lat_avg", "lat_max", "false", "zones", "draws", "10Hz_s", "25Hz_s", "other_s", "susp_s",
+         "wakes", "wake_ms", "lights", "r2l_ms");
+}
+
+void replay_print_row(const char *name, const ReplayResult *r) {
+  printf("%-16.16s %7.1f %7llu %8llu %9.1f %7u %5u %7.0f %7u %5u %6u %5u %7.1f %7.1f %7.1f %7.1f %5u %7.0f %6u %6.0f\n",
+         name,
+         r->duration_ms / 1000.0,
+         (unsigned long long)r->batches,
+         (unsigned long long)r->samples,
+         r->samples ? (double)r->cpu_ns / r->samples : 0.0,
+         r->glances,
+         r->detected,
+         r->detected ? (double)r->latency_sum_ms / r->detected : 0.0,
+         r->latency_max_ms,
+         r->false_activations,
+         r->zone_events,
+         r->deliveries,
+         r->ms_10hz / 1000.0,
+         r->ms_25hz / 1000.0,
+         r->ms_other_rate / 1000.0,
+         r->ms_unsubscribed / 1000.0,
+         r->wakes,
+         r->wakes ? (double)r->wake_latency_sum_ms / r->wakes : 0.0,
+         r->light_interactions,
+         r->raises ? (double)r->raise_latency_sum_ms / r->raises : 0.0);
+}
+
+void replay_accumulate(ReplayResult *total, const ReplayResult *r) {
+  total->duration_ms += r->duration_ms;
+  total->batches += r->batches;
+  total->samples += r->samples;
+  total->cpu_ns += r->cpu_ns;
+  total->glances += r->glances;
+  total->detected += r->detected;
+  total->latency_sum_ms += r->latency_sum_ms;
+  if (r->latency_max_ms > total->latency_max_ms) {
+    total->latency_max_ms = r->latency_max_ms;
+  }
+  total->false_activations += r->false_activations;
+  total->zone_events += r->zone_events;
+  total->deliveries += r->deliveries;
+  total->output_events += r->output_events;
+  total->ms_10hz += r->ms_10hz;
+  total->ms_25hz += r->ms_25hz;
+  total->ms_other_rate += r->ms_other_rate;
+  total->ms_unsubscribed += r->ms_unsubscribed;
+  total->light_interactions += r->light_interactions;
+  total->taps += r->taps;
+  total->wakes += r->wakes;
+  total->wake_latency_sum_ms += r->wake_latency_sum_ms;
+  total->raises += r->raises;
+  total->raise_latency_sum_ms += r->raise_latency_sum_ms;
+}
+
+bool replay_run_trace(const Trace *trace, ReplayResult *total) {
+  ReplayResult r;
+  if (!replay_isolated(trace, &r)) {
+    fprintf(stderr, "%s: replay failed\n", trace->name);
+    return false;
+  }
+  replay_print_row(trace->name, &r);
+  replay_accumulate(total, &r);
+  return true;
+}
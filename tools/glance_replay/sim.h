@@ -0,0 +1,49 @@
+#pragma once
+
+#include "pebble.h"
+
+// Harness-side view of the simulated Pebble in pebble_stub.c
+
+#define SIM_NO_DEADLINE UINT64_MAX
+
+typedef struct SimCounters {
+  uint32_t light_interactions;  // light_enable_interaction() calls
+  uint32_t light_off;           // light_enable(false) calls
+  uint32_t timers_registered;
+  uint32_t rate_changes;        // accel rate or batch size reconfigurations
+  uint64_t ms_at_rate[101];     // Simulated ms spent subscribed, indexed by Hz
+  uint64_t ms_unsubscribed;
+  uint32_t persist_writes;
+  uint32_t peeks;               // accel_service_peek() calls
+} SimCounters;
+
+// Supplies the reading accel_service_peek() returns at the current time
+typedef void (*SimPeekSource)(uint64_t now_ms, AccelData *data);
+
+void sim_reset(uint64_t start_ms);
+uint64_t sim_now(void);
+
+// Move the clock forward, accounting the elapsed time to the current rate
+void sim_advance_to(uint64_t t_ms);
+
+// Earliest pending AppTimer deadline, or SIM_NO_DEADLINE
+uint64_t sim_next_timer_deadline(void);
+
+// Run every timer whose deadline is <= now, in deadline order
+void sim_fire_due_timers(void);
+
+bool sim_accel_subscribed(void);
+AccelDataHandler sim_accel_handler(void);
+uint32_t sim_samples_per_update(void);
+uint32_t sim_sampling_rate_hz(void);
+
+// Tap handler, or NULL while the tap service is not subscribed
+AccelTapHandler sim_tap_handler(void);
+void sim_set_peek_source(SimPeekSource source);
+
+// Bumped whenever the subscription, rate or batch size changes, so the
+// harness knows to reschedule the next batch delivery.
+uint32_t sim_accel_config_epoch(void);
+
+void sim_set_verbose(bool verbose);
+const SimCounters *sim_counters(void);
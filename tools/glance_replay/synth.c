@@ -0,0 +1,187 @@
+#include <math.h>
+#include <string.h>
+#include "trace.h"
+
+// Synthetic wrist movements, generated at 100Hz.  These are no substitute
+// for recordings from real wrists, but they exercise every zone and FSM
+// path repeatably, so a regression shows up as a changed number.
+
+#define SYNTH_STEP_MS 10
+
+typedef struct Pose {
+  int x;
+  int y;
+  int z;
+} Pose;
+
+// Watch face towards the wearer, inside active_zone
+static const Pose POSE_LOOK = { 0, -350, -850 };
+// Arm hanging by the side, inside dropped_zone
+static const Pose POSE_DROPPED = { 930, 0, -100 };
+// Wrist rotated away, inside roll_zone
+static const Pose POSE_ROLL = { 0, 900, 0 };
+// Wrist resting on a desk, screen up - also inside active_zone
+static const Pose POSE_DESK = { 30, -60, -990 };
+
+typedef struct Synth {
+  Trace *trace;
+  uint32_t t_ms;
+  uint32_t seed;
+  int noise;
+} Synth;
+
+static int synth_rand(Synth *s, int amplitude) {
+  if (amplitude == 0) {
+    return 0;
+  }
+  // Sum of three uniform draws, roughly gaussian in [-amplitude, amplitude]
+  int sum = 0;
+  for (int i = 0; i < 3; i++) {
+    s->seed = s->seed * 1103515245u + 12345u;
+    sum += (int)((s->seed >> 16) % (2 * amplitude + 1)) - amplitude;
+  }
+  return sum / 3;
+}
+
+static void emit(Synth *s, int x, int y, int z, bool glance) {
+  trace_append(s->trace, s->t_ms,
+               x + synth_rand(s, s->noise),
+               y + synth_rand(s, s->noise),
+               z + synth_rand(s, s->noise),
+               glance);
+  s->t_ms += SYNTH_STEP_MS;
+}
+
+static void hold(Synth *s, Pose p, uint32_t ms, bool glance) {
+  for (uint32_t t = 0; t < ms; t += SYNTH_STEP_MS) {
+    emit(s, p.x, p.y, p.z, glance);
+  }
+}
+
+static void move(Synth *s, Pose from, Pose to, uint32_t ms, bool glance) {
+  for (uint32_t t = 0; t < ms; t += SYNTH_STEP_MS) {
+    emit(s,
+         from.x + (to.x - from.x) * (int)t / (int)ms,
+         from.y + (to.y - from.y) * (int)t / (int)ms,
+         from.z + (to.z - from.z) * (int)t / (int)ms,
+         glance);
+  }
+}
+
+static void scenario_glance(Synth *s) {
+  for (int i = 0; i < 10; i++) {
+    hold(s, POSE_DROPPED, 8000, false);
+    move(s, POSE_DROPPED, POSE_LOOK, 400, true);
+    hold(s, POSE_LOOK, 3000, true);
+    move(s, POSE_LOOK, POSE_DROPPED, 400, false);
+  }
+  hold(s, POSE_DROPPED, 20000, false);
+}
+
+static void scenario_slow_glance(Synth *s) {
+  for (int i = 0; i < 10; i++) {
+    hold(s, POSE_DROPPED, 8000, false);
+    move(s, POSE_DROPPED, POSE_LOOK, 1500, true);
+    hold(s, POSE_LOOK, 2000, true);
+    move(s, POSE_LOOK, POSE_DROPPED, 1500, false);
+  }
+  hold(s, POSE_DROPPED, 20000, false);
+}
+
+// Wearer is already looking, then flicks the wrist away and back to
+// extend the light.
+static void scenario_roll(Synth *s) {
+  for (int i = 0; i < 5; i++) {
+    hold(s, POSE_DROPPED, 6000, false);
+    move(s, POSE_DROPPED, POSE_LOOK, 400, true);
+    hold(s, POSE_LOOK, 2000, true);
+    move(s, POSE_LOOK, POSE_ROLL, 250, true);
+    hold(s, POSE_ROLL, 150, true);
+    move(s, POSE_ROLL, POSE_LOOK, 250, true);
+    hold(s, POSE_LOOK, 2000, true);
+    move(s, POSE_LOOK, POSE_DROPPED, 400, false);
+  }
+  hold(s, POSE_DROPPED, 20000, false);
+}
+
+static void scenario_idle(Synth *s) {
+  s->noise = 15;
+  hold(s, POSE_DROPPED, 300000, false);
+}
+
+static void scenario_walk(Synth *s) {
+  for (uint32_t t = 0; t < 120000; t += SYNTH_STEP_MS) {
+    double phase = 2.0 * M_PI * t / 1100.0;
+    emit(s,
+         POSE_DROPPED.x + (int)(120 * sin(2 * phase)),
+         (int)(350 * sin(phase)),
+         POSE_DROPPED.z + (int)(250 * cos(phase)),
+         false);
+  }
+}
+
+static void scenario_desk(Synth *s) {
+  s->noise = 60;
+  hold(s, POSE_DROPPED, 5000, false);
+  move(s, POSE_DROPPED, POSE_DESK, 600, false);
+  hold(s, POSE_DESK, 60000, false);
+  move(s, POSE_DESK, POSE_DROPPED, 600, false);
+  hold(s, POSE_DROPPED, 20000, false);
+}
+
+// Long still spells with the arm down, long enough for the service to
+// suspend sampling, each ended by a glance.  Alternate glances start
+// with a sharp flick, which the tap detector sees.
+static void scenario_sleep(Synth *s) {
+  s->noise = 10;
+  for (int i = 0; i < 6; i++) {
+    hold(s, POSE_DROPPED, 60000, false);
+    move(s, POSE_DROPPED, POSE_LOOK, (i & 1) ? 30 : 400, true);
+    hold(s, POSE_LOOK, 3000, true);
+    move(s, POSE_LOOK, POSE_DROPPED, 400, false);
+  }
+  hold(s, POSE_DROPPED, 20000, false);
+}
+
+// Arm hanging at the very edge of dropped_zone, so noise flips the zone
+static void scenario_edge(Synth *s) {
+  s->noise = 40;
+  Pose edge = { 805, 0, -100 };
+  hold(s, edge, 120000, false);
+}
+
+typedef struct Scenario {
+  const char *name;
+  void (*generate)(Synth *s);
+} Scenario;
+
+static const Scenario SCENARIOS[] = {
+  { "glance", scenario_glance },
+  { "slow_glance", scenario_slow_glance },
+  { "roll", scenario_roll },
+  { "idle", scenario_idle },
+  { "walk", scenario_walk },
+  { "desk", scenario_desk },
+  { "edge", scenario_edge },
+  { "sleep", scenario_sleep },
+};
+
+size_t synth_scenario_count(void) {
+  return sizeof(SCENARIOS) / sizeof(SCENARIOS[0]);
+}
+
+const char *synth_scenario_name(size_t index) {
+  return index < synth_scenario_count() ? SCENARIOS[index].name : NULL;
+}
+
+bool synth_generate(Trace *trace, const char *name) {
+  for (size_t i = 0; i < synth_scenario_count(); i++) {
+    if (strcmp(SCENARIOS[i].name, name) == 0) {
+      trace_init(trace, name);
+      Synth s = { .trace = trace, .t_ms = 0, .seed = 12345u + (uint32_t)i, .noise = 25 };
+      SCENARIOS[i].generate(&s);
+      return true;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,105 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "trace.h"
+
+void trace_init(Trace *trace, const char *name) {
+  memset(trace, 0, sizeof(*trace));
+  strncpy(trace->name, name, sizeof(trace->name) - 1);
+}
+
+void trace_free(Trace *trace) {
+  free(trace->samples);
+  trace->samples = NULL;
+  trace->count = 0;
+  trace->capacity = 0;
+}
+
+void trace_append(Trace *trace, uint32_t t_ms, int x, int y, int z, bool glance) {
+  if (trace->count == trace->capacity) {
+    trace->capacity = trace->capacity ? 2 * trace->capacity : 1024;
+    trace->samples = realloc(trace->samples, trace->capacity * sizeof(TraceSample));
+    if (!trace->samples) {
+      fprintf(stderr, "trace: out of memory\n");
+      exit(1);
+    }
+  }
+  TraceSample *s = &trace->samples[trace->count++];
+  s->t_ms = t_ms;
+  s->x = x;
+  s->y = y;
+  s->z = z;
+  s->glance = glance ? 1 : 0;
+  s->vibrate = 0;
+}
+
+uint32_t trace_duration_ms(const Trace *trace) {
+  return trace->count ? trace->samples[trace->count - 1].t_ms : 0;
+}
+
+bool trace_load_csv(Trace *trace, const char *path) {
+  FILE *f = fopen(path, "r");
+  if (!f) {
+    perror(path);
+    return false;
+  }
+
+  const char *base = strrchr(path, '/');
+  trace_init(trace, base ? base + 1 : path);
+
+  char line[256];
+  int line_no = 0;
+  while (fgets(line, sizeof(line), f)) {
+    line_no++;
+    char *p = line;
+    while (*p == ' ' || *p == '\t') p++;
+    if (*p == '#' || *p == '\n' || *p == '\r' || *p == 0) {
+      continue;
+    }
+
+    unsigned long t_ms;
+    int x, y, z, glance = 0, vibrate = 0;
+    int fields = sscanf(p, "%lu,%d,%d,%d,%d,%d", &t_ms, &x, &y, &z, &glance, &vibrate);
+    if (fields < 4) {
+      fprintf(stderr, "%s:%d: expected t_ms,x,y,z[,glance[,vibrate]]\n", path, line_no);
+      fclose(f);
+      trace_free(trace);
+      return false;
+    }
+    if (trace->count && t_ms < trace->samples[trace->count - 1].t_ms) {
+      fprintf(stderr, "%s:%d: time goes backwards\n", path, line_no);
+      fclose(f);
+      trace_free(trace);
+      return false;
+    }
+    trace_append(trace, (uint32_t)t_ms, x, y, z, glance != 0);
+    trace->samples[trace->count - 1].vibrate = (vibrate != 0);
+  }
+
+  fclose(f);
+  return trace->count > 0;
+}
+
+bool trace_save_csv(const Trace *trace, const char *path) {
+  FILE *f = fopen(path, "w");
+  if (!f) {
+    perror(path);
+    return false;
+  }
+  fprintf(f, "# %s\n# t_ms,x,y,z,glance,vibrate\n", trace->name);
+  for (size_t i = 0; i < trace->count; i++) {
+    const TraceSample *s = &trace->samples[i];
+    fprintf(f, "%u,%d,%d,%d,%d,%d\n", s->t_ms, s->x, s->y, s->z, s->glance, s->vibrate);
+  }
+  fclose(f);
+  return true;
+}
+
+const TraceSample *trace_sample_at(const Trace *trace, uint32_t t_ms, size_t *cursor) {
+  size_t i = *cursor;
+  while (i + 1 < trace->count && trace->samples[i + 1].t_ms <= t_ms) {
+    i++;
+  }
+  *cursor = i;
+  return &trace->samples[i];
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// An accelerometer recording, plus the ground truth of when the wearer
+// was actually trying to look at the watch.
+//
+// CSV form, one sample per line, '#' starts a comment:
+//   t_ms,x,y,z,glance,vibrate
+// t_ms is relative to the start of the trace and must be increasing; the
+// samples may be at any rate, the replay picks the latest sample at or
+// before each simulated accelerometer reading.  glance is 1 while the
+// wearer intends to look at the watch, else 0.  vibrate, which may be left
+// off, is 1 for samples taken while the vibe motor ran, as recorded on the
+// watch.
+
+typedef struct TraceSample {
+  uint32_t t_ms;
+  int16_t x;
+  int16_t y;
+  int16_t z;
+  uint8_t glance;
+  uint8_t vibrate;
+} TraceSample;
+
+typedef struct Trace {
+  char name[64];
+  TraceSample *samples;
+  size_t count;
+  size_t capacity;
+} Trace;
+
+void trace_init(Trace *trace, const char *name);
+void trace_free(Trace *trace);
+void trace_append(Trace *trace, uint32_t t_ms, int x, int y, int z, bool glance);
+uint32_t trace_duration_ms(const Trace *trace);
+
+// Returns false (and prints why) if the file can't be read or parsed
+bool trace_load_csv(Trace *trace, const char *path);
+bool trace_save_csv(const Trace *trace, const char *path);
+
+// Latest sample at or before t_ms.  *cursor must start at 0 and is
+// advanced so that a monotonic sweep of the trace is linear overall.
+const TraceSample *trace_sample_at(const Trace *trace, uint32_t t_ms, size_t *cursor);
+
+// Built-in synthetic scenarios, deterministic for a given name
+size_t synth_scenario_count(void);
+const char *synth_scenario_name(size_t index);
+bool synth_generate(Trace *trace, const char *name);
@@ -0,0 +1,223 @@
+// Checks that the exact zone classifier backends in src/glance_zones.c
+// agree, measures how often the approximate LUT backend agrees with them,
+// and measures what each costs per accelerometer batch.
+//
+//   zone_bench                 built-in synthetic scenarios
+//   zone_bench a.csv b.csv     recorded traces (see trace.h)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "trace.h"
+#include "glance_zones.h"
+
+#define REPEATS 50
+#define TRIALS 5
+
+typedef void (*BatchClassifier)(GlanceZone current_zone, const AccelData *data,
+                                uint32_t num_samples, uint8_t *zones_out);
+
+typedef struct Backend {
+  const char *name;
+  BatchClassifier classify;
+  bool exact;   // Must agree with the first backend
+} Backend;
+
+static const Backend BACKENDS[] = {
+  { "boxes", glance_zone_classify_batch_boxes, true },
+  { "swar", glance_zone_classify_batch_swar, true },
+  { "lut", glance_zone_classify_batch_lut, false },
+};
+#define LUT_BACKEND 2
+#define NUM_BACKENDS (sizeof(BACKENDS) / sizeof(BACKENDS[0]))
+
+static uint64_t cpu_now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint32_t s_seed = 1;
+static int rand_between(int lo, int hi) {
+  s_seed = s_seed * 1103515245u + 12345u;
+  return lo + (int)((s_seed >> 8) % (uint32_t)(hi - lo + 1));
+}
+
+// A coordinate that is often right on, or one either side of, a box edge
+static int edgy_coordinate(const int *edges, int num_edges) {
+  if (rand_between(0, 3) == 0) {
+    return rand_between(-4000, 4000);
+  }
+  return edges[rand_between(0, num_edges - 1)] + rand_between(-1, 1);
+}
+
+static int check_random(void) {
+  const glancing_zone *zones[] = { &active_zone, &dropped_zone, &roll_zone };
+  // The stay and enter boxes of each zone, i.e. grown by the exit margin
+  // and shrunk by the entry margin
+  int x_edges[12], y_edges[12], z_edges[12];
+  for (int i = 0; i < 3; i++) {
+    const int grow = zones[i]->exit_margin;
+    const int shrink = zones[i]->entry_margin;
+    x_edges[4 * i] = zones[i]->x_segment.start - grow;
+    x_edges[4 * i + 1] = zones[i]->x_segment.start + shrink;
+    x_edges[4 * i + 2] = zones[i]->x_segment.end + grow;
+    x_edges[4 * i + 3] = zones[i]->x_segment.end - shrink;
+    y_edges[4 * i] = zones[i]->y_segment.start - grow;
+    y_edges[4 * i + 1] = zones[i]->y_segment.start + shrink;
+    y_edges[4 * i + 2] = zones[i]->y_segment.end + grow;
+    y_edges[4 * i + 3] = zones[i]->y_segment.end - shrink;
+    z_edges[4 * i] = zones[i]->z_segment.start - grow;
+    z_edges[4 * i + 1] = zones[i]->z_segment.start + shrink;
+    z_edges[4 * i + 2] = zones[i]->z_segment.end + grow;
+    z_edges[4 * i + 3] = zones[i]->z_segment.end - shrink;
+  }
+
+  int mismatches = 0;
+  uint32_t lut_samples = 0, lut_agree = 0;
+  AccelData batch[GLANCE_ZONE_MAX_BATCH];
+  for (int round = 0; round < 100000; round++) {
+    uint32_t n = rand_between(1, GLANCE_ZONE_MAX_BATCH);
+    GlanceZone start = rand_between(GLANCE_ZONE_INACTIVE, GLANCE_ZONE_NONE);
+    for (uint32_t i = 0; i < n; i++) {
+      batch[i].x = edgy_coordinate(x_edges, 12);
+      batch[i].y = edgy_coordinate(y_edges, 12);
+      batch[i].z = edgy_coordinate(z_edges, 12);
+    }
+
+    uint8_t expected[GLANCE_ZONE_MAX_BATCH];
+    BACKENDS[0].classify(start, batch, n, expected);
+    for (size_t b = 1; b < NUM_BACKENDS; b++) {
+      uint8_t got[GLANCE_ZONE_MAX_BATCH];
+      BACKENDS[b].classify(start, batch, n, got);
+      if (!BACKENDS[b].exact) {
+        for (uint32_t i = 0; i < n; i++) {
+          lut_agree += (got[i] == expected[i]);
+        }
+        lut_samples += n;
+      }
+      else if (memcmp(expected, got, n) != 0 && mismatches++ < 10) {
+        printf("FAIL: %s disagrees with %s, batch of %u from zone %d\n",
+               BACKENDS[b].name, BACKENDS[0].name, n, start);
+      }
+    }
+  }
+  printf("zone_bench: %d random batches checked, %d mismatches, lut agrees on %.1f%% of edge samples\n",
+         100000, mismatches, 100.0 * lut_agree / (lut_samples ? lut_samples : 1));
+  return mismatches;
+}
+
+// Slice the trace into the batches the watch would see at one rate
+static AccelData *make_batches(const Trace *trace, uint32_t rate_hz, uint32_t batch_size,
+                               uint32_t *num_batches) {
+  uint32_t step_ms = 1000 / rate_hz;
+  uint32_t samples = trace_duration_ms(trace) / step_ms;
+  *num_batches = samples / batch_size;
+  AccelData *data = calloc((size_t)*num_batches * batch_size, sizeof(AccelData));
+
+  size_t cursor = 0;
+  for (uint32_t i = 0; i < *num_batches * batch_size; i++) {
+    const TraceSample *s = trace_sample_at(trace, i * step_ms, &cursor);
+    data[i].x = s->x;
+    data[i].y = s->y;
+    data[i].z = s->z;
+  }
+  return data;
+}
+
+static int bench_trace(const Trace *trace) {
+  static const struct { uint32_t rate_hz; uint32_t batch_size; } MODES[] = {
+    { 10, 7 },
+    { 25, 5 },
+  };
+  int mismatches = 0;
+
+  for (size_t m = 0; m < sizeof(MODES) / sizeof(MODES[0]); m++) {
+    uint32_t num_batches;
+    uint32_t batch_size = MODES[m].batch_size;
+    AccelData *data = make_batches(trace, MODES[m].rate_hz, batch_size, &num_batches);
+    uint8_t *zones[NUM_BACKENDS];
+    double ns_per_batch[NUM_BACKENDS];
+
+    for (size_t b = 0; b < NUM_BACKENDS; b++) {
+      zones[b] = malloc((size_t)num_batches * batch_size);
+      // Best of several trials, to keep scheduler noise out of the numbers
+      uint64_t best_ns = UINT64_MAX;
+      for (int trial = 0; trial < TRIALS; trial++) {
+        uint64_t t0 = cpu_now_ns();
+        for (int r = 0; r < REPEATS; r++) {
+          GlanceZone zone = GLANCE_ZONE_NONE;
+          for (uint32_t i = 0; i < num_batches; i++) {
+            uint8_t *out = &zones[b][i * batch_size];
+            BACKENDS[b].classify(zone, &data[i * batch_size], batch_size, out);
+            zone = out[batch_size - 1];
+          }
+        }
+        uint64_t elapsed = cpu_now_ns() - t0;
+        if (elapsed < best_ns) {
+          best_ns = elapsed;
+        }
+      }
+      ns_per_batch[b] = (double)best_ns / REPEATS / (num_batches ? num_batches : 1);
+    }
+
+    for (size_t b = 1; b < NUM_BACKENDS; b++) {
+      if (BACKENDS[b].exact && memcmp(zones[0], zones[b], (size_t)num_batches * batch_size) != 0) {
+        printf("FAIL: %s disagrees with %s on %s\n", BACKENDS[b].name, BACKENDS[0].name, trace->name);
+        mismatches++;
+      }
+    }
+    const uint32_t num_samples = num_batches * batch_size;
+    uint32_t lut_agree = 0;
+    for (uint32_t i = 0; i < num_samples; i++) {
+      lut_agree += (zones[LUT_BACKEND][i] == zones[0][i]);
+    }
+
+    printf("%-16.16s %2uHz x%-2u %7u", trace->name, MODES[m].rate_hz, batch_size, num_batches);
+    for (size_t b = 0; b < NUM_BACKENDS; b++) {
+      printf(" %9.1f", ns_per_batch[b]);
+    }
+    printf(" %7.2fx %7.2fx %8.1f%%\n", ns_per_batch[0] / ns_per_batch[1], ns_per_batch[0] / ns_per_batch[LUT_BACKEND],
+           100.0 * lut_agree / (num_samples ? num_samples : 1));
+
+    for (size_t b = 0; b < NUM_BACKENDS; b++) {
+      free(zones[b]);
+    }
+    free(data);
+  }
+  return mismatches;
+}
+
+int main(int argc, char **argv) {
+  glance_zones_pack();
+  int failures = check_random();
+
+  printf("%-16s %-8s %7s", "trace", "mode", "batches");
+  for (size_t b = 0; b < NUM_BACKENDS; b++) {
+    printf(" %6s_ns", BACKENDS[b].name);
+  }
+  printf(" %8s %8s %9s\n", "swar_x", "lut_x", "lut_agree");
+
+  if (argc > 1) {
+    for (int i = 1; i < argc; i++) {
+      Trace trace;
+      if (!trace_load_csv(&trace, argv[i])) {
+        failures++;
+        continue;
+      }
+      failures += bench_trace(&trace);
+      trace_free(&trace);
+    }
+  }
+  else {
+    for (size_t i = 0; i < synth_scenario_count(); i++) {
+      Trace trace;
+      synth_generate(&trace, synth_scenario_name(i));
+      failures += bench_trace(&trace);
+      trace_free(&trace);
+    }
+  }
+  return failures ? 1 : 0;
+}
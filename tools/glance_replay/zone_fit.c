@@ -0,0 +1,203 @@
+// Fits the glance zone boxes to labelled accelerometer traces.
+//
+//   zone_fit                        fit to the built-in synthetic scenarios
+//   zone_fit a.csv b.csv            fit to recorded traces (see trace.h)
+//   zone_fit -s glance -s desk ...  fit to some of the synthetic scenarios
+//   zone_fit -o glance_zone_bounds.h ...   also write the generated header
+//
+// Starting from the bounds compiled in, a coordinate descent nudges one
+// box edge at a time, keeping a change only if it lowers the cost over
+// all the traces:
+//
+//   COST_FALSE x false activations + COST_MISSED x missed glances
+//     + average glance latency in ms + COST_SAMPLE x samples processed
+//
+// so a false activation, which lights the backlight and samples at 25Hz,
+// outweighs a second of latency, and a box that keeps the service from
+// idling or suspending pays for the extra samples.
+//
+// The fit is only as good as the traces: the synthetic scenarios have no
+// ground truth for rolls, so fit to recordings before trusting a change
+// to the roll box.  The fitted bounds are also printed in the form the
+// CfgZoneBounds setting takes, to try them on the watch without a rebuild.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "trace.h"
+#include "replay.h"
+#include "glance_zones.h"
+
+#define COST_FALSE 1000.0
+#define COST_MISSED 2000.0
+#define COST_SAMPLE 0.05
+
+#define MAX_TRACES 32
+
+static const int STEPS[] = { 400, 200, 100, 50, 25 };
+
+static const char *ZONE_NAMES[3] = { "ACTIVE", "DROPPED", "ROLL" };
+static const char *AXIS_NAMES[3] = { "X", "Y", "Z" };
+
+static Trace s_traces[MAX_TRACES];
+static size_t s_num_traces = 0;
+static uint32_t s_evaluations = 0;
+
+static bool evaluate(const int16_t *bounds, ReplayResult *total, double *cost) {
+  if (!glance_zones_set_bounds(bounds)) {
+    return false;
+  }
+  s_evaluations++;
+
+  memset(total, 0, sizeof(*total));
+  for (size_t i = 0; i < s_num_traces; i++) {
+    ReplayResult r;
+    if (!replay_isolated(&s_traces[i], &r)) {
+      fprintf(stderr, "%s: replay failed\n", s_traces[i].name);
+      exit(1);
+    }
+    replay_accumulate(total, &r);
+  }
+
+  *cost = COST_FALSE * total->false_activations +
+          COST_MISSED * (total->glances - total->detected) +
+          (total->detected ? (double)total->latency_sum_ms / total->detected : 0.0) +
+          COST_SAMPLE * total->samples;
+  return true;
+}
+
+static void print_bounds(FILE *out, const char *prefix, const int16_t *bounds) {
+  for (int zone = 0; zone < 3; zone++) {
+    for (int axis = 0; axis < 3; axis++) {
+      const int i = 6 * zone + 2 * axis;
+      fprintf(out, "%s%s_ZONE_%s { %d, %d }\n", prefix, ZONE_NAMES[zone], AXIS_NAMES[axis],
+              bounds[i], bounds[i + 1]);
+    }
+    if (zone < 2) {
+      fprintf(out, "\n");
+    }
+  }
+}
+
+static bool write_header(const char *path, const int16_t *bounds, double cost_before, double cost_after) {
+  FILE *out = fopen(path, "w");
+  if (!out) {
+    perror(path);
+    return false;
+  }
+  fprintf(out, "#pragma once\n\n");
+  fprintf(out, "// Generated by tools/glance_replay/zone_fit - edit by re-running it.\n//\n");
+  fprintf(out, "// Fitted to:");
+  for (size_t i = 0; i < s_num_traces; i++) {
+    fprintf(out, "%s %s", (i && i % 6 == 0) ? "\n//  " : "", s_traces[i].name);
+  }
+  fprintf(out, "\n// Cost %.0f -> %.0f\n\n", cost_before, cost_after);
+  print_bounds(out, "#define GLANCE_", bounds);
+  return fclose(out) == 0;
+}
+
+static void usage(const char *prog) {
+  fprintf(stderr, "usage: %s [-o header.h] [-s scenario]... [trace.csv]...\n", prog);
+}
+
+static bool add_trace(Trace *trace) {
+  if (s_num_traces == MAX_TRACES) {
+    fprintf(stderr, "too many traces, at most %d\n", MAX_TRACES);
+    trace_free(trace);
+    return false;
+  }
+  s_traces[s_num_traces++] = *trace;
+  return true;
+}
+
+int main(int argc, char **argv) {
+  const char *header_path = NULL;
+
+  for (int i = 1; i < argc; i++) {
+    Trace trace;
+    if (strcmp(argv[i], "-o") == 0) {
+      if (++i >= argc) {
+        usage(argv[0]);
+        return 2;
+      }
+      header_path = argv[i];
+    }
+    else if (strcmp(argv[i], "-s") == 0) {
+      if (++i >= argc || !synth_generate(&trace, argv[i])) {
+        usage(argv[0]);
+        return 2;
+      }
+      if (!add_trace(&trace)) {
+        return 2;
+      }
+    }
+    else if (strcmp(argv[i], "-h") == 0) {
+      usage(argv[0]);
+      return 0;
+    }
+    else if (!trace_load_csv(&trace, argv[i]) || !add_trace(&trace)) {
+      return 1;
+    }
+  }
+  if (s_num_traces == 0) {
+    for (size_t i = 0; i < synth_scenario_count() && i < MAX_TRACES; i++) {
+      Trace trace;
+      synth_generate(&trace, synth_scenario_name(i));
+      add_trace(&trace);
+    }
+  }
+
+  glance_zones_pack();
+  int16_t best[GLANCE_ZONE_BOUNDS_COUNT];
+  glance_zones_get_bounds(best);
+
+  ReplayResult before, result;
+  double cost_before, best_cost;
+  evaluate(best, &before, &cost_before);
+  best_cost = cost_before;
+
+  for (size_t s = 0; s < sizeof(STEPS) / sizeof(STEPS[0]); s++) {
+    bool improved = true;
+    while (improved) {
+      improved = false;
+      for (int i = 0; i < GLANCE_ZONE_BOUNDS_COUNT; i++) {
+        for (int direction = -1; direction <= 1; direction += 2) {
+          int16_t candidate[GLANCE_ZONE_BOUNDS_COUNT];
+          memcpy(candidate, best, sizeof(candidate));
+          candidate[i] += direction * STEPS[s];
+
+          double cost;
+          if (evaluate(candidate, &result, &cost) && cost < best_cost) {
+            memcpy(best, candidate, sizeof(best));
+            best_cost = cost;
+            improved = true;
+            printf("  %s %s %s %+d -> cost %.0f\n", ZONE_NAMES[i / 6], AXIS_NAMES[(i % 6) / 2],
+                   (i & 1) ? "end" : "start", direction * STEPS[s], cost);
+          }
+        }
+      }
+    }
+  }
+
+  evaluate(best, &result, &best_cost);
+  printf("\n%u evaluations over %zu traces\n\n", s_evaluations, s_num_traces);
+  replay_print_header();
+  replay_print_row("before", &before);
+  replay_print_row("after", &result);
+
+  printf("\n");
+  print_bounds(stdout, "", best);
+  printf("\nCfgZoneBounds: ");
+  for (int i = 0; i < GLANCE_ZONE_BOUNDS_COUNT; i++) {
+    printf("%d%s", best[i], (i < GLANCE_ZONE_BOUNDS_COUNT - 1) ? "," : "\n");
+  }
+
+  if (header_path && !write_header(header_path, best, cost_before, best_cost)) {
+    return 1;
+  }
+  for (size_t i = 0; i < s_num_traces; i++) {
+    trace_free(&s_traces[i]);
+  }
+  return 0;
+}